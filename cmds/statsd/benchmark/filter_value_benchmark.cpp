@@ -13,6 +13,7 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <unordered_map>
 #include <vector>
 #include "benchmark/benchmark.h"
 #include "FieldValue.h"
@@ -61,6 +62,31 @@ static void BM_FilterValue(benchmark::State& state) {
 
 BENCHMARK(BM_FilterValue);
 
+static void BM_FilterValueAndLookUpSlice(benchmark::State& state) {
+    LogEvent event(1, 100000);
+    FieldMatcher field_matcher;
+    createLogEventAndMatcher(&event, &field_matcher);
+
+    std::vector<Matcher> matchers;
+    translateFieldMatcher(field_matcher, &matchers);
+
+    // A sliced metric looks the key up in its current bucket, and then in its anomaly trackers.
+    std::unordered_map<HashableDimensionKey, int64_t> slices;
+    HashableDimensionKey key;
+    filterValues(matchers, event.getValues(), &key);
+    slices[key] = 0;
+
+    while (state.KeepRunning()) {
+        HashableDimensionKey output;
+        filterValues(matchers, event.getValues(), &output);
+        for (int i = 0; i < 3; i++) {
+            benchmark::DoNotOptimize(slices.find(output));
+        }
+    }
+}
+
+BENCHMARK(BM_FilterValueAndLookUpSlice);
+
 }  //  namespace statsd
 }  //  namespace os
 }  //  namespace android
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <vector>
+#include "benchmark/benchmark.h"
+#include "logd/LogEvent.h"
+#include "stats_log_util.h"
+#include "metric_util.h"
+
+namespace android {
+namespace os {
+namespace statsd {
+
+using std::vector;
+
+// Atom ids that no real atom uses, so that each filler matcher cares about its own atom.
+static const int kFillerAtomIdBase = 100000;
+
+// A config where the screen matchers and predicate sit among many matchers, predicates and
+// count metrics on unrelated atoms. Events for the screen atom only hit a handful of them.
+static StatsdConfig CreateManyMatchersConfig(int fillerMatcherCount) {
+    StatsdConfig config;
+    config.add_allowed_log_source("AID_ROOT");  // LogEvent defaults to UID of root.
+
+    *config.add_atom_matcher() = CreateScreenTurnedOnAtomMatcher();
+    *config.add_atom_matcher() = CreateScreenTurnedOffAtomMatcher();
+    auto screenIsOffPredicate = CreateScreenIsOffPredicate();
+    *config.add_predicate() = screenIsOffPredicate;
+
+    for (int i = 0; i < fillerMatcherCount; i++) {
+        const string name = "Filler" + std::to_string(i);
+        auto matcher = CreateSimpleAtomMatcher(name, kFillerAtomIdBase + i);
+        *config.add_atom_matcher() = matcher;
+
+        auto metric = config.add_count_metric();
+        metric->set_id(StringToId(name + "Count"));
+        metric->set_what(matcher.id());
+        metric->set_bucket(FIVE_MINUTES);
+        // Every few metrics also depend on the screen, so screen changes still have work to do.
+        if (i % 10 == 0) {
+            metric->set_condition(screenIsOffPredicate.id());
+        }
+    }
+    return config;
+}
+
+static void BM_MetricsManagerManyMatchers(benchmark::State& state) {
+    ConfigKey cfgKey;
+    auto config = CreateManyMatchersConfig(state.range(0));
+    int64_t bucketStartTimeNs = 10000000000;
+    auto processor = CreateStatsLogProcessor(bucketStartTimeNs / NS_PER_SEC, config, cfgKey);
+
+    std::vector<std::unique_ptr<LogEvent>> events;
+    for (int i = 0; i < 100; i++) {
+        events.push_back(CreateScreenStateChangedEvent(
+                i % 2 ? android::view::DISPLAY_STATE_ON : android::view::DISPLAY_STATE_OFF,
+                bucketStartTimeNs + i + 1));
+    }
+
+    while (state.KeepRunning()) {
+        for (const auto& event : events) {
+            processor->OnLogEvent(event.get());
+        }
+    }
+}
+
+BENCHMARK(BM_MetricsManagerManyMatchers)->Arg(10)->Arg(100)->Arg(500);
+
+}  //  namespace statsd
+}  //  namespace os
+}  //  namespace android
@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <sys/resource.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <android-base/file.h>
+#include "benchmark/benchmark.h"
+#include "logd/LogEvent.h"
+#include "metric_util.h"
+
+// Counts every allocation made through operator new, so the replay can report allocations per
+// event. The count is global; only the replay benchmark reads it.
+static std::atomic<uint64_t> gAllocationCount(0);
+
+void* operator new(size_t size) {
+    gAllocationCount.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        // statsd is built without exceptions.
+        abort();
+    }
+    return p;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    free(p);
+}
+
+namespace android {
+namespace os {
+namespace statsd {
+
+using std::string;
+using std::vector;
+
+// The replay reads its inputs from these files, since BENCHMARK_MAIN owns the command line.
+//
+// The trace is a sequence of records, each a little-endian uint32_t length followed by that many
+// bytes of log_msg (entry header and payload, i.e. the first log_msg::len() bytes of
+// log_msg::buf), in the order LogReader received them.
+//
+// The config is a serialized StatsdConfig, as passed to "cmd stats config update".
+static const char* kTraceEnv = "STATSD_REPLAY_TRACE";
+static const char* kConfigEnv = "STATSD_REPLAY_CONFIG";
+
+// Splits the trace into its records. They are kept as raw bytes, so that each pass parses them
+// into LogEvents the way LogReader does.
+static bool readTrace(const string& path, vector<string>* records) {
+    string trace;
+    if (!android::base::ReadFileToString(path, &trace)) {
+        return false;
+    }
+    size_t pos = 0;
+    while (pos + sizeof(uint32_t) <= trace.size()) {
+        uint32_t len;
+        memcpy(&len, trace.data() + pos, sizeof(len));
+        pos += sizeof(len);
+        if (len > sizeof(log_msg::buf) || pos + len > trace.size()) {
+            return false;
+        }
+        records->push_back(trace.substr(pos, len));
+        pos += len;
+    }
+    return pos == trace.size();
+}
+
+static int64_t percentile(const vector<int64_t>& sortedLatencies, int p) {
+    if (sortedLatencies.empty()) {
+        return 0;
+    }
+    return sortedLatencies[(sortedLatencies.size() - 1) * p / 100];
+}
+
+// Replays a recorded trace through a processor running the recorded config. Each iteration is
+// one full pass over the trace with a fresh processor, so buckets and conditions start from the
+// same state every time. Per-event latencies cover parsing the record into a LogEvent and
+// processing it, and include the cost of reading the clock.
+static void BM_ReplayTrace(benchmark::State& state) {
+    const char* tracePath = getenv(kTraceEnv);
+    const char* configPath = getenv(kConfigEnv);
+    if (tracePath == nullptr || configPath == nullptr) {
+        state.SkipWithError("Set STATSD_REPLAY_TRACE and STATSD_REPLAY_CONFIG to replay a trace.");
+        return;
+    }
+
+    vector<string> records;
+    if (!readTrace(tracePath, &records) || records.empty()) {
+        state.SkipWithError("Could not read the trace.");
+        return;
+    }
+    string configBytes;
+    StatsdConfig config;
+    if (!android::base::ReadFileToString(configPath, &configBytes) ||
+        !config.ParseFromString(configBytes)) {
+        state.SkipWithError("Could not read the config.");
+        return;
+    }
+
+    // Reused for every record, like the buffer LogReader reads into.
+    log_msg msg;
+    memcpy(msg.buf, records.front().data(), records.front().size());
+    ConfigKey cfgKey;
+    const long timeBaseSec = LogEvent(msg).GetElapsedTimestampNs() / NS_PER_SEC;
+    vector<int64_t> latencies;
+    latencies.reserve(records.size());
+    uint64_t allocations = 0;
+    int64_t eventCount = 0;
+
+    while (state.KeepRunning()) {
+        state.PauseTiming();
+        auto processor = CreateStatsLogProcessor(timeBaseSec, config, cfgKey);
+        latencies.clear();
+        const uint64_t allocationsBefore = gAllocationCount.load(std::memory_order_relaxed);
+        state.ResumeTiming();
+
+        for (const auto& record : records) {
+            memcpy(msg.buf, record.data(), record.size());
+            // Parsing is part of the cost of an event, as it is in LogReader.
+            auto start = std::chrono::steady_clock::now();
+            LogEvent event(msg);
+            processor->OnLogEvent(&event);
+            auto end = std::chrono::steady_clock::now();
+            latencies.push_back(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        }
+
+        state.PauseTiming();
+        allocations += gAllocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+        eventCount += records.size();
+        // The processor goes away here, outside of the timed region.
+        processor.clear();
+        state.ResumeTiming();
+    }
+
+    // Latency percentiles come from the last pass; earlier passes ran the same events.
+    std::sort(latencies.begin(), latencies.end());
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    state.counters["events_per_sec"] = benchmark::Counter(eventCount, benchmark::Counter::kIsRate);
+    state.counters["p50_ns"] = percentile(latencies, 50);
+    state.counters["p99_ns"] = percentile(latencies, 99);
+    // Includes the trace and everything else the process did before the replay.
+    state.counters["peak_rss_kb"] = usage.ru_maxrss;
+    state.counters["allocs_per_event"] =
+            eventCount == 0 ? 0 : static_cast<double>(allocations) / eventCount;
+}
+BENCHMARK(BM_ReplayTrace)->Unit(benchmark::kMillisecond);
+
+}  //  namespace statsd
+}  //  namespace os
+}  //  namespace android
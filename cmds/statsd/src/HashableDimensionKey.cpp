@@ -16,6 +16,7 @@
 #define DEBUG false  // STOPSHIP if true
 #include "Log.h"
 
+#include <algorithm>
 #include <mutex>
 
 #include "HashableDimensionKey.h"
@@ -28,63 +29,166 @@ namespace statsd {
 using std::string;
 using std::vector;
 
-android::hash_t hashDimension(const HashableDimensionKey& value) {
-    android::hash_t hash = 0;
-    for (const auto& fieldValue : value.getValues()) {
-        hash = android::JenkinsHashMix(hash, android::hash_type((int)fieldValue.mField.getField()));
-        hash = android::JenkinsHashMix(hash, android::hash_type((int)fieldValue.mField.getTag()));
-        hash = android::JenkinsHashMix(hash, android::hash_type((int)fieldValue.mValue.getType()));
-        switch (fieldValue.mValue.getType()) {
-            case INT:
-                hash = android::JenkinsHashMix(hash,
-                                               android::hash_type(fieldValue.mValue.int_value));
-                break;
-            case LONG:
-                hash = android::JenkinsHashMix(hash,
-                                               android::hash_type(fieldValue.mValue.long_value));
-                break;
-            case STRING:
-                hash = android::JenkinsHashMix(hash, static_cast<uint32_t>(std::hash<std::string>()(
-                                                             fieldValue.mValue.str_value)));
-                break;
-            case FLOAT: {
-                hash = android::JenkinsHashMix(hash,
-                                               android::hash_type(fieldValue.mValue.float_value));
-                break;
-            }
-            default:
-                break;
+namespace {
+
+// The values of an event are read depth first, so they are sorted by the position of their
+// field at depth 0. Matchers for a single field always compare that position exactly.
+inline bool hasExactTopLevelPos(const Matcher& matcher) {
+    return matcher.getRawMaskAtDepth(0) == kClearLastBitDeco;
+}
+
+inline int32_t getTopLevelPos(const Matcher& matcher) {
+    return matcher.mMatcher.getPosAtDepth(0);
+}
+
+bool isSortedByTopLevelPos(const vector<Matcher>& matchers) {
+    for (size_t i = 0; i < matchers.size(); i++) {
+        if (!hasExactTopLevelPos(matchers[i]) ||
+            (i > 0 && getTopLevelPos(matchers[i]) < getTopLevelPos(matchers[i - 1]))) {
+            return false;
         }
     }
-    return JenkinsHashWhiten(hash);
+    return true;
+}
+
+// Returns whether the matcher may match a value that comes after this one within the same
+// top-level field, e.g. a later node of an attribution chain.
+bool mayMatchLaterInField(const Matcher& matcher, const Field& field) {
+    if (matcher.mMatcher.getDepth() == 0) {
+        return false;
+    }
+    // ANY and LAST can match any node of the chain, and so can ALL, which is encoded as
+    // position 0 under the same mask as FIRST and fixed positions.
+    if (matcher.getRawMaskAtDepth(1) != kClearLastBitDeco ||
+        matcher.mMatcher.getRawPosAtDepth(1) == 0) {
+        return true;
+    }
+    // FIRST or a fixed position: the nodes after it can't match.
+    return field.getPosAtDepth(1) <= matcher.mMatcher.getPosAtDepth(1);
+}
+
+// Returns the index of the first value at or after start whose top-level position is >= pos.
+size_t seekTopLevelPos(const vector<FieldValue>& values, size_t start, int32_t pos) {
+    return std::partition_point(values.begin() + start, values.end(),
+                                [pos](const FieldValue& value) {
+                                    return value.mField.getPosAtDepth(0) < pos;
+                                }) -
+           values.begin();
+}
+
+inline void appendMatchedValue(const FieldValue& value, const Matcher& matcher,
+                               HashableDimensionKey* output) {
+    FieldValue matched = value;
+    matched.mField.setTag(value.mField.getTag());
+    matched.mField.setField(value.mField.getField() & matcher.mMask);
+    output->addValue(matched);
+}
+
+}  // namespace
+
+android::hash_t HashableDimensionKey::mixValue(android::hash_t hash,
+                                               const FieldValue& fieldValue) {
+    hash = android::JenkinsHashMix(hash, android::hash_type((int)fieldValue.mField.getField()));
+    hash = android::JenkinsHashMix(hash, android::hash_type((int)fieldValue.mField.getTag()));
+    hash = android::JenkinsHashMix(hash, android::hash_type((int)fieldValue.mValue.getType()));
+    switch (fieldValue.mValue.getType()) {
+        case INT:
+            hash = android::JenkinsHashMix(hash, android::hash_type(fieldValue.mValue.int_value));
+            break;
+        case LONG:
+            hash = android::JenkinsHashMix(hash, android::hash_type(fieldValue.mValue.long_value));
+            break;
+        case STRING:
+            hash = android::JenkinsHashMix(hash, static_cast<uint32_t>(std::hash<std::string>()(
+                                                         fieldValue.mValue.str_value)));
+            break;
+        case FLOAT: {
+            hash = android::JenkinsHashMix(hash,
+                                           android::hash_type(fieldValue.mValue.float_value));
+            break;
+        }
+        default:
+            break;
+    }
+    return hash;
+}
+
+android::hash_t HashableDimensionKey::computeHashMix() const {
+    android::hash_t hash = 0;
+    for (const auto& fieldValue : mValues) {
+        hash = mixValue(hash, fieldValue);
+    }
+    return hash;
 }
 
 bool filterValues(const vector<Matcher>& matcherFields, const vector<FieldValue>& values,
                   HashableDimensionKey* output) {
-    size_t num_matches = 0;
-    for (const auto& value : values) {
-        for (size_t i = 0; i < matcherFields.size(); ++i) {
-            const auto& matcher = matcherFields[i];
-            // TODO: potential optimization here to break early because all fields are naturally
-            // sorted.
+    const size_t outputSize = output->getValues().size();
+
+    if (!isSortedByTopLevelPos(matcherFields)) {
+        for (const auto& value : values) {
+            for (const auto& matcher : matcherFields) {
+                if (value.mField.matches(matcher)) {
+                    appendMatchedValue(value, matcher, output);
+                }
+            }
+        }
+        return output->getValues().size() > outputSize;
+    }
+
+    // Both sides are sorted by top-level position, so walk them together. Each value is only
+    // checked against the matchers for its own top-level field, and we skip over the values that
+    // no remaining matcher can match, e.g. the rest of a long attribution chain after FIRST.
+    size_t matcherIndex = 0;
+    size_t valueIndex = 0;
+    while (valueIndex < values.size() && matcherIndex < matcherFields.size()) {
+        const FieldValue& value = values[valueIndex];
+        const int32_t pos = value.mField.getPosAtDepth(0);
+        const int32_t matcherPos = getTopLevelPos(matcherFields[matcherIndex]);
+        if (matcherPos < pos) {
+            matcherIndex++;
+            continue;
+        }
+        if (matcherPos > pos) {
+            valueIndex = seekTopLevelPos(values, valueIndex + 1, matcherPos);
+            continue;
+        }
+
+        bool mayMatchLater = false;
+        for (size_t i = matcherIndex;
+             i < matcherFields.size() && getTopLevelPos(matcherFields[i]) == pos; i++) {
+            const Matcher& matcher = matcherFields[i];
             if (value.mField.matches(matcher)) {
-                output->addValue(value);
-                output->mutableValue(num_matches)->mField.setTag(value.mField.getTag());
-                output->mutableValue(num_matches)->mField.setField(
-                    value.mField.getField() & matcher.mMask);
-                num_matches++;
+                appendMatchedValue(value, matcher, output);
             }
+            mayMatchLater = mayMatchLater || mayMatchLaterInField(matcher, value.mField);
         }
+        valueIndex = mayMatchLater ? valueIndex + 1
+                                   : seekTopLevelPos(values, valueIndex + 1, pos + 1);
     }
-    return num_matches > 0;
+    return output->getValues().size() > outputSize;
 }
 
 void filterGaugeValues(const std::vector<Matcher>& matcherFields,
                        const std::vector<FieldValue>& values, std::vector<FieldValue>* output) {
     for (const auto& field : matcherFields) {
-        for (const auto& value : values) {
-            if (value.mField.matches(field)) {
-                output->push_back(value);
+        if (!hasExactTopLevelPos(field)) {
+            for (const auto& value : values) {
+                if (value.mField.matches(field)) {
+                    output->push_back(value);
+                }
+            }
+            continue;
+        }
+        // Only look at the values of the matcher's own top-level field.
+        const int32_t pos = getTopLevelPos(field);
+        for (size_t i = seekTopLevelPos(values, 0, pos);
+             i < values.size() && values[i].mField.getPosAtDepth(0) == pos; i++) {
+            if (values[i].mField.matches(field)) {
+                output->push_back(values[i]);
+            }
+            if (!mayMatchLaterInField(field, values[i].mField)) {
+                break;
             }
         }
     }
@@ -102,12 +206,12 @@ void getDimensionForCondition(const std::vector<FieldValue>& eventValues,
         return;
     }
 
+    vector<FieldValue> values = conditionDimension->getValues();
     for (size_t i = 0; i < count; i++) {
-        conditionDimension->mutableValue(i)->mField.setField(
-            links.conditionFields[i].mMatcher.getField());
-        conditionDimension->mutableValue(i)->mField.setTag(
-            links.conditionFields[i].mMatcher.getTag());
+        values[i].mField.setField(links.conditionFields[i].mMatcher.getField());
+        values[i].mField.setTag(links.conditionFields[i].mMatcher.getTag());
     }
+    *conditionDimension = HashableDimensionKey(values);
 }
 
 bool LessThan(const vector<FieldValue>& s1, const vector<FieldValue>& s2) {
@@ -128,6 +232,10 @@ bool HashableDimensionKey::operator==(const HashableDimensionKey& that) const {
     if (mValues.size() != that.getValues().size()) {
         return false;
     }
+    // Most keys that differ are told apart by their hashes, without walking the values.
+    if (mHashMix != that.mHashMix) {
+        return false;
+    }
     size_t count = mValues.size();
     for (size_t i = 0; i < count; i++) {
         if (mValues[i] != (that.getValues())[i]) {
@@ -34,33 +34,34 @@ struct Metric2Condition {
     std::vector<Matcher> conditionFields;
 };
 
+/**
+ * The key of a slice. The hash is kept up to date by every mutator, since the same key is usually
+ * looked up in several maps. Keys are never written to once built, so a const key, e.g.
+ * DEFAULT_DIMENSION_KEY, can be read from any thread.
+ */
 class HashableDimensionKey {
 public:
-    explicit HashableDimensionKey(const std::vector<FieldValue>& values) {
-        mValues = values;
+    explicit HashableDimensionKey(const std::vector<FieldValue>& values)
+        : mValues(values), mHashMix(computeHashMix()) {
     }
 
     HashableDimensionKey() {};
 
-    HashableDimensionKey(const HashableDimensionKey& that) : mValues(that.getValues()){};
+    HashableDimensionKey(const HashableDimensionKey& that) = default;
+
+    HashableDimensionKey& operator=(const HashableDimensionKey& from) = default;
 
     inline void addValue(const FieldValue& value) {
         mValues.push_back(value);
+        mHashMix = mixValue(mHashMix, value);
     }
 
     inline const std::vector<FieldValue>& getValues() const {
         return mValues;
     }
 
-    inline std::vector<FieldValue>* mutableValues() {
-        return &mValues;
-    }
-
-    inline FieldValue* mutableValue(size_t i) {
-        if (i >= 0 && i < mValues.size()) {
-            return &(mValues[i]);
-        }
-        return nullptr;
+    inline android::hash_t getHash() const {
+        return JenkinsHashWhiten(mHashMix);
     }
 
     std::string toString() const;
@@ -72,7 +73,14 @@ public:
     bool contains(const HashableDimensionKey& that) const;
 
 private:
+    static android::hash_t mixValue(android::hash_t hash, const FieldValue& value);
+
+    android::hash_t computeHashMix() const;
+
     std::vector<FieldValue> mValues;
+
+    // The hash of mValues before whitening, so that addValue() only has to mix in the new value.
+    android::hash_t mHashMix = 0;
 };
 
 class MetricDimensionKey {
@@ -117,7 +125,9 @@ class MetricDimensionKey {
       HashableDimensionKey mDimensionKeyInCondition;
 };
 
-android::hash_t hashDimension(const HashableDimensionKey& key);
+inline android::hash_t hashDimension(const HashableDimensionKey& key) {
+    return key.getHash();
+}
 
 /**
  * Creating HashableDimensionKeys from FieldValues using matcher.
@@ -128,6 +138,9 @@ android::hash_t hashDimension(const HashableDimensionKey& key);
  * In another event, uid 1000 is at position 6, and it's the last
  * these 2 events should be mapped to the same dimension.  So we will remove the original position
  * from the dimension key for the uid field (by applying 0x80 bit mask).
+ *
+ * The values must be in the order they are read from the event, as LogEvent and this function
+ * produce them. When the matchers are in the same order, both are walked together in one pass.
  */
 bool filterValues(const std::vector<Matcher>& matcherFields, const std::vector<FieldValue>& values,
                   HashableDimensionKey* output);
@@ -136,7 +149,8 @@ bool filterValues(const std::vector<Matcher>& matcherFields, const std::vector<F
  * Filter the values from FieldValues using the matchers.
  *
  * In contrast to the above function, this function will not do any modification to the original
- * data. Considering it as taking a snapshot on the atom event.
+ * data. Considering it as taking a snapshot on the atom event. The values are output in the
+ * order of the matchers.
  */
 void filterGaugeValues(const std::vector<Matcher>& matchers, const std::vector<FieldValue>& values,
                        std::vector<FieldValue>* output);
@@ -69,9 +69,7 @@ const int FIELD_ID_STRINGS = 9;
 
 #define NS_PER_HOUR 3600 * NS_PER_SEC
 
-#define STATS_DATA_DIR "/data/misc/stats-data"
-
-// Cool down period for writing data to disk to avoid overwriting files.
+// Cool down period for writing data to disk.
 #define WRITE_DATA_COOL_DOWN_SEC 5
 
 StatsLogProcessor::StatsLogProcessor(const sp<UidMap>& uidMap,
@@ -85,28 +83,116 @@ StatsLogProcessor::StatsLogProcessor(const sp<UidMap>& uidMap,
       mSendBroadcast(sendBroadcast),
       mTimeBaseNs(timeBaseNs),
       mLargestTimestampSeen(0),
-      mLastTimestampSeen(0) {
+      mLastTimestampSeen(0),
+      mAtomsOfInterest(android::util::kMaxPushedAtomId / 64 + 1) {
     mStatsPullerManager.ForceClearPullerCache();
+    updateAtomsOfInterestLocked();
 }
 
 StatsLogProcessor::~StatsLogProcessor() {
 }
 
+StatsLogProcessor::ConfigLockGuard::ConfigLockGuard(
+        const std::shared_ptr<ConfigLock>& configLock)
+    : mConfigLock(configLock) {
+    mConfigLock->mutex.lock();
+}
+
+StatsLogProcessor::ConfigLockGuard::~ConfigLockGuard() {
+    unlockConfig(mConfigLock.get());
+}
+
+std::shared_ptr<StatsLogProcessor::ConfigLock> StatsLogProcessor::getConfigLockLocked(
+        const ConfigKey& key) const {
+    auto& configLock = mConfigLocks[key];
+    if (configLock == nullptr) {
+        configLock = std::make_shared<ConfigLock>();
+    }
+    return configLock;
+}
+
+vector<StatsLogProcessor::ConfigSnapshot> StatsLogProcessor::getConfigSnapshot(
+        uint64_t* outGeneration) const {
+    std::lock_guard<std::mutex> lock(mMetricsMutex);
+    vector<ConfigSnapshot> configs;
+    configs.reserve(mMetricsManagers.size());
+    for (const auto& pair : mMetricsManagers) {
+        configs.push_back({pair.first, pair.second, getConfigLockLocked(pair.first)});
+    }
+    if (outGeneration != nullptr) {
+        *outGeneration = mConfigsGeneration;
+    }
+    return configs;
+}
+
+void StatsLogProcessor::unlockConfig(ConfigLock* configLock) {
+    while (true) {
+        vector<PendingLogEvent> pendingEvents;
+        {
+            std::lock_guard<std::mutex> pendingLock(configLock->pendingMutex);
+            if (configLock->pendingEvents.empty()) {
+                configLock->mutex.unlock();
+                return;
+            }
+            pendingEvents.swap(configLock->pendingEvents);
+        }
+        for (const auto& pending : pendingEvents) {
+            pending.manager->onLogEvent(*pending.event);
+        }
+    }
+}
+
+bool StatsLogProcessor::isAtomOfInterest(int atomId) const {
+    if (atomId < 0 || (size_t)atomId >= mAtomsOfInterest.size() * 64) {
+        return true;
+    }
+    const uint64_t bits = mAtomsOfInterest[atomId / 64].load(std::memory_order_relaxed);
+    return (bits >> (atomId % 64)) & 1;
+}
+
+void StatsLogProcessor::updateAtomsOfInterestLocked() {
+    vector<uint64_t> bits(mAtomsOfInterest.size(), 0);
+    auto addAtom = [&bits](int atomId) {
+        if (atomId >= 0 && (size_t)atomId < bits.size() * 64) {
+            bits[atomId / 64] |= 1ULL << (atomId % 64);
+        }
+    };
+    // Keeps the uid map up to date, whether any config cares or not.
+    addAtom(android::util::ISOLATED_UID_CHANGED);
+    for (const auto& pair : mMetricsManagers) {
+        for (const int tagId : pair.second->getTagIds()) {
+            addAtom(tagId);
+        }
+    }
+    for (size_t i = 0; i < bits.size(); i++) {
+        mAtomsOfInterest[i].store(bits[i], std::memory_order_relaxed);
+    }
+}
+
+void StatsLogProcessor::startWorkerPool(size_t threadCount) {
+    std::lock_guard<std::mutex> ingestionLock(mIngestionMutex);
+    if (threadCount == 0) {
+        mWorkerPool.reset();
+    } else {
+        mWorkerPool = make_unique<WorkerPool>(threadCount);
+    }
+}
+
 void StatsLogProcessor::onAnomalyAlarmFired(
         const int64_t& timestampNs,
         unordered_set<sp<const InternalAlarm>, SpHash<InternalAlarm>> alarmSet) {
-    std::lock_guard<std::mutex> lock(mMetricsMutex);
-    for (const auto& itr : mMetricsManagers) {
-        itr.second->onAnomalyAlarmFired(timestampNs, alarmSet);
+    for (const auto& config : getConfigSnapshot()) {
+        ConfigLockGuard configLock(config.configLock);
+        config.manager->onAnomalyAlarmFired(timestampNs, alarmSet);
     }
 }
 void StatsLogProcessor::onPeriodicAlarmFired(
         const int64_t& timestampNs,
         unordered_set<sp<const InternalAlarm>, SpHash<InternalAlarm>> alarmSet) {
 
-    std::lock_guard<std::mutex> lock(mMetricsMutex);
-    for (const auto& itr : mMetricsManagers) {
-        itr.second->onPeriodicAlarmFired(timestampNs, alarmSet);
+    for (const auto& config : getConfigSnapshot()) {
+        ConfigLockGuard configLock(config.configLock);
+        config.manager->onPeriodicAlarmFired(timestampNs, alarmSet);
     }
 }
 
@@ -180,8 +266,65 @@ void StatsLogProcessor::resetConfigsLocked(const int64_t timestampNs) {
 }
 
 void StatsLogProcessor::OnLogEvent(LogEvent* event, bool reconnected) {
-    std::lock_guard<std::mutex> lock(mMetricsMutex);
+    vector<PendingDiskWrite> diskWrites;
+    {
+        std::lock_guard<std::mutex> ingestionLock(mIngestionMutex);
+        bool shouldDispatch;
+        {
+            std::lock_guard<std::mutex> lock(mMetricsMutex);
+            shouldDispatch = preprocessLogEventLocked(event, reconnected);
+            diskWrites.swap(mPendingDiskWrites);
+        }
+        if (shouldDispatch) {
+            dispatchLogEvent(*event);
+            flushIfNecessary(event->GetElapsedTimestampNs());
+        }
+    }
+    // Saved once ingestion is released, so that a config busy with a dump can't hold up the
+    // next event for every other config.
+    writePendingDataToDisk(diskWrites, false /* waitForConfigs */);
+}
+
+void StatsLogProcessor::OnLogEventBatch(const std::vector<std::unique_ptr<LogEvent>>& events) {
+    vector<PendingDiskWrite> diskWrites;
+    {
+        std::lock_guard<std::mutex> ingestionLock(mIngestionMutex);
+        int64_t lastDispatchedTimestampNs = 0;
+        bool dispatched = false;
+        for (const auto& event : events) {
+            if (!isAtomOfInterest(event->GetTagId())) {
+                // Socket events never start a reconnection, so there is nothing else to track.
+                StatsdStats::getInstance().noteAtomLogged(
+                        event->GetTagId(), event->GetElapsedTimestampNs() / NS_PER_SEC);
+                continue;
+            }
+            bool shouldDispatch;
+            {
+                std::lock_guard<std::mutex> lock(mMetricsMutex);
+                shouldDispatch = preprocessLogEventLocked(
+                        event.get(), false /*reconnected, N/A in statsd socket*/);
+                // A config reset in the middle of the batch queues the old config's report.
+                // Nothing reaches that config any more, so it can wait for the end of the batch.
+                diskWrites.insert(diskWrites.end(),
+                                  std::make_move_iterator(mPendingDiskWrites.begin()),
+                                  std::make_move_iterator(mPendingDiskWrites.end()));
+                mPendingDiskWrites.clear();
+            }
+            if (!shouldDispatch) {
+                continue;
+            }
+            dispatchLogEvent(*event);
+            lastDispatchedTimestampNs = event->GetElapsedTimestampNs();
+            dispatched = true;
+        }
+        if (dispatched) {
+            flushIfNecessary(lastDispatchedTimestampNs);
+        }
+    }
+    writePendingDataToDisk(diskWrites, false /* waitForConfigs */);
+}
 
+bool StatsLogProcessor::preprocessLogEventLocked(LogEvent* event, bool reconnected) {
 #ifdef VERY_VERBOSE_PRINTING
     if (mPrintAllLogs) {
         ALOGI("%s", event->ToString().c_str());
@@ -200,7 +343,7 @@ void StatsLogProcessor::OnLogEvent(LogEvent* event, bool reconnected) {
         if (currentTimestampNs == mLastTimestampSeen) {
             mInReconnection = false;
             // Found the CP. ignore this event, and we will start to read from next event.
-            return;
+            return false;
         }
         if (currentTimestampNs > mLargestTimestampSeen) {
             // We see a new log but CP has not been found yet. Give up now.
@@ -214,7 +357,7 @@ void StatsLogProcessor::OnLogEvent(LogEvent* event, bool reconnected) {
             resetConfigsLocked(currentTimestampNs);
         } else {
             // Still in search of the CP. Keep going.
-            return;
+            return false;
         }
     }
 
@@ -235,8 +378,17 @@ void StatsLogProcessor::OnLogEvent(LogEvent* event, bool reconnected) {
         onIsolatedUidChangedEventLocked(*event);
     }
 
+    if (mIngestionSnapshotStale) {
+        mIngestionSnapshot.clear();
+        for (const auto& pair : mMetricsManagers) {
+            mIngestionSnapshot.push_back(
+                    {pair.first, pair.second, getConfigLockLocked(pair.first)});
+        }
+        mIngestionSnapshotStale = false;
+    }
+
     if (mMetricsManagers.empty()) {
-        return;
+        return false;
     }
 
     int64_t curTimeSec = getElapsedRealtimeSec();
@@ -250,19 +402,68 @@ void StatsLogProcessor::OnLogEvent(LogEvent* event, bool reconnected) {
         // Map the isolated uid to host uid if necessary.
         mapIsolatedUidToHostUidIfNecessaryLocked(event);
     }
+    return true;
+}
 
-    // pass the event to metrics managers.
+void StatsLogProcessor::dispatchLogEvent(const LogEvent& event) {
+    if (mWorkerPool != nullptr && mIngestionSnapshot.size() > 1) {
+        // Parsing on first read isn't thread safe.
+        event.parse();
+        mWorkerPool->run(mIngestionSnapshot.size(), [this, &event](size_t index) {
+            processLogEventForConfig(mIngestionSnapshot[index], event);
+        });
+        return;
+    }
+    for (const auto& config : mIngestionSnapshot) {
+        processLogEventForConfig(config, event);
+    }
+}
+
+void StatsLogProcessor::processLogEventForConfig(const ConfigSnapshot& config,
+                                                 const LogEvent& event) {
+    ConfigLock* configLock = config.configLock.get();
+    {
+        std::lock_guard<std::mutex> pendingLock(configLock->pendingMutex);
+        if (!configLock->mutex.try_lock()) {
+            // The config is busy, e.g. dumping a report. Whoever holds it processes the event
+            // before releasing it, so we don't stall the other configs waiting here. The queue
+            // is capped, since a slow dump or disk write would otherwise grow it without limit.
+            if (configLock->pendingEvents.size() >= StatsdStats::kMaxPendingEventsPerConfig) {
+                StatsdStats::getInstance().noteBusyConfigEventDropped(config.key);
+                return;
+            }
+            configLock->pendingEvents.push_back({config.manager, make_unique<LogEvent>(event)});
+            return;
+        }
+    }
+    config.manager->onLogEvent(event);
+    unlockConfig(configLock);
+}
+
+void StatsLogProcessor::flushIfNecessary(int64_t timestampNs) {
+    std::lock_guard<std::mutex> lock(mMetricsMutex);
     for (auto& pair : mMetricsManagers) {
-        pair.second->onLogEvent(*event);
-        flushIfNecessaryLocked(event->GetElapsedTimestampNs(), pair.first, *(pair.second));
+        auto configLock = getConfigLockLocked(pair.first);
+        if (!configLock->mutex.try_lock()) {
+            // Busy configs are checked again on a later event.
+            continue;
+        }
+        flushIfNecessaryLocked(timestampNs, pair.first, *(pair.second));
+        unlockConfig(configLock.get());
     }
 }
 
 void StatsLogProcessor::OnConfigUpdated(const int64_t timestampNs, const ConfigKey& key,
                                         const StatsdConfig& config) {
-    std::lock_guard<std::mutex> lock(mMetricsMutex);
-    WriteDataToDiskLocked(key, timestampNs, CONFIG_UPDATED);
-    OnConfigUpdatedLocked(timestampNs, key, config);
+    vector<PendingDiskWrite> diskWrites;
+    {
+        std::lock_guard<std::mutex> lock(mMetricsMutex);
+        WriteDataToDiskLocked(key, timestampNs, CONFIG_UPDATED);
+        OnConfigUpdatedLocked(timestampNs, key, config);
+        diskWrites.swap(mPendingDiskWrites);
+    }
+    // The old MetricsManager is kept alive by its pending write.
+    writePendingDataToDisk(diskWrites);
 }
 
 void StatsLogProcessor::OnConfigUpdatedLocked(
@@ -280,6 +481,9 @@ void StatsLogProcessor::OnConfigUpdatedLocked(
         }
         newMetricsManager->refreshTtl(timestampNs);
         mMetricsManagers[key] = newMetricsManager;
+        mIngestionSnapshotStale = true;
+        mConfigsGeneration++;
+        updateAtomsOfInterestLocked();
         VLOG("StatsdConfig valid");
     } else {
         // If there is any error in the config, don't use it.
@@ -288,20 +492,28 @@ void StatsLogProcessor::OnConfigUpdatedLocked(
 }
 
 size_t StatsLogProcessor::GetMetricsSize(const ConfigKey& key) const {
-    std::lock_guard<std::mutex> lock(mMetricsMutex);
-    auto it = mMetricsManagers.find(key);
-    if (it == mMetricsManagers.end()) {
-        ALOGW("Config source %s does not exist", key.ToString().c_str());
-        return 0;
+    sp<MetricsManager> metricsManager;
+    std::shared_ptr<ConfigLock> configLock;
+    {
+        std::lock_guard<std::mutex> lock(mMetricsMutex);
+        auto it = mMetricsManagers.find(key);
+        if (it == mMetricsManagers.end()) {
+            ALOGW("Config source %s does not exist", key.ToString().c_str());
+            return 0;
+        }
+        metricsManager = it->second;
+        configLock = getConfigLockLocked(key);
     }
-    return it->second->byteSize();
+    ConfigLockGuard configLockGuard(configLock);
+    return metricsManager->byteSize();
 }
 
 void StatsLogProcessor::dumpStates(FILE* out, bool verbose) {
-    std::lock_guard<std::mutex> lock(mMetricsMutex);
-    fprintf(out, "MetricsManager count: %lu\n", (unsigned long)mMetricsManagers.size());
-    for (auto metricsManager : mMetricsManagers) {
-        metricsManager.second->dumpStates(out, verbose);
+    const vector<ConfigSnapshot> configs = getConfigSnapshot();
+    fprintf(out, "MetricsManager count: %lu\n", (unsigned long)configs.size());
+    for (const auto& config : configs) {
+        ConfigLockGuard configLock(config.configLock);
+        config.manager->dumpStates(out, verbose);
     }
 }
 
@@ -312,7 +524,19 @@ void StatsLogProcessor::onDumpReport(const ConfigKey& key, const int64_t dumpTim
                                      const bool include_current_partial_bucket,
                                      const DumpReportReason dumpReportReason,
                                      vector<uint8_t>* outData) {
-    std::lock_guard<std::mutex> lock(mMetricsMutex);
+    sp<MetricsManager> metricsManager;
+    std::shared_ptr<ConfigLock> configLock;
+    {
+        std::lock_guard<std::mutex> lock(mMetricsMutex);
+        auto it = mMetricsManagers.find(key);
+        if (it != mMetricsManagers.end()) {
+            // This allows another broadcast to be sent within the rate-limit period if we get
+            // close to filling the buffer again soon.
+            mLastBroadcastTimes.erase(key);
+            metricsManager = it->second;
+            configLock = getConfigLockLocked(key);
+        }
+    }
 
     ProtoOutputStream proto;
 
@@ -323,24 +547,23 @@ void StatsLogProcessor::onDumpReport(const ConfigKey& key, const int64_t dumpTim
     proto.end(configKeyToken);
     // End of ConfigKey.
 
-    // Then, check stats-data directory to see there's any file containing
-    // ConfigMetricsReport from previous shutdowns to concatenate to reports.
-    StorageManager::appendConfigMetricsReport(key, &proto);
+    if (metricsManager != nullptr) {
+        // Only this config waits while the report is built; the others keep ingesting.
+        ConfigLockGuard configLockGuard(configLock);
 
-    auto it = mMetricsManagers.find(key);
-    if (it != mMetricsManagers.end()) {
-        // This allows another broadcast to be sent within the rate-limit period if we get close to
-        // filling the buffer again soon.
-        mLastBroadcastTimes.erase(key);
+        // Then, check stats-data directory to see there's any file containing
+        // ConfigMetricsReport from previous shutdowns to concatenate to reports.
+        StorageManager::appendConfigMetricsReport(key, &proto);
 
         // Start of ConfigMetricsReport (reports).
         uint64_t reportsToken =
                 proto.start(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | FIELD_ID_REPORTS);
-        onConfigMetricsReportLocked(key, dumpTimeStampNs, include_current_partial_bucket,
-                                    dumpReportReason, &proto);
+        onConfigMetricsReportLocked(key, *metricsManager, dumpTimeStampNs,
+                                    include_current_partial_bucket, dumpReportReason, &proto);
         proto.end(reportsToken);
         // End of ConfigMetricsReport (reports).
     } else {
+        StorageManager::appendConfigMetricsReport(key, &proto);
         ALOGW("Config source %s does not exist", key.ToString().c_str());
     }
 
@@ -364,34 +587,31 @@ void StatsLogProcessor::onDumpReport(const ConfigKey& key, const int64_t dumpTim
  * onConfigMetricsReportLocked dumps serialized ConfigMetricsReport into outData.
  */
 void StatsLogProcessor::onConfigMetricsReportLocked(const ConfigKey& key,
+                                                    MetricsManager& metricsManager,
                                                     const int64_t dumpTimeStampNs,
                                                     const bool include_current_partial_bucket,
                                                     const DumpReportReason dumpReportReason,
                                                     ProtoOutputStream* proto) {
-    // We already checked whether key exists in mMetricsManagers in
-    // WriteDataToDisk.
-    auto it = mMetricsManagers.find(key);
-    if (it == mMetricsManagers.end()) {
-        return;
-    }
-    int64_t lastReportTimeNs = it->second->getLastReportTimeNs();
-    int64_t lastReportWallClockNs = it->second->getLastReportWallClockNs();
+    int64_t lastReportTimeNs = metricsManager.getLastReportTimeNs();
+    int64_t lastReportWallClockNs = metricsManager.getLastReportWallClockNs();
 
     std::set<string> str_set;
 
     // First, fill in ConfigMetricsReport using current data on memory, which
     // starts from filling in StatsLogReport's.
-    it->second->onDumpReport(dumpTimeStampNs, include_current_partial_bucket,
+    metricsManager.onDumpReport(dumpTimeStampNs, include_current_partial_bucket,
                              &str_set, proto);
 
     // Fill in UidMap if there is at least one metric to report.
     // This skips the uid map if it's an empty config.
-    if (it->second->getNumMetrics() > 0) {
+    if (metricsManager.getNumMetrics() > 0) {
         uint64_t uidMapToken = proto->start(FIELD_TYPE_MESSAGE | FIELD_ID_UID_MAP);
-        if (it->second->hashStringInReport()) {
-            mUidMap->appendUidMap(dumpTimeStampNs, key, &str_set, proto);
+        if (metricsManager.hashStringInReport()) {
+            mUidMap->appendUidMap(dumpTimeStampNs, key, &str_set,
+                                  metricsManager.mutableLastUidMapSnapshotId(), proto);
         } else {
-            mUidMap->appendUidMap(dumpTimeStampNs, key, nullptr, proto);
+            mUidMap->appendUidMap(dumpTimeStampNs, key, nullptr,
+                                  metricsManager.mutableLastUidMapSnapshotId(), proto);
         }
         proto->end(uidMapToken);
     }
@@ -444,19 +664,35 @@ void StatsLogProcessor::resetIfConfigTtlExpiredLocked(const int64_t timestampNs)
 }
 
 void StatsLogProcessor::OnConfigRemoved(const ConfigKey& key) {
-    std::lock_guard<std::mutex> lock(mMetricsMutex);
-    auto it = mMetricsManagers.find(key);
-    if (it != mMetricsManagers.end()) {
-        WriteDataToDiskLocked(key, getElapsedRealtimeNs(), CONFIG_REMOVED);
-        mMetricsManagers.erase(it);
-        mUidMap->OnConfigRemoved(key);
-    }
-    StatsdStats::getInstance().noteConfigRemoved(key);
+    vector<PendingDiskWrite> diskWrites;
+    {
+        std::lock_guard<std::mutex> lock(mMetricsMutex);
+        auto it = mMetricsManagers.find(key);
+        if (it != mMetricsManagers.end()) {
+            WriteDataToDiskLocked(key, getElapsedRealtimeNs(), CONFIG_REMOVED);
+            mMetricsManagers.erase(it);
+            mIngestionSnapshotStale = true;
+            mConfigsGeneration++;
+            updateAtomsOfInterestLocked();
+            mUidMap->OnConfigRemoved(key);
+        }
+        StatsdStats::getInstance().noteConfigRemoved(key);
 
-    mLastBroadcastTimes.erase(key);
+        mLastBroadcastTimes.erase(key);
+        mConfigLocks.erase(key);
 
-    if (mMetricsManagers.empty()) {
-        mStatsPullerManager.ForceClearPullerCache();
+        if (mMetricsManagers.empty()) {
+            mStatsPullerManager.ForceClearPullerCache();
+        }
+        diskWrites.swap(mPendingDiskWrites);
+    }
+    // The removed MetricsManager and its ConfigLock are kept alive by the pending write.
+    writePendingDataToDisk(diskWrites);
+    // The report took the event data moved to disk, unless writing it failed. Whatever is left
+    // belongs to no metric, as long as the config hasn't been added back meanwhile.
+    std::lock_guard<std::mutex> lock(mMetricsMutex);
+    if (mMetricsManagers.find(key) == mMetricsManagers.end()) {
+        StorageManager::deleteEventMetricChunks(key);
     }
 }
 
@@ -479,10 +715,13 @@ void StatsLogProcessor::flushIfNecessaryLocked(
         StatsdStats::getInstance().noteDataDropped(key);
         VLOG("StatsD had to toss out metrics for %s", key.ToString().c_str());
     } else if ((totalBytes > StatsdStats::kBytesPerConfigTriggerGetData) ||
-               (mOnDiskDataConfigs.find(key) != mOnDiskDataConfigs.end())) {
+               (mOnDiskDataConfigs.find(key) != mOnDiskDataConfigs.end()) ||
+               (metricsManager.spilledByteSize() >
+                StatsdStats::kSpilledBytesPerConfigTriggerGetData)) {
         // Request to send a broadcast if:
         // 1. in memory data > threshold   OR
-        // 2. config has old data report on disk.
+        // 2. config has old data report on disk   OR
+        // 3. event data moved to disk > threshold.
         requestDump = true;
     }
 
@@ -507,31 +746,54 @@ void StatsLogProcessor::flushIfNecessaryLocked(
 void StatsLogProcessor::WriteDataToDiskLocked(const ConfigKey& key,
                                               const int64_t timestampNs,
                                               const DumpReportReason dumpReportReason) {
-    if (mMetricsManagers.find(key) == mMetricsManagers.end() ||
-        !mMetricsManagers.find(key)->second->shouldWriteToDisk()) {
+    auto it = mMetricsManagers.find(key);
+    if (it == mMetricsManagers.end() || !it->second->shouldWriteToDisk()) {
         return;
     }
-    ProtoOutputStream proto;
-    onConfigMetricsReportLocked(key, timestampNs, true /* include_current_partial_bucket*/,
-                                dumpReportReason, &proto);
-    string file_name = StringPrintf("%s/%ld_%d_%lld", STATS_DATA_DIR,
-         (long)getWallClockSec(), key.GetUid(), (long long)key.GetId());
-    android::base::unique_fd fd(open(file_name.c_str(),
-                                O_WRONLY | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR));
-    if (fd == -1) {
-        ALOGE("Attempt to write %s but failed", file_name.c_str());
+    mPendingDiskWrites.push_back(
+            {{key, it->second, getConfigLockLocked(key)}, timestampNs, dumpReportReason});
+}
+
+void StatsLogProcessor::writePendingDataToDisk(vector<PendingDiskWrite>& diskWrites,
+                                               bool waitForConfigs) {
+    vector<ConfigKey> writtenKeys;
+    vector<PendingDiskWrite> busyWrites;
+    for (auto& diskWrite : diskWrites) {
+        const ConfigKey& key = diskWrite.config.key;
+        ConfigLock* configLock = diskWrite.config.configLock.get();
+        if (waitForConfigs) {
+            configLock->mutex.lock();
+        } else if (!configLock->mutex.try_lock()) {
+            busyWrites.push_back(std::move(diskWrite));
+            continue;
+        }
+        ProtoOutputStream proto;
+        onConfigMetricsReportLocked(key, *diskWrite.config.manager, diskWrite.timestampNs,
+                                    true /* include_current_partial_bucket*/, diskWrite.reason,
+                                    &proto);
+        unlockConfig(configLock);
+        if (!StorageManager::writeConfigMetricsReport(key, &proto)) {
+            ALOGE("Failed to save the report of %s to disk", key.ToString().c_str());
+            continue;
+        }
+        writtenKeys.push_back(key);
+    }
+    if (writtenKeys.empty() && busyWrites.empty()) {
         return;
     }
-    proto.flush(fd.get());
-    // We were able to write the ConfigMetricsReport to disk, so we should trigger collection ASAP.
-    mOnDiskDataConfigs.insert(key);
+    std::lock_guard<std::mutex> lock(mMetricsMutex);
+    // Busy configs are written once they are free, ahead of the reports queued meanwhile.
+    mPendingDiskWrites.insert(mPendingDiskWrites.begin(),
+                              std::make_move_iterator(busyWrites.begin()),
+                              std::make_move_iterator(busyWrites.end()));
+    // We were able to write the ConfigMetricsReports to disk, so we should trigger collection
+    // ASAP.
+    mOnDiskDataConfigs.insert(writtenKeys.begin(), writtenKeys.end());
 }
 
 void StatsLogProcessor::WriteDataToDiskLocked(const DumpReportReason dumpReportReason) {
     const int64_t timeNs = getElapsedRealtimeNs();
     // Do not write to disk if we already have in the last few seconds.
-    // This is to avoid overwriting files that would have the same name if we
-    //   write twice in the same second.
     if (static_cast<unsigned long long> (timeNs) <
             mLastWriteTimeNs + WRITE_DATA_COOL_DOWN_SEC * NS_PER_SEC) {
         ALOGI("Statsd skipping writing data to disk. Already wrote data in last %d seconds",
@@ -545,13 +807,38 @@ void StatsLogProcessor::WriteDataToDiskLocked(const DumpReportReason dumpReportR
 }
 
 void StatsLogProcessor::WriteDataToDisk(const DumpReportReason dumpReportReason) {
-    std::lock_guard<std::mutex> lock(mMetricsMutex);
-    WriteDataToDiskLocked(dumpReportReason);
+    vector<PendingDiskWrite> diskWrites;
+    {
+        std::lock_guard<std::mutex> lock(mMetricsMutex);
+        WriteDataToDiskLocked(dumpReportReason);
+        diskWrites.swap(mPendingDiskWrites);
+    }
+    writePendingDataToDisk(diskWrites);
 }
 
 void StatsLogProcessor::informPullAlarmFired(const int64_t timestampNs) {
-    std::lock_guard<std::mutex> lock(mMetricsMutex);
-    mStatsPullerManager.OnAlarmFired(timestampNs);
+    // The pulls block on binder and HALs, so they run without any lock and events keep flowing
+    // meanwhile. The pulled data is delivered like an event: the receivers are metric producers,
+    // which share condition trackers with the rest of their config, so every config is locked.
+    //
+    // The config locks are taken without mMetricsMutex, so that a config busy dumping stalls only
+    // the delivery. mMetricsMutex is then held during the delivery to keep the set of configs, and
+    // so the set of receivers, from changing; if it changed while waiting, try again.
+    mStatsPullerManager.OnAlarmFired(timestampNs, [this](const std::function<void()>& deliver) {
+        while (true) {
+            uint64_t generation;
+            const vector<ConfigSnapshot> configs = getConfigSnapshot(&generation);
+            vector<std::unique_ptr<ConfigLockGuard>> configLocks;
+            for (const auto& config : configs) {
+                configLocks.push_back(std::make_unique<ConfigLockGuard>(config.configLock));
+            }
+            std::lock_guard<std::mutex> lock(mMetricsMutex);
+            if (generation == mConfigsGeneration) {
+                deliver();
+                return;
+            }
+        }
+    });
 }
 
 int64_t StatsLogProcessor::getLastReportTimeNs(const ConfigKey& key) {
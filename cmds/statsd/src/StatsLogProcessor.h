@@ -22,10 +22,13 @@
 #include "metrics/MetricsManager.h"
 #include "packages/UidMap.h"
 #include "external/StatsPullerManager.h"
+#include "WorkerPool.h"
 
 #include "frameworks/base/cmds/statsd/src/statsd_config.pb.h"
 
 #include <stdio.h>
+#include <atomic>
+#include <memory>
 #include <unordered_map>
 
 namespace android {
@@ -57,6 +60,10 @@ public:
     // for testing only.
     void OnLogEvent(LogEvent* event);
 
+    // Processes events read together from the socket, checking the memory limits once per batch.
+    // Atoms that no config uses are dropped up front, without taking any lock.
+    void OnLogEventBatch(const std::vector<std::unique_ptr<LogEvent>>& events);
+
     void OnConfigUpdated(const int64_t timestampNs, const ConfigKey& key,
                          const StatsdConfig& config);
     void OnConfigRemoved(const ConfigKey& key);
@@ -103,6 +110,10 @@ public:
     // Add a specific config key to the possible configs to dump ASAP.
     void noteOnDiskData(const ConfigKey& key);
 
+    // Hands each event to the metrics managers of different configs in parallel on threadCount
+    // extra threads. Events are still processed in order within each config.
+    void startWorkerPool(size_t threadCount);
+
 private:
     // For testing only.
     inline sp<AlarmMonitor> getAnomalyAlarmMonitor() const {
@@ -113,10 +124,76 @@ private:
         return mPeriodicAlarmMonitor;
     }
 
+    // Guards the set of configs and everything else below, except for the state of each
+    // MetricsManager, which is guarded by its ConfigLock. Never wait for a ConfigLock while
+    // holding it, since a config may be busy dumping for a long time; try_lock is fine. It may be
+    // acquired while holding ConfigLocks.
     mutable mutex mMetricsMutex;
 
     std::unordered_map<ConfigKey, sp<MetricsManager>> mMetricsManagers;
 
+    // An event that arrived while its config was busy, e.g. dumping a report.
+    struct PendingLogEvent {
+        sp<MetricsManager> manager;
+        std::unique_ptr<LogEvent> event;
+    };
+
+    // Serializes access to the MetricsManager of one config, so that dumping one config does not
+    // stall ingestion for the others. Events for a busy config are queued instead of waited on,
+    // and whoever holds the lock replays them before releasing it. Hence pendingEvents is only
+    // ever non-empty while mutex is held, which keeps the events of a config in order.
+    struct ConfigLock {
+        std::mutex mutex;
+        std::mutex pendingMutex;
+        std::vector<PendingLogEvent> pendingEvents;
+    };
+
+    // Holds a ConfigLock for the scope, replaying the events queued meanwhile on release.
+    class ConfigLockGuard {
+    public:
+        explicit ConfigLockGuard(const std::shared_ptr<ConfigLock>& configLock);
+        ~ConfigLockGuard();
+
+    private:
+        std::shared_ptr<ConfigLock> mConfigLock;
+    };
+
+    // Created on demand, hence mutable.
+    mutable std::unordered_map<ConfigKey, std::shared_ptr<ConfigLock>> mConfigLocks;
+
+    struct ConfigSnapshot {
+        ConfigKey key;
+        sp<MetricsManager> manager;
+        std::shared_ptr<ConfigLock> configLock;
+    };
+
+    // Serializes ingestion so that events reach every config in the order they were logged.
+    std::mutex mIngestionMutex;
+
+    // The configs to dispatch events to. Rebuilt under mMetricsMutex when mMetricsManagers
+    // changes and only read by the ingesting thread, so guarded by mIngestionMutex.
+    std::vector<ConfigSnapshot> mIngestionSnapshot;
+
+    // Set under mMetricsMutex whenever mMetricsManagers changes.
+    bool mIngestionSnapshotStale = true;
+
+    // Incremented under mMetricsMutex whenever mMetricsManagers changes.
+    uint64_t mConfigsGeneration = 0;
+
+    // A report to save to disk once mMetricsMutex is released, since building it needs the
+    // ConfigLock.
+    struct PendingDiskWrite {
+        ConfigSnapshot config;
+        int64_t timestampNs;
+        DumpReportReason reason;
+    };
+
+    // Guarded by mMetricsMutex.
+    std::vector<PendingDiskWrite> mPendingDiskWrites;
+
+    // Guarded by mIngestionMutex. Null unless startWorkerPool() was called.
+    std::unique_ptr<WorkerPool> mWorkerPool;
+
     std::unordered_map<ConfigKey, long> mLastBroadcastTimes;
 
     // Tracks when we last checked the bytes consumed for each config key.
@@ -133,16 +210,53 @@ private:
 
     sp<AlarmMonitor> mPeriodicAlarmMonitor;
 
+    // Updates the processor state for a new event. Returns false if the event should not be
+    // passed to the metrics managers.
+    bool preprocessLogEventLocked(LogEvent* event, bool reconnected);
+
+    // Passes the event to every config in mIngestionSnapshot, without holding mMetricsMutex.
+    void dispatchLogEvent(const LogEvent& event);
+
+    // Processes the event in the given config, or queues it if the config is busy.
+    static void processLogEventForConfig(const ConfigSnapshot& config, const LogEvent& event);
+
+    // Replays the events queued while the config was busy, then releases its lock.
+    static void unlockConfig(ConfigLock* configLock);
+
+    std::shared_ptr<ConfigLock> getConfigLockLocked(const ConfigKey& key) const;
+
+    // Copies the current configs under mMetricsMutex, so that the caller can then lock each of
+    // them without holding it.
+    std::vector<ConfigSnapshot> getConfigSnapshot(uint64_t* outGeneration = nullptr) const;
+
+    // Builds and saves the given reports. Called without mMetricsMutex. Unless waitForConfigs
+    // is set, reports of configs that are busy are queued in mPendingDiskWrites again instead of
+    // waited for.
+    void writePendingDataToDisk(std::vector<PendingDiskWrite>& diskWrites,
+                                bool waitForConfigs = true);
+
+    void flushIfNecessary(int64_t timestampNs);
+
     void resetIfConfigTtlExpiredLocked(const int64_t timestampNs);
 
+    // Returns whether any config may use the atom. Doesn't take any lock.
+    bool isAtomOfInterest(int atomId) const;
+
+    // Rebuilds mAtomsOfInterest when the set of configs changes.
+    void updateAtomsOfInterestLocked();
+
     void OnConfigUpdatedLocked(
         const int64_t currentTimestampNs, const ConfigKey& key, const StatsdConfig& config);
 
+    // These only queue the reports in mPendingDiskWrites. Whoever releases mMetricsMutex next
+    // passes them to writePendingDataToDisk().
     void WriteDataToDiskLocked(const DumpReportReason dumpReportReason);
     void WriteDataToDiskLocked(const ConfigKey& key, const int64_t timestampNs,
                                const DumpReportReason dumpReportReason);
 
-    void onConfigMetricsReportLocked(const ConfigKey& key, const int64_t dumpTimeStampNs,
+    // Called with the ConfigLock of the key held.
+    void onConfigMetricsReportLocked(const ConfigKey& key, MetricsManager& metricsManager,
+                                     const int64_t dumpTimeStampNs,
                                      const bool include_current_partial_bucket,
                                      const DumpReportReason dumpReportReason,
                                      util::ProtoOutputStream* proto);
@@ -187,6 +301,10 @@ private:
     // Last time we wrote data to disk.
     int64_t mLastWriteTimeNs = 0;
 
+    // One bit per pushed atom id, set if any config may use the atom. Written under
+    // mMetricsMutex, read without it. Atom ids beyond the end are always of interest.
+    std::vector<std::atomic<uint64_t>> mAtomsOfInterest;
+
 #ifdef VERY_VERBOSE_PRINTING
     bool mPrintAllLogs = false;
 #endif
@@ -195,6 +313,12 @@ private:
     FRIEND_TEST(StatsLogProcessorTest, TestRateLimitByteSize);
     FRIEND_TEST(StatsLogProcessorTest, TestRateLimitBroadcast);
     FRIEND_TEST(StatsLogProcessorTest, TestDropWhenByteSizeTooLarge);
+    FRIEND_TEST(StatsLogProcessorTest, TestLogEventBatch);
+    FRIEND_TEST(StatsLogProcessorTest, TestEventQueuedWhileConfigBusy);
+    FRIEND_TEST(StatsLogProcessorTest, TestWorkerPool);
+    FRIEND_TEST(StatsLogProcessorTest, TestBusyConfigDoesNotStallOthers);
+    FRIEND_TEST(StatsLogProcessorTest, TestPendingEventsAreCapped);
+    FRIEND_TEST(StatsLogProcessorTest, TestAtomsOfInterest);
     FRIEND_TEST(WakelockDurationE2eTest, TestAggregatedPredicateDimensionsForSumDuration1);
     FRIEND_TEST(WakelockDurationE2eTest, TestAggregatedPredicateDimensionsForSumDuration2);
     FRIEND_TEST(WakelockDurationE2eTest, TestAggregatedPredicateDimensionsForSumDuration3);
@@ -55,6 +55,10 @@ constexpr const char* kPermissionUsage = "android.permission.PACKAGE_USAGE_STATS
 
 constexpr const char* kOpUsage = "android:get_usage_stats";
 
+// Extra threads that process each event for different configs in parallel. 0 processes all the
+// configs on the socket thread.
+constexpr size_t kLogEventWorkerThreadCount = 0;
+
 #define STATS_SERVICE_DIR "/data/misc/stats-service"
 
 static binder::Status ok() {
@@ -170,6 +174,10 @@ StatsService::StatsService(const sp<Looper>& handlerLooper)
     }
     );
 
+    if (kLogEventWorkerThreadCount > 0) {
+        mProcessor->startWorkerPool(kLogEventWorkerThreadCount);
+    }
+
     mConfigManager->AddListener(mProcessor);
 
     init_system_properties();
@@ -878,6 +886,7 @@ Status StatsService::statsCompanionReady() {
 }
 
 void StatsService::Startup() {
+    StorageManager::deleteAllEventMetricChunks();
     mConfigManager->Startup();
 }
 
@@ -892,6 +901,10 @@ void StatsService::OnLogEvent(LogEvent* event, bool reconnectionStarts) {
     mProcessor->OnLogEvent(event, reconnectionStarts);
 }
 
+void StatsService::OnLogEventBatch(const std::vector<std::unique_ptr<LogEvent>>& events) {
+    mProcessor->OnLogEventBatch(events);
+}
+
 Status StatsService::getData(int64_t key, const String16& packageName, vector<uint8_t>* output) {
     ENFORCE_DUMP_AND_USAGE_STATS(packageName);
 
@@ -83,6 +83,11 @@ public:
      */
     virtual void OnLogEvent(LogEvent* event, bool reconnectionStarts);
 
+    /**
+     * Called by StatsSocketListener with the events read in one wakeup.
+     */
+    virtual void OnLogEventBatch(const std::vector<std::unique_ptr<LogEvent>>& events);
+
     /**
      * Binder call for clients to request data for this configuration key.
      */
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define DEBUG false  // STOPSHIP if true
+#include "Log.h"
+
+#include "WorkerPool.h"
+
+namespace android {
+namespace os {
+namespace statsd {
+
+WorkerPool::WorkerPool(size_t threadCount) {
+    for (size_t i = 0; i < threadCount; i++) {
+        mThreads.emplace_back(&WorkerPool::workerLoop, this);
+    }
+    VLOG("WorkerPool started with %zu threads", threadCount);
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mWorkAvailable.notify_all();
+    for (auto& thread : mThreads) {
+        thread.join();
+    }
+}
+
+void WorkerPool::run(size_t taskCount, const std::function<void(size_t)>& task) {
+    if (taskCount == 0) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mMutex);
+    mTask = &task;
+    mTaskCount = taskCount;
+    mNextTask = 0;
+    mUnfinishedTasks = taskCount;
+    mWorkAvailable.notify_all();
+
+    // Help out instead of sleeping while the workers run the batch.
+    while (mNextTask < mTaskCount) {
+        const size_t index = mNextTask++;
+        lock.unlock();
+        task(index);
+        lock.lock();
+        mUnfinishedTasks--;
+    }
+    mWorkDone.wait(lock, [this] { return mUnfinishedTasks == 0; });
+    mTask = nullptr;
+    mTaskCount = 0;
+    mNextTask = 0;
+}
+
+void WorkerPool::workerLoop() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true) {
+        mWorkAvailable.wait(lock, [this] {
+            return mStopping || (mTask != nullptr && mNextTask < mTaskCount);
+        });
+        if (mStopping) {
+            return;
+        }
+        const size_t index = mNextTask++;
+        const std::function<void(size_t)>* task = mTask;
+        lock.unlock();
+        (*task)(index);
+        lock.lock();
+        if (--mUnfinishedTasks == 0) {
+            mWorkDone.notify_all();
+        }
+    }
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace os {
+namespace statsd {
+
+/**
+ * A fixed set of threads that run a batch of independent tasks in parallel.
+ *
+ * run() returns only once every task of the batch has finished, so tasks may refer to data
+ * owned by the caller. The calling thread works on the batch too. Only one batch runs at a
+ * time; callers must not call run() concurrently.
+ */
+class WorkerPool {
+public:
+    explicit WorkerPool(size_t threadCount);
+
+    ~WorkerPool();
+
+    /**
+     * Calls task(i) for every i in [0, taskCount) and waits for all the calls to return.
+     */
+    void run(size_t taskCount, const std::function<void(size_t)>& task);
+
+    inline size_t getThreadCount() const {
+        return mThreads.size();
+    }
+
+private:
+    void workerLoop();
+
+    std::mutex mMutex;
+
+    // Signaled when a batch starts or when the pool shuts down.
+    std::condition_variable mWorkAvailable;
+
+    // Signaled when the last task of a batch finishes.
+    std::condition_variable mWorkDone;
+
+    // The batch being run. All guarded by mMutex.
+    const std::function<void(size_t)>* mTask = nullptr;
+    size_t mTaskCount = 0;
+    size_t mNextTask = 0;
+    size_t mUnfinishedTasks = 0;
+
+    bool mStopping = false;
+
+    std::vector<std::thread> mThreads;
+};
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
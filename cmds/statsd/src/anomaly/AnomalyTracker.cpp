@@ -51,10 +51,14 @@ AnomalyTracker::~AnomalyTracker() {
 
 void AnomalyTracker::resetStorage() {
     VLOG("resetStorage() called.");
-    mPastBuckets.clear();
+    mDimensionSlots.clear();
+    mSlots.clear();
+    mFreeSlots.clear();
+    mPastValues.clear();
+    mHasPastValue.clear();
     // Excludes the current bucket.
-    mPastBuckets.resize(mNumOfPastBuckets);
-    mSumOverPastBuckets.clear();
+    mBucketSlots.clear();
+    mBucketSlots.resize(mNumOfPastBuckets);
 }
 
 size_t AnomalyTracker::index(int64_t bucketNum) const {
@@ -81,11 +85,9 @@ void AnomalyTracker::advanceMostRecentBucketTo(const int64_t& bucketNum) {
         return;
     }
 
-    // Clear out space by emptying out old mPastBuckets[i] values and update mSumOverPastBuckets.
+    // Clear out space by emptying out the buckets that leave the window.
     for (int64_t i = mMostRecentBucketNum + 1; i <= bucketNum; i++) {
-        const int idx = index(i);
-        subtractBucketFromSum(mPastBuckets[idx]);
-        mPastBuckets[idx] = nullptr;  // release (but not clear) the old bucket.
+        clearPastBucket(index(i));
     }
     mMostRecentBucketNum = bucketNum;
 }
@@ -99,25 +101,11 @@ void AnomalyTracker::addPastBucket(const MetricDimensionKey& key,
         return;
     }
 
-    const int bucketIndex = index(bucketNum);
-    if (bucketNum <= mMostRecentBucketNum && (mPastBuckets[bucketIndex] != nullptr)) {
-        // We need to insert into an already existing past bucket.
-        std::shared_ptr<DimToValMap>& bucket = mPastBuckets[bucketIndex];
-        auto itr = bucket->find(key);
-        if (itr != bucket->end()) {
-            // Old entry already exists; update it.
-            subtractValueFromSum(key, itr->second);
-            itr->second = bucketValue;
-        } else {
-            bucket->insert({key, bucketValue});
-        }
-        mSumOverPastBuckets[key] += bucketValue;
-    } else {
-        // Bucket does not exist yet (in future or was never made), so we must make it.
-        std::shared_ptr<DimToValMap> bucket = std::make_shared<DimToValMap>();
-        bucket->insert({key, bucketValue});
-        addPastBucket(bucket, bucketNum);
+    if (bucketNum > mMostRecentBucketNum) {
+        // Clear space for the new bucket to be at bucketNum.
+        advanceMostRecentBucketTo(bucketNum);
     }
+    setPastValue(key, index(bucketNum), bucketValue);
 }
 
 void AnomalyTracker::addPastBucket(std::shared_ptr<DimToValMap> bucket,
@@ -128,49 +116,77 @@ void AnomalyTracker::addPastBucket(std::shared_ptr<DimToValMap> bucket,
         return;
     }
 
+    const size_t bucketIndex = index(bucketNum);
     if (bucketNum <= mMostRecentBucketNum) {
         // We are updating an old bucket, not adding a new one.
-        subtractBucketFromSum(mPastBuckets[index(bucketNum)]);
+        clearPastBucket(bucketIndex);
     } else {
         // Clear space for the new bucket to be at bucketNum.
         advanceMostRecentBucketTo(bucketNum);
     }
-    mPastBuckets[index(bucketNum)] = bucket;
-    addBucketToSum(bucket);
-}
-
-void AnomalyTracker::subtractBucketFromSum(const shared_ptr<DimToValMap>& bucket) {
     if (bucket == nullptr) {
         return;
     }
     for (const auto& keyValuePair : *bucket) {
-        subtractValueFromSum(keyValuePair.first, keyValuePair.second);
+        setPastValue(keyValuePair.first, bucketIndex, keyValuePair.second);
     }
 }
 
-
-void AnomalyTracker::subtractValueFromSum(const MetricDimensionKey& key,
-                                          const int64_t& bucketValue) {
-    auto itr = mSumOverPastBuckets.find(key);
-    if (itr == mSumOverPastBuckets.end()) {
-        return;
+void AnomalyTracker::setPastValue(const MetricDimensionKey& key, size_t bucketIndex,
+                                  int64_t value) {
+    size_t slot;
+    auto slotIt = mDimensionSlots.find(key);
+    if (slotIt != mDimensionSlots.end()) {
+        slot = slotIt->second;
+    } else {
+        if (!mFreeSlots.empty()) {
+            slot = mFreeSlots.back();
+            mFreeSlots.pop_back();
+            mSlots[slot] = {key, 0, 0};
+        } else {
+            slot = mSlots.size();
+            mSlots.push_back({key, 0, 0});
+            mPastValues.resize(mPastValues.size() + mNumOfPastBuckets, 0);
+            mHasPastValue.resize(mHasPastValue.size() + mNumOfPastBuckets, false);
+        }
+        mDimensionSlots[key] = slot;
     }
-    itr->second -= bucketValue;
-    if (itr->second == 0) {
-        mSumOverPastBuckets.erase(itr);
+
+    DimensionSlot& dimension = mSlots[slot];
+    const size_t cell = slot * mNumOfPastBuckets + bucketIndex;
+    if (mHasPastValue[cell]) {
+        dimension.sum -= mPastValues[cell];
+    } else {
+        mHasPastValue[cell] = true;
+        dimension.valueCount++;
+        mBucketSlots[bucketIndex].push_back(slot);
     }
+    mPastValues[cell] = value;
+    dimension.sum += value;
 }
 
-void AnomalyTracker::addBucketToSum(const shared_ptr<DimToValMap>& bucket) {
-    if (bucket == nullptr) {
+void AnomalyTracker::clearPastValue(size_t slot, size_t bucketIndex) {
+    const size_t cell = slot * mNumOfPastBuckets + bucketIndex;
+    if (!mHasPastValue[cell]) {
         return;
     }
-    // For each dimension present in the bucket, add its value to its corresponding sum.
-    for (const auto& keyValuePair : *bucket) {
-        mSumOverPastBuckets[keyValuePair.first] += keyValuePair.second;
+    mHasPastValue[cell] = false;
+    DimensionSlot& dimension = mSlots[slot];
+    dimension.sum -= mPastValues[cell];
+    mPastValues[cell] = 0;
+    if (--dimension.valueCount == 0) {
+        mDimensionSlots.erase(dimension.key);
+        mFreeSlots.push_back(slot);
     }
 }
 
+void AnomalyTracker::clearPastBucket(size_t bucketIndex) {
+    for (const size_t slot : mBucketSlots[bucketIndex]) {
+        clearPastValue(slot, bucketIndex);
+    }
+    mBucketSlots[bucketIndex].clear();
+}
+
 int64_t AnomalyTracker::getPastBucketValue(const MetricDimensionKey& key,
                                            const int64_t& bucketNum) const {
     if (bucketNum < 0 || mMostRecentBucketNum < 0
@@ -179,18 +195,17 @@ int64_t AnomalyTracker::getPastBucketValue(const MetricDimensionKey& key,
         return 0;
     }
 
-    const auto& bucket = mPastBuckets[index(bucketNum)];
-    if (bucket == nullptr) {
+    const auto& slotIt = mDimensionSlots.find(key);
+    if (slotIt == mDimensionSlots.end()) {
         return 0;
     }
-    const auto& itr = bucket->find(key);
-    return itr == bucket->end() ? 0 : itr->second;
+    return mPastValues[slotIt->second * mNumOfPastBuckets + index(bucketNum)];
 }
 
 int64_t AnomalyTracker::getSumOverPastBuckets(const MetricDimensionKey& key) const {
-    const auto& itr = mSumOverPastBuckets.find(key);
-    if (itr != mSumOverPastBuckets.end()) {
-        return itr->second;
+    const auto& slotIt = mDimensionSlots.find(key);
+    if (slotIt != mDimensionSlots.end()) {
+        return mSlots[slotIt->second].sum;
     }
     return 0;
 }
@@ -51,6 +51,7 @@ public:
     // If a bucket for bucketNum already exists, it will be replaced.
     // Also, advances to bucketNum (if not in the past), effectively filling any intervening
     // buckets with 0s.
+    // The values are copied; the tracker doesn't keep the map, so the caller may reuse it.
     void addPastBucket(std::shared_ptr<DimToValMap> bucket, const int64_t& bucketNum);
 
     // Inserts (or replaces) the bucket entry for the given bucketNum at the given key to be the
@@ -133,13 +134,35 @@ protected:
     // for the anomaly detection (since the current bucket is not in the past).
     const int mNumOfPastBuckets;
 
-    // Values for each of the past mNumOfPastBuckets buckets. Always of size mNumOfPastBuckets.
-    // mPastBuckets[i] can be null, meaning that no data is present in that bucket.
-    std::vector<shared_ptr<DimToValMap>> mPastBuckets;
+    // The past buckets are stored by dimension rather than by bucket. Each dimension that has a
+    // value in any of the past buckets owns a slot, which holds the sum over the past buckets and
+    // one cell per past bucket. Rolling a bucket out of the window only visits the dimensions
+    // that have a value in it, and doesn't allocate.
+    typedef struct {
+        MetricDimensionKey key;
+        // Sum over the values in the past buckets.
+        int64_t sum;
+        // The number of past buckets that have a value for this dimension. The slot is freed
+        // when it drops to 0.
+        int valueCount;
+    } DimensionSlot;
 
-    // Cached sum over all existing buckets in mPastBuckets.
-    // Its buckets never contain entries of 0.
-    DimToValMap mSumOverPastBuckets;
+    // Maps each dimension with a value in the past buckets to its slot in mSlots.
+    unordered_map<MetricDimensionKey, size_t> mDimensionSlots;
+
+    std::vector<DimensionSlot> mSlots;
+
+    // Slots in mSlots that no dimension uses.
+    std::vector<size_t> mFreeSlots;
+
+    // The cells of all slots: mPastValues[slot * mNumOfPastBuckets + index(bucketNum)]. A cell
+    // only holds a value if its flag in mHasPastValue is set.
+    std::vector<int64_t> mPastValues;
+    std::vector<bool> mHasPastValue;
+
+    // For each past bucket, the slots that were given a value in it. May hold stale or repeated
+    // slots, whose cells are then skipped. Always of size mNumOfPastBuckets.
+    std::vector<std::vector<size_t>> mBucketSlots;
 
     // The bucket number of the last added bucket.
     int64_t mMostRecentBucketNum = -1;
@@ -155,15 +178,15 @@ protected:
     //   [mMostRecentBucketNum - mNumOfPastBuckets + 1, bucketNum - mNumOfPastBuckets].
     void advanceMostRecentBucketTo(const int64_t& bucketNum);
 
-    // Add the information in the given bucket to mSumOverPastBuckets.
-    void addBucketToSum(const shared_ptr<DimToValMap>& bucket);
+    // Sets the value of the dimension in the past bucket at bucketIndex, updating its sum.
+    void setPastValue(const MetricDimensionKey& key, size_t bucketIndex, int64_t value);
 
-    // Subtract the information in the given bucket from mSumOverPastBuckets
-    // and remove any items with value 0.
-    void subtractBucketFromSum(const shared_ptr<DimToValMap>& bucket);
+    // Removes the value of the slot in the past bucket at bucketIndex, if any, and frees the
+    // slot if that was its last value.
+    void clearPastValue(size_t slot, size_t bucketIndex);
 
-    // From mSumOverPastBuckets[key], subtracts bucketValue, removing it if it is now 0.
-    void subtractValueFromSum(const MetricDimensionKey& key, const int64_t& bucketValue);
+    // Removes all the values of the past bucket at bucketIndex.
+    void clearPastBucket(size_t bucketIndex);
 
     // Returns true if in the refractory period, else false.
     bool isInRefractoryPeriod(const int64_t& timestampNs, const MetricDimensionKey& key) const;
@@ -180,6 +203,7 @@ protected:
 
     FRIEND_TEST(AnomalyTrackerTest, TestConsecutiveBuckets);
     FRIEND_TEST(AnomalyTrackerTest, TestSparseBuckets);
+    FRIEND_TEST(AnomalyTrackerTest, TestPastBucketsReuseSlots);
     FRIEND_TEST(GaugeMetricProducerTest, TestAnomalyDetection);
     FRIEND_TEST(CountMetricProducerTest, TestAnomalyDetectionUnSliced);
     FRIEND_TEST(AnomalyDetectionE2eTest, TestDurationMetric_SUM_single_bucket);
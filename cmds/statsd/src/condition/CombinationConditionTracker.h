@@ -81,6 +81,10 @@ public:
 
     bool IsSimpleCondition() const  override { return false; }
 
+    const std::vector<int>& getChildren() const override {
+        return mChildren;
+    }
+
     bool IsChangedDimensionTrackable() const  override {
         return mLogicalOperation == LogicalOperation::AND && mSlicedChildren.size() == 1;
     }
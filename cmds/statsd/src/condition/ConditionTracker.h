@@ -113,6 +113,13 @@ public:
         return mTrackerIndex;
     }
 
+    // return the list of ConditionTracker index that this ConditionTracker evaluates together
+    // with itself. Only combination conditions have children.
+    virtual const std::vector<int>& getChildren() const {
+        static const std::vector<int> kNoChildren;
+        return kNoChildren;
+    }
+
     virtual void setSliced(bool sliced) {
         mSliced = mSliced | sliced;
     }
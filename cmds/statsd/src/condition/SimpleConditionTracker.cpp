@@ -20,6 +20,8 @@
 #include "SimpleConditionTracker.h"
 #include "guardrail/StatsdStats.h"
 
+#include <algorithm>
+
 namespace android {
 namespace os {
 namespace statsd {
@@ -127,6 +129,84 @@ void SimpleConditionTracker::dumpState() {
     }
 }
 
+// Gets the values of key for the given fields, in that order. Returns false if key lacks any of
+// them, in which case it doesn't contain any key with those fields.
+static bool getValuesForFields(const HashableDimensionKey& key, const vector<Field>& fields,
+                               HashableDimensionKey* output) {
+    for (const Field& field : fields) {
+        bool found = false;
+        for (const auto& value : key.getValues()) {
+            if (value.mField == field) {
+                output->addValue(value);
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const SimpleConditionTracker::PartialKeyIndex& SimpleConditionTracker::getPartialKeyIndex(
+        const HashableDimensionKey& partialKey) const {
+    vector<Field> fields;
+    for (const auto& value : partialKey.getValues()) {
+        fields.push_back(value.mField);
+    }
+    for (const auto& index : mPartialKeyIndexes) {
+        if (index.fields == fields) {
+            return index;
+        }
+    }
+
+    mPartialKeyIndexes.push_back(PartialKeyIndex());
+    PartialKeyIndex& index = mPartialKeyIndexes.back();
+    index.fields = fields;
+    for (const auto& slice : mSlicedConditionState) {
+        HashableDimensionKey values;
+        if (getValuesForFields(slice.first, fields, &values)) {
+            index.slices[values].push_back(slice.first);
+        }
+    }
+    return index;
+}
+
+void SimpleConditionTracker::insertSlice(const HashableDimensionKey& key, int startedCount) {
+    mSlicedConditionState[key] = startedCount;
+    for (auto& index : mPartialKeyIndexes) {
+        HashableDimensionKey values;
+        if (getValuesForFields(key, index.fields, &values)) {
+            index.slices[values].push_back(key);
+        }
+    }
+}
+
+void SimpleConditionTracker::eraseSlice(unordered_map<HashableDimensionKey, int>::iterator it) {
+    const HashableDimensionKey& key = it->first;
+    for (auto& index : mPartialKeyIndexes) {
+        HashableDimensionKey values;
+        if (!getValuesForFields(key, index.fields, &values)) {
+            continue;
+        }
+        auto slicesIt = index.slices.find(values);
+        if (slicesIt == index.slices.end()) {
+            continue;
+        }
+        vector<HashableDimensionKey>& slices = slicesIt->second;
+        auto sliceIt = std::find(slices.begin(), slices.end(), key);
+        if (sliceIt != slices.end()) {
+            *sliceIt = slices.back();
+            slices.pop_back();
+        }
+        if (slices.empty()) {
+            index.slices.erase(slicesIt);
+        }
+    }
+    mSlicedConditionState.erase(it);
+}
+
 void SimpleConditionTracker::handleStopAll(std::vector<ConditionState>& conditionCache,
                                            std::vector<bool>& conditionChangedCache) {
     // Unless the default condition is false, and there was nothing started, otherwise we have
@@ -144,6 +224,9 @@ void SimpleConditionTracker::handleStopAll(std::vector<ConditionState>& conditio
     // After StopAll, we know everything has stopped. From now on, default condition is false.
     mInitialValue = ConditionState::kFalse;
     mSlicedConditionState.clear();
+    for (auto& index : mPartialKeyIndexes) {
+        index.slices.clear();
+    }
     conditionCache[mIndex] = ConditionState::kFalse;
     if (!mSliced) {
         mUnSlicedPart = ConditionState::kFalse;
@@ -185,13 +268,13 @@ void SimpleConditionTracker::handleConditionEvent(const HashableDimensionKey& ou
         // We get a new output key.
         newCondition = matchStart ? ConditionState::kTrue : ConditionState::kFalse;
         if (matchStart && mInitialValue != ConditionState::kTrue) {
-            mSlicedConditionState[outputKey] = 1;
+            insertSlice(outputKey, 1);
             changed = true;
             mLastChangedToTrueDimensions.insert(outputKey);
         } else if (mInitialValue != ConditionState::kFalse) {
             // it's a stop and we don't have history about it.
             // If the default condition is not false, it means this stop is valuable to us.
-            mSlicedConditionState[outputKey] = 0;
+            insertSlice(outputKey, 0);
             mLastChangedToFalseDimensions.insert(outputKey);
             changed = true;
         }
@@ -233,7 +316,7 @@ void SimpleConditionTracker::handleConditionEvent(const HashableDimensionKey& ou
 
             // if default condition is false, it means we don't need to keep the false values.
             if (mInitialValue == ConditionState::kFalse && startedCount == 0) {
-                mSlicedConditionState.erase(outputIt);
+                eraseSlice(outputIt);
                 VLOG("erase key %s", outputKey.toString().c_str());
             }
         }
@@ -384,18 +467,24 @@ void SimpleConditionTracker::isConditionMet(
         // For unseen key, check whether the require dimensions are subset of sliced condition
         // output.
         conditionState = conditionState | mInitialValue;
-        for (const auto& slice : mSlicedConditionState) {
-            ConditionState sliceState =
-                slice.second > 0 ? ConditionState::kTrue : ConditionState::kFalse;
-            if (slice.first.contains(key)) {
+        const PartialKeyIndex& index = getPartialKeyIndex(key);
+        const auto& slicesIt = index.slices.find(key);
+        if (slicesIt != index.slices.end()) {
+            for (const auto& sliceKey : slicesIt->second) {
+                const auto& slice = mSlicedConditionState.find(sliceKey);
+                if (slice == mSlicedConditionState.end()) {
+                    continue;
+                }
+                ConditionState sliceState =
+                    slice->second > 0 ? ConditionState::kTrue : ConditionState::kFalse;
                 conditionState = conditionState | sliceState;
                 if (sliceState == ConditionState::kTrue && dimensionFields.size() > 0) {
                     if (isSubOutputDimensionFields) {
                         HashableDimensionKey dimensionKey;
-                        filterValues(dimensionFields, slice.first.getValues(), &dimensionKey);
+                        filterValues(dimensionFields, slice->first.getValues(), &dimensionKey);
                         dimensionsKeySet.insert(dimensionKey);
                     } else {
-                        dimensionsKeySet.insert(slice.first);
+                        dimensionsKeySet.insert(slice->first);
                     }
                 }
             }
@@ -123,7 +123,28 @@ private:
 
     int mDimensionTag;
 
-    std::map<HashableDimensionKey, int> mSlicedConditionState;
+    std::unordered_map<HashableDimensionKey, int> mSlicedConditionState;
+
+    // The keys in mSlicedConditionState, by their values for a subset of their fields. Lets a
+    // partial link find the slices that contain its key without comparing it to every slice.
+    struct PartialKeyIndex {
+        std::vector<Field> fields;
+        std::unordered_map<HashableDimensionKey, std::vector<HashableDimensionKey>> slices;
+    };
+
+    // One index per set of fields that partial links have queried. An index is built on the
+    // first query with its fields and kept in sync with mSlicedConditionState from then on,
+    // hence mutable.
+    mutable std::vector<PartialKeyIndex> mPartialKeyIndexes;
+
+    // Returns the index on the fields of partialKey, building it if needed.
+    const PartialKeyIndex& getPartialKeyIndex(const HashableDimensionKey& partialKey) const;
+
+    // Adds a key to mSlicedConditionState and to the partial key indexes.
+    void insertSlice(const HashableDimensionKey& key, int startedCount);
+
+    // Removes a key from mSlicedConditionState and from the partial key indexes.
+    void eraseSlice(std::unordered_map<HashableDimensionKey, int>::iterator it);
 
     void handleStopAll(std::vector<ConditionState>& conditionCache,
                        std::vector<bool>& changedCache);
@@ -138,6 +159,7 @@ private:
     FRIEND_TEST(SimpleConditionTrackerTest, TestSlicedCondition);
     FRIEND_TEST(SimpleConditionTrackerTest, TestSlicedWithNoOutputDim);
     FRIEND_TEST(SimpleConditionTrackerTest, TestStopAll);
+    FRIEND_TEST(SimpleConditionTrackerTest, TestPartialLinkIndex);
 };
 
 }  // namespace statsd
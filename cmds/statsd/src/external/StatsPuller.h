@@ -37,6 +37,8 @@ public:
 
     virtual ~StatsPuller() {}
 
+    // Pulls the atom, or returns the data of the last pull if it is younger than the cooldown.
+    // Concurrent requests for the atom wait for the pull in progress and share its data.
     bool Pull(const int64_t timeNs, std::vector<std::shared_ptr<LogEvent>>* data);
 
     // Clear cache immediately
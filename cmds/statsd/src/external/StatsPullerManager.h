@@ -40,8 +40,10 @@ class StatsPullerManager {
         return mPullerManager.PullerForMatcherExists(tagId);
     }
 
-    void OnAlarmFired(const int64_t currentTimeNs) {
-        mPullerManager.OnAlarmFired(currentTimeNs);
+    void OnAlarmFired(
+            const int64_t currentTimeNs,
+            const std::function<void(const std::function<void()>&)>& withReceiversLocked) {
+        mPullerManager.OnAlarmFired(currentTimeNs, withReceiversLocked);
     }
 
     virtual bool Pull(const int tagId, const int64_t timesNs,
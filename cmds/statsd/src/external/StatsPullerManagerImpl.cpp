@@ -22,6 +22,7 @@
 #include <math.h>
 #include <stdint.h>
 #include <algorithm>
+#include <set>
 #include "../StatsService.h"
 #include "../logd/LogEvent.h"
 #include "../stats_log_util.h"
@@ -173,7 +174,8 @@ const std::map<int, PullAtomInfo> StatsPullerManagerImpl::kAllPullAtomInfo = {
         // temperature
         {android::util::TEMPERATURE, {{}, {}, 1, new ResourceThermalManagerPuller()}}};
 
-StatsPullerManagerImpl::StatsPullerManagerImpl() : mNextPullTimeNs(NO_ALARM_UPDATE) {
+StatsPullerManagerImpl::StatsPullerManagerImpl()
+    : mPullPool(kPullThreadCount), mNextPullTimeNs(NO_ALARM_UPDATE) {
 }
 
 bool StatsPullerManagerImpl::Pull(const int tagId, const int64_t timeNs,
@@ -278,23 +280,25 @@ void StatsPullerManagerImpl::UnRegisterReceiver(int tagId, wp<PullDataReceiver>
     }
 }
 
-void StatsPullerManagerImpl::OnAlarmFired(const int64_t currentTimeNs) {
-    AutoMutex _l(mLock);
-
-    int64_t minNextPullTimeNs = NO_ALARM_UPDATE;
-
-    vector<pair<int, vector<ReceiverInfo*>>> needToPull =
-            vector<pair<int, vector<ReceiverInfo*>>>();
-    for (auto& pair : mReceivers) {
-        vector<ReceiverInfo*> receivers = vector<ReceiverInfo*>();
-        if (pair.second.size() != 0) {
-            for (ReceiverInfo& receiverInfo : pair.second) {
-                if (receiverInfo.nextPullTimeNs <= currentTimeNs) {
-                    receivers.push_back(&receiverInfo);
+void StatsPullerManagerImpl::OnAlarmFired(
+        const int64_t currentTimeNs,
+        const std::function<void(const std::function<void()>&)>& withReceiversLocked) {
+    // mLock is only held to find the due receivers and to schedule the next alarm. The pulls
+    // themselves run unlocked, so that registering receivers doesn't wait for them.
+    vector<pair<int, vector<sp<PullDataReceiver>>>> needToPull;
+    {
+        AutoMutex _l(mLock);
+        for (const auto& pair : mReceivers) {
+            vector<sp<PullDataReceiver>> receivers;
+            for (const ReceiverInfo& receiverInfo : pair.second) {
+                if (receiverInfo.nextPullTimeNs > currentTimeNs) {
+                    continue;
+                }
+                sp<PullDataReceiver> receiverPtr = receiverInfo.receiver.promote();
+                if (receiverPtr != nullptr) {
+                    receivers.push_back(receiverPtr);
                 } else {
-                    if (receiverInfo.nextPullTimeNs < minNextPullTimeNs) {
-                        minNextPullTimeNs = receiverInfo.nextPullTimeNs;
-                    }
+                    VLOG("receiver already gone.");
                 }
             }
             if (receivers.size() > 0) {
@@ -303,24 +307,47 @@ void StatsPullerManagerImpl::OnAlarmFired(const int64_t currentTimeNs) {
         }
     }
 
-    for (const auto& pullInfo : needToPull) {
-        vector<shared_ptr<LogEvent>> data;
-        if (Pull(pullInfo.first, currentTimeNs, &data)) {
-            for (const auto& receiverInfo : pullInfo.second) {
-                sp<PullDataReceiver> receiverPtr = receiverInfo->receiver.promote();
-                if (receiverPtr != nullptr) {
-                    receiverPtr->onDataPulled(data);
-                    // we may have just come out of a coma, compute next pull time
-                    receiverInfo->nextPullTimeNs =
-                            (currentTimeNs - receiverInfo->nextPullTimeNs) /
-                                receiverInfo->intervalNs * receiverInfo->intervalNs +
-                            receiverInfo->intervalNs + receiverInfo->nextPullTimeNs;
-                    if (receiverInfo->nextPullTimeNs < minNextPullTimeNs) {
-                        minNextPullTimeNs = receiverInfo->nextPullTimeNs;
-                    }
-                } else {
-                    VLOG("receiver already gone.");
+    // Pull the atoms in parallel. Each atom is pulled once no matter how many receivers want it.
+    vector<vector<shared_ptr<LogEvent>>> pulledData(needToPull.size());
+    // Not vector<bool>, whose elements can't be written from different threads.
+    vector<char> pullSucceeded(needToPull.size(), false);
+    {
+        std::lock_guard<std::mutex> poolLock(mPullPoolMutex);
+        mPullPool.run(needToPull.size(), [&](size_t i) {
+            pullSucceeded[i] = Pull(needToPull[i].first, currentTimeNs, &pulledData[i]);
+        });
+    }
+
+    std::set<pair<int, PullDataReceiver*>> delivered;
+    withReceiversLocked([&]() {
+        for (size_t i = 0; i < needToPull.size(); i++) {
+            if (!pullSucceeded[i]) {
+                continue;
+            }
+            for (const auto& receiverPtr : needToPull[i].second) {
+                receiverPtr->onDataPulled(pulledData[i]);
+                delivered.insert(make_pair(needToPull[i].first, receiverPtr.get()));
+            }
+        }
+    });
+
+    AutoMutex _l(mLock);
+    int64_t minNextPullTimeNs = NO_ALARM_UPDATE;
+    for (auto& pair : mReceivers) {
+        for (ReceiverInfo& receiverInfo : pair.second) {
+            if (receiverInfo.nextPullTimeNs <= currentTimeNs) {
+                if (delivered.find(make_pair(pair.first, receiverInfo.receiver.unsafe_get())) ==
+                    delivered.end()) {
+                    continue;
                 }
+                // we may have just come out of a coma, compute next pull time
+                receiverInfo.nextPullTimeNs =
+                        (currentTimeNs - receiverInfo.nextPullTimeNs) / receiverInfo.intervalNs *
+                                receiverInfo.intervalNs +
+                        receiverInfo.intervalNs + receiverInfo.nextPullTimeNs;
+            }
+            if (receiverInfo.nextPullTimeNs < minNextPullTimeNs) {
+                minNextPullTimeNs = receiverInfo.nextPullTimeNs;
             }
         }
     }
@@ -20,12 +20,14 @@
 #include <binder/IServiceManager.h>
 #include <utils/RefBase.h>
 #include <utils/threads.h>
+#include <functional>
 #include <string>
 #include <unordered_map>
 #include <vector>
 #include <list>
 #include "PullDataReceiver.h"
 #include "StatsPuller.h"
+#include "WorkerPool.h"
 #include "logd/LogEvent.h"
 
 namespace android {
@@ -58,7 +60,11 @@ public:
     // Verify if we know how to pull for this matcher
     bool PullerForMatcherExists(int tagId) const;
 
-    void OnAlarmFired(const int64_t timeNs);
+    // Pulls the atoms that are due without holding any lock, then hands them to their receivers
+    // from within withReceiversLocked, which runs the delivery it is given with whatever locks
+    // the receivers need.
+    void OnAlarmFired(const int64_t timeNs,
+                      const std::function<void(const std::function<void()>&)>& withReceiversLocked);
 
     bool Pull(const int tagId, const int64_t timeNs, vector<std::shared_ptr<LogEvent>>* data);
 
@@ -87,6 +93,15 @@ public:
     // locks for data receiver and StatsCompanionService changes
     Mutex mLock;
 
+    // Threads that pull on top of the alarm thread when several atoms are due at once.
+    static const size_t kPullThreadCount = 3;
+
+    // Runs the pulls of independent atoms in parallel.
+    WorkerPool mPullPool;
+
+    // WorkerPool runs one batch at a time.
+    std::mutex mPullPoolMutex;
+
     void updateAlarmLocked();
 
     int64_t mNextPullTimeNs;
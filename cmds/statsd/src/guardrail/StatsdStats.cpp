@@ -52,6 +52,7 @@ const int FIELD_ID_LOGGER_ERROR_STATS = 11;
 const int FIELD_ID_PERIODIC_ALARM_STATS = 12;
 const int FIELD_ID_LOG_LOSS_STATS = 14;
 const int FIELD_ID_SYSTEM_SERVER_RESTART = 15;
+const int FIELD_ID_LOG_EVENT_BATCH_STATS = 16;
 
 const int FIELD_ID_ATOM_STATS_TAG = 1;
 const int FIELD_ID_ATOM_STATS_COUNT = 2;
@@ -76,6 +77,7 @@ const int FIELD_ID_CONFIG_STATS_BROADCAST = 10;
 const int FIELD_ID_CONFIG_STATS_DATA_DROP = 11;
 const int FIELD_ID_CONFIG_STATS_DUMP_REPORT_TIME = 12;
 const int FIELD_ID_CONFIG_STATS_DUMP_REPORT_BYTES = 20;
+const int FIELD_ID_CONFIG_STATS_BUSY_CONFIG_EVENTS_DROPPED = 21;
 const int FIELD_ID_CONFIG_STATS_MATCHER_STATS = 13;
 const int FIELD_ID_CONFIG_STATS_CONDITION_STATS = 14;
 const int FIELD_ID_CONFIG_STATS_METRIC_STATS = 15;
@@ -99,13 +101,19 @@ const int FIELD_ID_UID_MAP_BYTES_USED = 2;
 const int FIELD_ID_UID_MAP_DROPPED_CHANGES = 3;
 const int FIELD_ID_UID_MAP_DELETED_APPS = 4;
 
+const int FIELD_ID_LOG_EVENT_BATCH_COUNT = 1;
+const int FIELD_ID_LOG_EVENT_BATCH_EVENTS = 2;
+const int FIELD_ID_LOG_EVENT_BATCH_MAX_SIZE = 3;
+
 const std::map<int, std::pair<size_t, size_t>> StatsdStats::kAtomDimensionKeySizeLimitMap = {
         {android::util::CPU_TIME_PER_UID_FREQ, {6000, 10000}},
 };
 
+static std::atomic<uint64_t> sNextInstanceId(1);
+
 // TODO: add stats for pulled atoms.
-StatsdStats::StatsdStats() {
-    mPushedAtomStats.resize(android::util::kMaxPushedAtomId + 1);
+StatsdStats::StatsdStats()
+    : mPushedAtomStats(android::util::kMaxPushedAtomId + 1), mInstanceId(sNextInstanceId++) {
     mStartTimeSec = getWallClockSec();
 }
 
@@ -114,6 +122,82 @@ StatsdStats& StatsdStats::getInstance() {
     return statsInstance;
 }
 
+void StatsdStats::ThreadShard::retire() {
+    if (shard != nullptr) {
+        lock_guard<std::mutex> lock(shard->lock);
+        shard->retired = true;
+    }
+}
+
+StatsdStats::StatsShard& StatsdStats::getThreadShard() {
+    // Each thread caches the shard of the instance it reported to last. Only the singleton is
+    // used outside of tests, so the cache hardly ever misses after the first call.
+    thread_local ThreadShard threadShard;
+    if (threadShard.instanceId != mInstanceId) {
+        threadShard.retire();
+        threadShard.shard = std::make_shared<StatsShard>();
+        threadShard.instanceId = mInstanceId;
+        lock_guard<std::mutex> lock(mLock);
+        mShards.push_back(threadShard.shard);
+    }
+    return *threadShard.shard;
+}
+
+static void mergeMaxSizes(const std::map<const int64_t, int>& from,
+                          std::map<const int64_t, int>* to) {
+    for (const auto& pair : from) {
+        int& size = (*to)[pair.first];
+        if (pair.second > size) {
+            size = pair.second;
+        }
+    }
+}
+
+void StatsdStats::mergeShardsLocked() {
+    for (auto it = mShards.begin(); it != mShards.end();) {
+        // A copy, so that the shard outlives its lock when it is erased below.
+        const shared_ptr<StatsShard> shard = *it;
+        lock_guard<std::mutex> shardLock(shard->lock);
+        for (const auto& pair : shard->configs) {
+            auto statsIt = mConfigStats.find(pair.first);
+            if (statsIt == mConfigStats.end()) {
+                continue;
+            }
+            ConfigStats& stats = *statsIt->second;
+            const ConfigCounters& counters = pair.second;
+            for (const auto& matcher : counters.matcher_stats) {
+                stats.matcher_stats[matcher.first] += matcher.second;
+            }
+            mergeMaxSizes(counters.condition_stats, &stats.condition_stats);
+            mergeMaxSizes(counters.metric_stats, &stats.metric_stats);
+            mergeMaxSizes(counters.metric_dimension_in_condition_stats,
+                          &stats.metric_dimension_in_condition_stats);
+        }
+        shard->configs.clear();
+
+        for (const auto& pair : shard->pulls) {
+            PulledAtomStats& pulledAtomStats = mPulledAtomStats[pair.first];
+            pulledAtomStats.totalPull += pair.second.totalPull;
+            pulledAtomStats.totalPullFromCache += pair.second.totalPullFromCache;
+            pulledAtomStats.totalPullTimeNs += pair.second.totalPullTimeNs;
+            if (pair.second.maxPullTimeNs > pulledAtomStats.maxPullTimeNs) {
+                pulledAtomStats.maxPullTimeNs = pair.second.maxPullTimeNs;
+            }
+            for (int i = 0; i < kPullTimeHistogramBuckets; i++) {
+                pulledAtomStats.pullTimeHistogram[i] += pair.second.pullTimeHistogram[i];
+            }
+        }
+        shard->pulls.clear();
+
+        // Nothing is added to a retired shard, so it has just been merged for the last time.
+        if (shard->retired) {
+            it = mShards.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
 void StatsdStats::addToIceBoxLocked(shared_ptr<ConfigStats>& stats) {
     // The size of mIceBox grows strictly by one at a time. It won't be > kMaxIceBoxSize.
     if (mIceBox.size() == kMaxIceBoxSize) {
@@ -156,6 +240,8 @@ void StatsdStats::noteConfigReceived(
 void StatsdStats::noteConfigRemovedInternalLocked(const ConfigKey& key) {
     auto it = mConfigStats.find(key);
     if (it != mConfigStats.end()) {
+        // Settle the counters before the stats go to the ice box.
+        mergeShardsLocked();
         int32_t nowTimeSec = getWallClockSec();
         it->second->deletion_time_sec = nowTimeSec;
         addToIceBoxLocked(it->second);
@@ -188,6 +274,15 @@ void StatsdStats::noteLogLost(int64_t timestampNs) {
     mLogLossTimestampNs.push_back(timestampNs);
 }
 
+void StatsdStats::noteLogEventBatch(int batchSize) {
+    lock_guard<std::mutex> lock(mLock);
+    mLogEventBatchStats.batches++;
+    mLogEventBatchStats.events += batchSize;
+    if (batchSize > mLogEventBatchStats.maxBatchSize) {
+        mLogEventBatchStats.maxBatchSize = batchSize;
+    }
+}
+
 void StatsdStats::noteBroadcastSent(const ConfigKey& key) {
     noteBroadcastSent(key, getWallClockSec());
 }
@@ -209,6 +304,16 @@ void StatsdStats::noteDataDropped(const ConfigKey& key) {
     noteDataDropped(key, getWallClockSec());
 }
 
+void StatsdStats::noteBusyConfigEventDropped(const ConfigKey& key) {
+    lock_guard<std::mutex> lock(mLock);
+    auto it = mConfigStats.find(key);
+    if (it == mConfigStats.end()) {
+        ALOGE("Config key %s not found!", key.ToString().c_str());
+        return;
+    }
+    it->second->busy_config_events_dropped++;
+}
+
 void StatsdStats::noteDataDropped(const ConfigKey& key, int32_t timeSec) {
     lock_guard<std::mutex> lock(mLock);
     auto it = mConfigStats.find(key);
@@ -261,54 +366,40 @@ void StatsdStats::setCurrentUidMapMemory(int bytes) {
 }
 
 void StatsdStats::noteConditionDimensionSize(const ConfigKey& key, const int64_t& id, int size) {
-    lock_guard<std::mutex> lock(mLock);
+    StatsShard& shard = getThreadShard();
+    lock_guard<std::mutex> lock(shard.lock);
     // if name doesn't exist before, it will create the key with count 0.
-    auto statsIt = mConfigStats.find(key);
-    if (statsIt == mConfigStats.end()) {
-        return;
-    }
-
-    auto& conditionSizeMap = statsIt->second->condition_stats;
-    if (size > conditionSizeMap[id]) {
-        conditionSizeMap[id] = size;
+    int& maxSize = shard.configs[key].condition_stats[id];
+    if (size > maxSize) {
+        maxSize = size;
     }
 }
 
 void StatsdStats::noteMetricDimensionSize(const ConfigKey& key, const int64_t& id, int size) {
-    lock_guard<std::mutex> lock(mLock);
+    StatsShard& shard = getThreadShard();
+    lock_guard<std::mutex> lock(shard.lock);
     // if name doesn't exist before, it will create the key with count 0.
-    auto statsIt = mConfigStats.find(key);
-    if (statsIt == mConfigStats.end()) {
-        return;
-    }
-    auto& metricsDimensionMap = statsIt->second->metric_stats;
-    if (size > metricsDimensionMap[id]) {
-        metricsDimensionMap[id] = size;
+    int& maxSize = shard.configs[key].metric_stats[id];
+    if (size > maxSize) {
+        maxSize = size;
     }
 }
 
 void StatsdStats::noteMetricDimensionInConditionSize(
         const ConfigKey& key, const int64_t& id, int size) {
-    lock_guard<std::mutex> lock(mLock);
+    StatsShard& shard = getThreadShard();
+    lock_guard<std::mutex> lock(shard.lock);
     // if name doesn't exist before, it will create the key with count 0.
-    auto statsIt = mConfigStats.find(key);
-    if (statsIt == mConfigStats.end()) {
-        return;
-    }
-    auto& metricsDimensionMap = statsIt->second->metric_dimension_in_condition_stats;
-    if (size > metricsDimensionMap[id]) {
-        metricsDimensionMap[id] = size;
+    int& maxSize = shard.configs[key].metric_dimension_in_condition_stats[id];
+    if (size > maxSize) {
+        maxSize = size;
     }
 }
 
 void StatsdStats::noteMatcherMatched(const ConfigKey& key, const int64_t& id) {
-    lock_guard<std::mutex> lock(mLock);
-
-    auto statsIt = mConfigStats.find(key);
-    if (statsIt == mConfigStats.end()) {
-        return;
-    }
-    statsIt->second->matcher_stats[id]++;
+    StatsShard& shard = getThreadShard();
+    lock_guard<std::mutex> lock(shard.lock);
+    shard.configs[key].matcher_stats[id]++;
 }
 
 void StatsdStats::noteAnomalyDeclared(const ConfigKey& key, const int64_t& id) {
@@ -336,24 +427,42 @@ void StatsdStats::updateMinPullIntervalSec(int pullAtomId, long intervalSec) {
 }
 
 void StatsdStats::notePull(int pullAtomId) {
-    lock_guard<std::mutex> lock(mLock);
-    mPulledAtomStats[pullAtomId].totalPull++;
+    StatsShard& shard = getThreadShard();
+    lock_guard<std::mutex> lock(shard.lock);
+    shard.pulls[pullAtomId].totalPull++;
 }
 
 void StatsdStats::notePullFromCache(int pullAtomId) {
-    lock_guard<std::mutex> lock(mLock);
-    mPulledAtomStats[pullAtomId].totalPullFromCache++;
+    StatsShard& shard = getThreadShard();
+    lock_guard<std::mutex> lock(shard.lock);
+    shard.pulls[pullAtomId].totalPullFromCache++;
 }
 
-void StatsdStats::noteAtomLogged(int atomId, int32_t timeSec) {
-    lock_guard<std::mutex> lock(mLock);
+void StatsdStats::notePullTime(int pullAtomId, int64_t pullTimeNs) {
+    int bucket = 0;
+    int64_t bucketLimitNs = 1000000;  // 1ms
+    while (bucket < kPullTimeHistogramBuckets - 1 && pullTimeNs >= bucketLimitNs) {
+        bucket++;
+        bucketLimitNs *= 4;
+    }
 
+    StatsShard& shard = getThreadShard();
+    lock_guard<std::mutex> lock(shard.lock);
+    PulledAtomStats& pulledAtomStats = shard.pulls[pullAtomId];
+    pulledAtomStats.totalPullTimeNs += pullTimeNs;
+    if (pullTimeNs > pulledAtomStats.maxPullTimeNs) {
+        pulledAtomStats.maxPullTimeNs = pullTimeNs;
+    }
+    pulledAtomStats.pullTimeHistogram[bucket]++;
+}
+
+void StatsdStats::noteAtomLogged(int atomId, int32_t timeSec) {
     if (atomId > android::util::kMaxPushedAtomId) {
         ALOGW("not interested in atom %d", atomId);
         return;
     }
 
-    mPushedAtomStats[atomId]++;
+    mPushedAtomStats[atomId].fetch_add(1, std::memory_order_relaxed);
 }
 
 void StatsdStats::noteSystemServerRestart(int32_t timeSec) {
@@ -380,6 +489,8 @@ void StatsdStats::reset() {
 }
 
 void StatsdStats::resetInternalLocked() {
+    // Empty the shards first, so that nothing counted before the reset shows up after it.
+    mergeShardsLocked();
     // Reset the historical data, but keep the active ConfigStats
     mStartTimeSec = getWallClockSec();
     mIceBox.clear();
@@ -389,9 +500,11 @@ void StatsdStats::resetInternalLocked() {
     mLoggerErrors.clear();
     mSystemServerRestartSec.clear();
     mLogLossTimestampNs.clear();
+    mLogEventBatchStats = {0, 0, 0};
     for (auto& config : mConfigStats) {
         config.second->broadcast_sent_time_sec.clear();
         config.second->data_drop_time_sec.clear();
+        config.second->busy_config_events_dropped = 0;
         config.second->dump_report_stats.clear();
         config.second->annotations.clear();
         config.second->matcher_stats.clear();
@@ -410,8 +523,9 @@ string buildTimeString(int64_t timeSec) {
     return string(timeBuffer);
 }
 
-void StatsdStats::dumpStats(FILE* out) const {
+void StatsdStats::dumpStats(FILE* out) {
     lock_guard<std::mutex> lock(mLock);
+    mergeShardsLocked();
     time_t t = mStartTimeSec;
     struct tm* tm = localtime(&t);
     char timeBuffer[80];
@@ -461,6 +575,11 @@ void StatsdStats::dumpStats(FILE* out) const {
                     buildTimeString(dataDropTime).c_str(), (long long)dataDropTime);
         }
 
+        if (configStats->busy_config_events_dropped > 0) {
+            fprintf(out, "\tevents dropped while busy: %d\n",
+                    configStats->busy_config_events_dropped);
+        }
+
         for (const auto& dump : configStats->dump_report_stats) {
             fprintf(out, "\tdump report time: %s(%lld) bytes: %lld\n",
                     buildTimeString(dump.first).c_str(), (long long)dump.first,
@@ -490,15 +609,22 @@ void StatsdStats::dumpStats(FILE* out) const {
     fprintf(out, "********Pushed Atom stats***********\n");
     const size_t atomCounts = mPushedAtomStats.size();
     for (size_t i = 2; i < atomCounts; i++) {
-        if (mPushedAtomStats[i] > 0) {
-            fprintf(out, "Atom %lu->%d\n", (unsigned long)i, mPushedAtomStats[i]);
+        const int count = mPushedAtomStats[i].load(std::memory_order_relaxed);
+        if (count > 0) {
+            fprintf(out, "Atom %lu->%d\n", (unsigned long)i, count);
         }
     }
 
     fprintf(out, "********Pulled Atom stats***********\n");
     for (const auto& pair : mPulledAtomStats) {
-        fprintf(out, "Atom %d->%ld, %ld, %ld\n", (int)pair.first, (long)pair.second.totalPull,
-                (long)pair.second.totalPullFromCache, (long)pair.second.minPullIntervalSec);
+        fprintf(out, "Atom %d->%ld, %ld, %ld, max pull time %lldns, pull time histogram:",
+                (int)pair.first, (long)pair.second.totalPull,
+                (long)pair.second.totalPullFromCache, (long)pair.second.minPullIntervalSec,
+                (long long)pair.second.maxPullTimeNs);
+        for (int i = 0; i < kPullTimeHistogramBuckets; i++) {
+            fprintf(out, " %ld", pair.second.pullTimeHistogram[i]);
+        }
+        fprintf(out, "\n");
     }
 
     if (mAnomalyAlarmRegisteredStats > 0) {
@@ -531,6 +657,12 @@ void StatsdStats::dumpStats(FILE* out) const {
     for (const auto& loss : mLogLossTimestampNs) {
         fprintf(out, "Log loss detected at %lld (elapsedRealtimeNs)\n", (long long)loss);
     }
+
+    if (mLogEventBatchStats.batches > 0) {
+        fprintf(out, "Log event batches: %lld, events: %lld, max batch size: %d\n",
+                (long long)mLogEventBatchStats.batches, (long long)mLogEventBatchStats.events,
+                mLogEventBatchStats.maxBatchSize);
+    }
 }
 
 void addConfigStatsToProto(const ConfigStats& configStats, ProtoOutputStream* proto) {
@@ -563,6 +695,11 @@ void addConfigStatsToProto(const ConfigStats& configStats, ProtoOutputStream* pr
                      drop);
     }
 
+    if (configStats.busy_config_events_dropped > 0) {
+        proto->write(FIELD_TYPE_INT32 | FIELD_ID_CONFIG_STATS_BUSY_CONFIG_EVENTS_DROPPED,
+                     configStats.busy_config_events_dropped);
+    }
+
     for (const auto& dump : configStats.dump_report_stats) {
         proto->write(FIELD_TYPE_INT32 | FIELD_ID_CONFIG_STATS_DUMP_REPORT_TIME |
                      FIELD_COUNT_REPEATED,
@@ -628,6 +765,7 @@ void addConfigStatsToProto(const ConfigStats& configStats, ProtoOutputStream* pr
 
 void StatsdStats::dumpStats(std::vector<uint8_t>* output, bool reset) {
     lock_guard<std::mutex> lock(mLock);
+    mergeShardsLocked();
 
     ProtoOutputStream proto;
     proto.write(FIELD_TYPE_INT32 | FIELD_ID_BEGIN_TIME, mStartTimeSec);
@@ -643,11 +781,12 @@ void StatsdStats::dumpStats(std::vector<uint8_t>* output, bool reset) {
 
     const size_t atomCounts = mPushedAtomStats.size();
     for (size_t i = 2; i < atomCounts; i++) {
-        if (mPushedAtomStats[i] > 0) {
+        const int count = mPushedAtomStats[i].load(std::memory_order_relaxed);
+        if (count > 0) {
             uint64_t token =
                     proto.start(FIELD_TYPE_MESSAGE | FIELD_ID_ATOM_STATS | FIELD_COUNT_REPEATED);
             proto.write(FIELD_TYPE_INT32 | FIELD_ID_ATOM_STATS_TAG, (int32_t)i);
-            proto.write(FIELD_TYPE_INT32 | FIELD_ID_ATOM_STATS_COUNT, mPushedAtomStats[i]);
+            proto.write(FIELD_TYPE_INT32 | FIELD_ID_ATOM_STATS_COUNT, count);
             proto.end(token);
         }
     }
@@ -695,6 +834,17 @@ void StatsdStats::dumpStats(std::vector<uint8_t>* output, bool reset) {
                     restart);
     }
 
+    if (mLogEventBatchStats.batches > 0) {
+        uint64_t token = proto.start(FIELD_TYPE_MESSAGE | FIELD_ID_LOG_EVENT_BATCH_STATS);
+        proto.write(FIELD_TYPE_INT64 | FIELD_ID_LOG_EVENT_BATCH_COUNT,
+                    (long long)mLogEventBatchStats.batches);
+        proto.write(FIELD_TYPE_INT64 | FIELD_ID_LOG_EVENT_BATCH_EVENTS,
+                    (long long)mLogEventBatchStats.events);
+        proto.write(FIELD_TYPE_INT32 | FIELD_ID_LOG_EVENT_BATCH_MAX_SIZE,
+                    mLogEventBatchStats.maxBatchSize);
+        proto.end(token);
+    }
+
     output->clear();
     size_t bufferSize = proto.size();
     output->resize(bufferSize);
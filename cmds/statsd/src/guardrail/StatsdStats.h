@@ -20,6 +20,7 @@
 
 #include <gtest/gtest_prod.h>
 #include <log/log_time.h>
+#include <atomic>
 #include <list>
 #include <mutex>
 #include <string>
@@ -43,6 +44,9 @@ struct ConfigStats {
 
     std::list<int32_t> broadcast_sent_time_sec;
     std::list<int32_t> data_drop_time_sec;
+
+    // The number of events dropped because too many were queued while the config was busy.
+    int32_t busy_config_events_dropped = 0;
     std::list<std::pair<int32_t, int64_t>> dump_report_stats;
 
     // Stores how many times a matcher have been matched. The map size is capped by kMaxConfigCount.
@@ -118,6 +122,22 @@ public:
     // data subscriber that it's time to call getData.
     static const size_t kBytesPerConfigTriggerGetData = 192 * 1024;
 
+    // Event metrics move their data to disk in chunks of this size, rather than holding it all
+    // in memory until the next dump.
+    static const size_t kEventMetricSpillChunkBytes = 32 * 1024;
+
+    // Max data an event metric keeps on disk. Past this, further data stays in memory and counts
+    // against kMaxMetricsBytesPerConfig.
+    static const size_t kMaxSpilledBytesPerMetric = 2 * 1024 * 1024;
+
+    // Once the event metrics of a configuration hold this much data on disk, we notify the data
+    // subscriber that it's time to call getData.
+    static const size_t kSpilledBytesPerConfigTriggerGetData = 1024 * 1024;
+
+    // Max number of events queued for a config while it is busy, e.g. dumping a report. Later
+    // events for it are dropped until the queue is replayed.
+    static const size_t kMaxPendingEventsPerConfig = 10000;
+
     // Cap the UID map's memory usage to this. This should be fairly high since the UID information
     // is critical for understanding the metrics.
     const static size_t kMaxBytesUsedUidMap = 50 * 1024;
@@ -140,6 +160,14 @@ public:
     // Maximum size of all files that can be written to stats directory on disk.
     static const int kMaxFileSize = 50 * 1024 * 1024;
 
+    // Size after which metrics reports go to a new segment file on disk. A report that is larger
+    // than this gets a segment of its own.
+    static const int kMaxReportSegmentSize = 1024 * 1024;
+
+    // Number of buckets in the pull time histogram of each pulled atom. Bucket i counts the
+    // pulls that took less than 4^i ms; the last bucket counts the rest.
+    static const int kPullTimeHistogramBuckets = 8;
+
     // How long to try to clear puller cache from last time
     static const long kPullerCacheClearIntervalSec = 1;
 
@@ -172,6 +200,12 @@ public:
      */
     void noteDataDropped(const ConfigKey& key);
 
+    /**
+     * Report an event has been dropped because too many were queued while the config was busy,
+     * e.g. dumping a report.
+     */
+    void noteBusyConfigEventDropped(const ConfigKey& key);
+
     /**
      * Report metrics data report has been sent.
      *
@@ -272,6 +306,9 @@ public:
     // Notify pull request for an atom served from cached data
     void notePullFromCache(int pullAtomId);
 
+    // Notify how long an actual pull of an atom took
+    void notePullTime(int pullAtomId, int64_t pullTimeNs);
+
     /**
      * Records statsd met an error while reading from logd.
      */
@@ -287,6 +324,11 @@ public:
      */
     void noteLogLost(int64_t timestamp);
 
+    /**
+     * Records that the socket listener handed [batchSize] events to the processor at once.
+     */
+    void noteLogEventBatch(int batchSize);
+
     /**
      * Reset the historical stats. Including all stats in icebox, and the tracked stats about
      * metrics, matchers, and atoms. The active configs will be kept and StatsdStats will continue
@@ -304,14 +346,23 @@ public:
     /**
      * Output statsd stats in human readable format to [out] file.
      */
-    void dumpStats(FILE* out) const;
+    void dumpStats(FILE* out);
 
     typedef struct {
         long totalPull;
         long totalPullFromCache;
         long minPullIntervalSec;
+        int64_t totalPullTimeNs;
+        int64_t maxPullTimeNs;
+        long pullTimeHistogram[kPullTimeHistogramBuckets];
     } PulledAtomStats;
 
+    typedef struct {
+        int64_t batches;
+        int64_t events;
+        int32_t maxBatchSize;
+    } LogEventBatchStats;
+
 private:
     StatsdStats();
 
@@ -334,7 +385,8 @@ private:
     // The size of the vector is the largest pushed atom id in atoms.proto + 1. Atoms
     // out of that range will be dropped (it's either pulled atoms or test atoms).
     // This is a vector, not a map because it will be accessed A LOT -- for each stats log.
-    std::vector<int> mPushedAtomStats;
+    // The counters are atomic so that logging an atom never takes mLock.
+    std::vector<std::atomic<int>> mPushedAtomStats;
 
     // Maps PullAtomId to its stats. The size is capped by the puller atom counts.
     std::map<int, PulledAtomStats> mPulledAtomStats;
@@ -347,6 +399,9 @@ private:
 
     std::list<int32_t> mSystemServerRestartSec;
 
+    // Stats about the batches read from the statsd socket.
+    LogEventBatchStats mLogEventBatchStats = {0, 0, 0};
+
     // Stores the number of times statsd modified the anomaly alarm registered with
     // StatsCompanionService.
     int mAnomalyAlarmRegisteredStats = 0;
@@ -354,6 +409,52 @@ private:
     // Stores the number of times statsd registers the periodic alarm changes
     int mPeriodicAlarmRegisteredStats = 0;
 
+    // Per config counters that are bumped for every matched event or dimension change.
+    typedef struct {
+        std::map<const int64_t, int> matcher_stats;
+        std::map<const int64_t, int> condition_stats;
+        std::map<const int64_t, int> metric_stats;
+        std::map<const int64_t, int> metric_dimension_in_condition_stats;
+    } ConfigCounters;
+
+    // The counters one thread collected since the last merge. Each thread that reports
+    // matcher, dimension or pull stats gets its own shard, so the ingestion threads never wait
+    // on mLock or on each other. The shard lock is only contended while the shard is merged.
+    struct StatsShard {
+        std::mutex lock;
+        // Set once no thread reports to the shard any more. Guarded by lock.
+        bool retired = false;
+        std::map<const ConfigKey, ConfigCounters> configs;
+        std::map<int, PulledAtomStats> pulls;
+    };
+
+    // The calling thread's shard. It is retired when the thread exits or starts reporting to
+    // another instance, so that the instance drops it after merging it one last time.
+    struct ThreadShard {
+        uint64_t instanceId = 0;
+        std::shared_ptr<StatsShard> shard;
+
+        ~ThreadShard() {
+            retire();
+        }
+
+        void retire();
+    };
+
+    // All the shards handed out by this instance and not yet dropped. Guarded by mLock.
+    std::vector<std::shared_ptr<StatsShard>> mShards;
+
+    // Tells the shards of different instances apart in the calling thread's cache.
+    const uint64_t mInstanceId;
+
+    // Returns the calling thread's shard, registering a new one on first use.
+    StatsShard& getThreadShard();
+
+    // Folds the shards into mConfigStats and mPulledAtomStats and clears them, dropping the
+    // retired ones. Counters for configs that no longer exist are dropped, like they would have
+    // been when noted.
+    void mergeShardsLocked();
+
     void noteConfigResetInternalLocked(const ConfigKey& key);
 
     void noteConfigRemovedInternalLocked(const ConfigKey& key);
@@ -372,10 +473,14 @@ private:
     FRIEND_TEST(StatsdStatsTest, TestInvalidConfigAdd);
     FRIEND_TEST(StatsdStatsTest, TestConfigRemove);
     FRIEND_TEST(StatsdStatsTest, TestSubStats);
+    FRIEND_TEST(StatsdStatsTest, TestBusyConfigEventDropped);
     FRIEND_TEST(StatsdStatsTest, TestAtomLog);
     FRIEND_TEST(StatsdStatsTest, TestTimestampThreshold);
     FRIEND_TEST(StatsdStatsTest, TestAnomalyMonitor);
     FRIEND_TEST(StatsdStatsTest, TestSystemServerCrash);
+    FRIEND_TEST(StatsdStatsTest, TestLogEventBatch);
+    FRIEND_TEST(StatsdStatsTest, TestCountersFromManyThreads);
+    FRIEND_TEST(StatsdStatsTest, TestPullTimeHistogram);
 };
 
 }  // namespace statsd
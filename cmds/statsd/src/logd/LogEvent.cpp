@@ -40,6 +40,49 @@ LogEvent::LogEvent(log_msg& msg) {
     }
 }
 
+LogEvent::LogEvent(const char* buffer, size_t len, uint32_t uid, int64_t logdTimestampNs) {
+    mLogdTimestampNs = logdTimestampNs;
+    mLogUid = uid;
+    mElapsedTimestampNs = 0;
+    mTagId = 0;
+
+    // Every stats log is a list that starts with the elapsed timestamp and the atom id:
+    // [EVENT_TYPE_LIST][count][EVENT_TYPE_LONG][int64][EVENT_TYPE_INT][int32]...
+    // Read them straight from the buffer, and only parse the rest if someone asks for it.
+    const size_t kHeaderLen = 2 + 1 + sizeof(int64_t) + 1 + sizeof(int32_t);
+    const char* timestamp = buffer + 3;
+    const char* tagId = timestamp + sizeof(int64_t) + 1;
+    if (len >= kHeaderLen && buffer[0] == EVENT_TYPE_LIST && buffer[2] == EVENT_TYPE_LONG &&
+        tagId[-1] == EVENT_TYPE_INT) {
+        memcpy(&mElapsedTimestampNs, timestamp, sizeof(int64_t));
+        memcpy(&mTagId, tagId, sizeof(int32_t));
+        mUnparsedBuffer = buffer;
+        mUnparsedBufferLen = len;
+        return;
+    }
+
+    // Not the layout we expected. Let the parser make sense of it now.
+    android_log_context context = create_android_log_parser(buffer, len);
+    if (context) {
+        init(context);
+        android_log_destroy(&context);
+    }
+}
+
+void LogEvent::parseUnparsedBuffer() const {
+    const char* buffer = mUnparsedBuffer;
+    const size_t len = mUnparsedBufferLen;
+    mUnparsedBuffer = nullptr;
+    mUnparsedBufferLen = 0;
+
+    android_log_context context = create_android_log_parser(buffer, len);
+    if (context) {
+        // Besides the values, init() reads the timestamp and atom id again, to the same values.
+        const_cast<LogEvent*>(this)->init(context);
+        android_log_destroy(&context);
+    }
+}
+
 LogEvent::LogEvent(int32_t tagId, int64_t wallClockTimestampNs, int64_t elapsedTimestampNs) {
     mLogdTimestampNs = wallClockTimestampNs;
     mTagId = tagId;
@@ -62,6 +105,14 @@ LogEvent::LogEvent(int32_t tagId, int64_t timestampNs) {
     }
 }
 
+LogEvent::LogEvent(const LogEvent& event)
+    : mValues(event.getValues()),
+      mLogdTimestampNs(event.mLogdTimestampNs),
+      mElapsedTimestampNs(event.mElapsedTimestampNs),
+      mTagId(event.mTagId),
+      mLogUid(event.mLogUid) {
+}
+
 void LogEvent::init() {
     if (mContext) {
         const char* buffer;
@@ -275,7 +326,7 @@ void LogEvent::init(android_log_context context) {
 int64_t LogEvent::GetLong(size_t key, status_t* err) const {
     // TODO: encapsulate the magical operations all in Field struct as a static function.
     int field = getSimpleField(key);
-    for (const auto& value : mValues) {
+    for (const auto& value : getValues()) {
         if (value.mField.getField() == field) {
             if (value.mValue.getType() == LONG) {
                 return value.mValue.long_value;
@@ -297,7 +348,7 @@ int64_t LogEvent::GetLong(size_t key, status_t* err) const {
 
 int LogEvent::GetInt(size_t key, status_t* err) const {
     int field = getSimpleField(key);
-    for (const auto& value : mValues) {
+    for (const auto& value : getValues()) {
         if (value.mField.getField() == field) {
             if (value.mValue.getType() == INT) {
                 return value.mValue.int_value;
@@ -317,7 +368,7 @@ int LogEvent::GetInt(size_t key, status_t* err) const {
 
 const char* LogEvent::GetString(size_t key, status_t* err) const {
     int field = getSimpleField(key);
-    for (const auto& value : mValues) {
+    for (const auto& value : getValues()) {
         if (value.mField.getField() == field) {
             if (value.mValue.getType() == STRING) {
                 return value.mValue.str_value.c_str();
@@ -337,7 +388,7 @@ const char* LogEvent::GetString(size_t key, status_t* err) const {
 
 bool LogEvent::GetBool(size_t key, status_t* err) const {
     int field = getSimpleField(key);
-    for (const auto& value : mValues) {
+    for (const auto& value : getValues()) {
         if (value.mField.getField() == field) {
             if (value.mValue.getType() == INT) {
                 return value.mValue.int_value != 0;
@@ -359,7 +410,7 @@ bool LogEvent::GetBool(size_t key, status_t* err) const {
 
 float LogEvent::GetFloat(size_t key, status_t* err) const {
     int field = getSimpleField(key);
-    for (const auto& value : mValues) {
+    for (const auto& value : getValues()) {
         if (value.mField.getField() == field) {
             if (value.mValue.getType() == FLOAT) {
                 return value.mValue.float_value;
@@ -381,7 +432,7 @@ string LogEvent::ToString() const {
     string result;
     result += StringPrintf("{ %lld %lld (%d)", (long long)mLogdTimestampNs,
                            (long long)mElapsedTimestampNs, mTagId);
-    for (const auto& value : mValues) {
+    for (const auto& value : getValues()) {
         result +=
                 StringPrintf("%#x", value.mField.getField()) + "->" + value.mValue.toString() + " ";
     }
@@ -61,6 +61,14 @@ public:
      */
     explicit LogEvent(log_msg& msg);
 
+    /**
+     * Read a LogEvent from the payload of a statsd socket message, after the event tag, without
+     * copying it. Only the timestamp and the atom id are read up front. The values are parsed
+     * the first time they are read, so the buffer must stay valid until then, or until parse()
+     * is called. Atoms that nothing reads are never parsed.
+     */
+    explicit LogEvent(const char* buffer, size_t len, uint32_t uid, int64_t logdTimestampNs);
+
     /**
      * Constructs a LogEvent with synthetic data for testing. Must call init() before reading.
      */
@@ -69,6 +77,12 @@ public:
     // For testing. The timestamp is used as both elapsed real time and logd timestamp.
     explicit LogEvent(int32_t tagId, int64_t timestampNs);
 
+    /**
+     * Copies the parsed values of an event that has already been initialized. Don't copy on the
+     * hot path, it's slower; this is only for events that must outlive the socket buffer.
+     */
+    explicit LogEvent(const LogEvent& event);
+
     ~LogEvent();
 
     /**
@@ -142,32 +156,49 @@ public:
     }
 
     inline int size() const {
-        return mValues.size();
+        return getValues().size();
     }
 
     const std::vector<FieldValue>& getValues() const {
+        parse();
         return mValues;
     }
 
     std::vector<FieldValue>* getMutableValues() {
+        parse();
         return &mValues;
     }
 
-private:
     /**
-     * Don't copy, it's slower. If we really need this we can add it but let's try to
-     * avoid it.
+     * Parses the values of an event read without copying its buffer. Reading the values does
+     * this implicitly, but that isn't thread safe, so call it before sharing the event between
+     * threads.
      */
-    explicit LogEvent(const LogEvent&);
+    inline void parse() const {
+        if (mUnparsedBuffer != nullptr) {
+            parseUnparsedBuffer();
+        }
+    }
+
+    inline bool isParsed() const {
+        return mUnparsedBuffer == nullptr;
+    }
 
+private:
     /**
      * Parses a log_msg into a LogEvent object.
      */
     void init(android_log_context context);
 
+    void parseUnparsedBuffer() const;
+
     // The items are naturally sorted in DFS order as we read them. this allows us to do fast
-    // matching.
-    std::vector<FieldValue> mValues;
+    // matching. Mutable because they are parsed on first use for events read from a buffer.
+    mutable std::vector<FieldValue> mValues;
+
+    // The encoded values of an event that hasn't been parsed yet. Not owned.
+    mutable const char* mUnparsedBuffer = nullptr;
+    mutable size_t mUnparsedBufferLen = 0;
 
     // This field is used when statsD wants to create log event object and write fields to it. After
     // calling init() function, this object would be destroyed to save memory usage.
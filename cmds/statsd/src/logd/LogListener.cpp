@@ -36,6 +36,12 @@ LogListener::LogListener() {
 LogListener::~LogListener() {
 }
 
+void LogListener::OnLogEventBatch(const std::vector<std::unique_ptr<LogEvent>>& events) {
+    for (const auto& event : events) {
+        OnLogEvent(event.get(), false /*reconnectionStarts*/);
+    }
+}
+
 }  // namespace statsd
 }  // namespace os
 }  // namespace android
@@ -19,6 +19,7 @@
 #include "logd/LogEvent.h"
 
 #include <utils/RefBase.h>
+#include <memory>
 #include <vector>
 
 namespace android {
@@ -34,6 +35,12 @@ public:
     virtual ~LogListener();
 
     virtual void OnLogEvent(LogEvent* msg, bool reconnectionStarts) = 0;
+
+    /**
+     * Called with all the events that were read in one wakeup. The default implementation
+     * delivers them to OnLogEvent one at a time.
+     */
+    virtual void OnLogEventBatch(const std::vector<std::unique_ptr<LogEvent>>& events);
 };
 
 }  // namespace statsd
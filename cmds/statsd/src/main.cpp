@@ -39,6 +39,7 @@ using namespace android::os::statsd;
 
 const bool kUseLogd = false;
 const bool kUseStatsdSocket = true;
+const bool kBatchStatsdSocketReads = true;
 
 /**
  * Thread function data.
@@ -141,7 +142,8 @@ int main(int /*argc*/, char** /*argv*/) {
 
     gStatsService->Startup();
 
-    sp<StatsSocketListener> socketListener = new StatsSocketListener(gStatsService);
+    sp<StatsSocketListener> socketListener =
+            new StatsSocketListener(gStatsService, kBatchStatsdSocketReads);
 
     if (kUseLogd) {
         ALOGI("using logd");
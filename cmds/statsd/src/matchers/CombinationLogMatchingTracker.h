@@ -44,6 +44,10 @@ public:
                     const std::vector<sp<LogMatchingTracker>>& allTrackers,
                     std::vector<MatchingState>& matcherResults) override;
 
+    const std::vector<int>& getChildren() const override {
+        return mChildren;
+    }
+
 private:
     LogicalOperation mLogicalOperation;
 
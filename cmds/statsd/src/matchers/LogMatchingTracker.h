@@ -69,6 +69,13 @@ public:
         return mAtomIds;
     }
 
+    // Get the indices of the LogMatchingTrackers that this matcher evaluates when it processes an
+    // event. Only combination matchers have children.
+    virtual const std::vector<int>& getChildren() const {
+        static const std::vector<int> kNoChildren;
+        return kNoChildren;
+    }
+
     const int64_t& getId() const {
         return mId;
     }
@@ -32,7 +32,7 @@ using std::vector;
 SimpleLogMatchingTracker::SimpleLogMatchingTracker(const int64_t& id, const int index,
                                                    const SimpleAtomMatcher& matcher,
                                                    const UidMap& uidMap)
-    : LogMatchingTracker(id, index), mMatcher(matcher), mUidMap(uidMap) {
+    : LogMatchingTracker(id, index), mMatcher(compileAtomMatcher(matcher)), mUidMap(uidMap) {
     if (!matcher.has_atom_id()) {
         mInitialized = false;
     } else {
@@ -48,7 +48,8 @@ public:
                     std::vector<MatchingState>& matcherResults) override;
 
 private:
-    const SimpleAtomMatcher mMatcher;
+    // Compiled once here, so that events are matched without reading the config proto.
+    const CompiledAtomMatcher mMatcher;
     const UidMap& mUidMap;
 };
 
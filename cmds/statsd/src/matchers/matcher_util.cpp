@@ -82,24 +82,113 @@ bool combinationMatch(const vector<int>& children, const LogicalOperation& opera
     return matched;
 }
 
-bool tryMatchString(const UidMap& uidMap, const Field& field, const Value& value,
-                    const string& str_match) {
+static CompiledFieldValueMatcher compileFieldValueMatcher(const FieldValueMatcher& matcher) {
+    CompiledFieldValueMatcher compiled;
+    compiled.field = matcher.field();
+    compiled.hasPosition = matcher.has_position();
+    compiled.position = matcher.position();
+    compiled.valueMatcherCase = matcher.value_matcher_case();
+    compiled.boolValue = false;
+    compiled.intValue = 0;
+    compiled.floatValue = 0;
+    compiled.hasPackageNames = false;
+
+    auto addString = [&compiled](const string& str) {
+        compiled.strings.insert(str);
+        auto aidIt = UidMap::sAidToUidMapping.find(str);
+        if (aidIt != UidMap::sAidToUidMapping.end()) {
+            compiled.aidUids.insert(aidIt->second);
+        } else {
+            compiled.hasPackageNames = true;
+        }
+    };
+    switch (compiled.valueMatcherCase) {
+        case FieldValueMatcher::ValueMatcherCase::kEqBool:
+            compiled.boolValue = matcher.eq_bool();
+            break;
+        case FieldValueMatcher::ValueMatcherCase::kEqString:
+            addString(matcher.eq_string());
+            break;
+        case FieldValueMatcher::ValueMatcherCase::kEqAnyString:
+            for (const auto& str : matcher.eq_any_string().str_value()) {
+                addString(str);
+            }
+            break;
+        case FieldValueMatcher::ValueMatcherCase::kNeqAnyString:
+            for (const auto& str : matcher.neq_any_string().str_value()) {
+                addString(str);
+            }
+            break;
+        case FieldValueMatcher::ValueMatcherCase::kEqInt:
+            compiled.intValue = matcher.eq_int();
+            break;
+        case FieldValueMatcher::ValueMatcherCase::kLtInt:
+            compiled.intValue = matcher.lt_int();
+            break;
+        case FieldValueMatcher::ValueMatcherCase::kGtInt:
+            compiled.intValue = matcher.gt_int();
+            break;
+        case FieldValueMatcher::ValueMatcherCase::kLteInt:
+            compiled.intValue = matcher.lte_int();
+            break;
+        case FieldValueMatcher::ValueMatcherCase::kGteInt:
+            compiled.intValue = matcher.gte_int();
+            break;
+        case FieldValueMatcher::ValueMatcherCase::kLtFloat:
+            compiled.floatValue = matcher.lt_float();
+            break;
+        case FieldValueMatcher::ValueMatcherCase::kGtFloat:
+            compiled.floatValue = matcher.gt_float();
+            break;
+        case FieldValueMatcher::ValueMatcherCase::kMatchesTuple:
+            for (const auto& subMatcher : matcher.matches_tuple().field_value_matcher()) {
+                compiled.children.push_back(compileFieldValueMatcher(subMatcher));
+            }
+            break;
+        default:
+            break;
+    }
+    return compiled;
+}
+
+CompiledAtomMatcher compileAtomMatcher(const SimpleAtomMatcher& simpleMatcher) {
+    CompiledAtomMatcher compiled;
+    compiled.atomId = simpleMatcher.atom_id();
+    for (const auto& matcher : simpleMatcher.field_value_matcher()) {
+        compiled.fieldValueMatchers.push_back(compileFieldValueMatcher(matcher));
+    }
+    return compiled;
+}
+
+// Whether the value equals any of the strings of the matcher. Attribution uids are looked up in
+// the uid map once, however many strings there are.
+static bool matchesAnyString(const UidMap& uidMap, const CompiledFieldValueMatcher& matcher,
+                             const Field& field, const Value& value) {
     if (isAttributionUidField(field, value)) {
         int uid = value.int_value;
-        auto aidIt = UidMap::sAidToUidMapping.find(str_match);
-        if (aidIt != UidMap::sAidToUidMapping.end()) {
-            return ((int)aidIt->second) == uid;
+        if (matcher.aidUids.find(uid) != matcher.aidUids.end()) {
+            return true;
+        }
+        if (!matcher.hasPackageNames) {
+            return false;
         }
         std::set<string> packageNames = uidMap.getAppNamesFromUid(uid, true /* normalize*/);
-        return packageNames.find(str_match) != packageNames.end();
+        for (const string& packageName : packageNames) {
+            // Strings that name an AID only match by uid.
+            if (matcher.strings.find(packageName) != matcher.strings.end() &&
+                UidMap::sAidToUidMapping.find(packageName) == UidMap::sAidToUidMapping.end()) {
+                return true;
+            }
+        }
+        return false;
     } else if (value.getType() == STRING) {
-        return value.str_value == str_match;
+        return matcher.strings.find(value.str_value) != matcher.strings.end();
     }
     return false;
 }
 
-bool matchesSimple(const UidMap& uidMap, const FieldValueMatcher& matcher,
-                   const vector<FieldValue>& values, int start, int end, int depth) {
+static bool matchesSimple(const UidMap& uidMap, const CompiledFieldValueMatcher& matcher,
+                          const vector<FieldValue>& values, int start, int end, int depth) {
     if (depth > 2) {
         ALOGE("Depth > 3 not supported");
         return false;
@@ -116,12 +205,12 @@ bool matchesSimple(const UidMap& uidMap, const FieldValueMatcher& matcher,
     // break when pos is larger than the one we are searching for.
     for (int i = start; i < end; i++) {
         int pos = values[i].mField.getPosAtDepth(depth);
-        if (pos == matcher.field()) {
+        if (pos == matcher.field) {
             if (newStart == -1) {
                 newStart = i;
             }
             newEnd = i + 1;
-        } else if (pos > matcher.field()) {
+        } else if (pos > matcher.field) {
             break;
         }
     }
@@ -136,13 +225,13 @@ bool matchesSimple(const UidMap& uidMap, const FieldValueMatcher& matcher,
     }
 
     vector<pair<int, int>> ranges; // the ranges are for matching ANY position
-    if (matcher.has_position()) {
+    if (matcher.hasPosition) {
         // Repeated fields position is stored as a node in the path.
         depth++;
         if (depth > 2) {
             return false;
         }
-        switch (matcher.position()) {
+        switch (matcher.position) {
             case Position::FIRST: {
                 for (int i = start; i < end; i++) {
                     int pos = values[i].mField.getPosAtDepth(depth);
@@ -196,13 +285,13 @@ bool matchesSimple(const UidMap& uidMap, const FieldValueMatcher& matcher,
         ranges.push_back(std::make_pair(start, end));
     }
     // start and end are still pointing to the matched range.
-    switch (matcher.value_matcher_case()) {
+    switch (matcher.valueMatcherCase) {
         case FieldValueMatcher::kMatchesTuple: {
             ++depth;
             // If any range matches all matchers, good.
             for (const auto& range : ranges) {
                 bool matched = true;
-                for (const auto& subMatcher : matcher.matches_tuple().field_value_matcher()) {
+                for (const auto& subMatcher : matcher.children) {
                     if (!matchesSimple(uidMap, subMatcher, values, range.first, range.second,
                                        depth)) {
                         matched = false;
@@ -219,59 +308,40 @@ bool matchesSimple(const UidMap& uidMap, const FieldValueMatcher& matcher,
         case FieldValueMatcher::ValueMatcherCase::kEqBool: {
             for (int i = start; i < end; i++) {
                 if ((values[i].mValue.getType() == INT &&
-                     (values[i].mValue.int_value != 0) == matcher.eq_bool()) ||
+                     (values[i].mValue.int_value != 0) == matcher.boolValue) ||
                     (values[i].mValue.getType() == LONG &&
-                     (values[i].mValue.long_value != 0) == matcher.eq_bool())) {
+                     (values[i].mValue.long_value != 0) == matcher.boolValue)) {
                     return true;
                 }
             }
             return false;
         }
-        case FieldValueMatcher::ValueMatcherCase::kEqString: {
+        case FieldValueMatcher::ValueMatcherCase::kEqString:
+        case FieldValueMatcher::ValueMatcherCase::kEqAnyString: {
             for (int i = start; i < end; i++) {
-                if (tryMatchString(uidMap, values[i].mField, values[i].mValue,
-                                   matcher.eq_string())) {
+                if (matchesAnyString(uidMap, matcher, values[i].mField, values[i].mValue)) {
                     return true;
                 }
             }
             return false;
         }
         case FieldValueMatcher::ValueMatcherCase::kNeqAnyString: {
-            const auto& str_list = matcher.neq_any_string();
             for (int i = start; i < end; i++) {
-                bool notEqAll = true;
-                for (const auto& str : str_list.str_value()) {
-                    if (tryMatchString(uidMap, values[i].mField, values[i].mValue, str)) {
-                        notEqAll = false;
-                        break;
-                    }
-                }
-                if (notEqAll) {
+                if (!matchesAnyString(uidMap, matcher, values[i].mField, values[i].mValue)) {
                     return true;
                 }
             }
             return false;
         }
-        case FieldValueMatcher::ValueMatcherCase::kEqAnyString: {
-            const auto& str_list = matcher.eq_any_string();
-            for (int i = start; i < end; i++) {
-                for (const auto& str : str_list.str_value()) {
-                    if (tryMatchString(uidMap, values[i].mField, values[i].mValue, str)) {
-                        return true;
-                    }
-                }
-            }
-            return false;
-        }
         case FieldValueMatcher::ValueMatcherCase::kEqInt: {
             for (int i = start; i < end; i++) {
                 if (values[i].mValue.getType() == INT &&
-                    (matcher.eq_int() == values[i].mValue.int_value)) {
+                    (matcher.intValue == values[i].mValue.int_value)) {
                     return true;
                 }
                 // eq_int covers both int and long.
                 if (values[i].mValue.getType() == LONG &&
-                    (matcher.eq_int() == values[i].mValue.long_value)) {
+                    (matcher.intValue == values[i].mValue.long_value)) {
                     return true;
                 }
             }
@@ -280,12 +350,12 @@ bool matchesSimple(const UidMap& uidMap, const FieldValueMatcher& matcher,
         case FieldValueMatcher::ValueMatcherCase::kLtInt: {
             for (int i = start; i < end; i++) {
                 if (values[i].mValue.getType() == INT &&
-                    (values[i].mValue.int_value < matcher.lt_int())) {
+                    (values[i].mValue.int_value < matcher.intValue)) {
                     return true;
                 }
                 // lt_int covers both int and long.
                 if (values[i].mValue.getType() == LONG &&
-                    (values[i].mValue.long_value < matcher.lt_int())) {
+                    (values[i].mValue.long_value < matcher.intValue)) {
                     return true;
                 }
             }
@@ -294,12 +364,12 @@ bool matchesSimple(const UidMap& uidMap, const FieldValueMatcher& matcher,
         case FieldValueMatcher::ValueMatcherCase::kGtInt: {
             for (int i = start; i < end; i++) {
                 if (values[i].mValue.getType() == INT &&
-                    (values[i].mValue.int_value > matcher.gt_int())) {
+                    (values[i].mValue.int_value > matcher.intValue)) {
                     return true;
                 }
                 // gt_int covers both int and long.
                 if (values[i].mValue.getType() == LONG &&
-                    (values[i].mValue.long_value > matcher.gt_int())) {
+                    (values[i].mValue.long_value > matcher.intValue)) {
                     return true;
                 }
             }
@@ -308,7 +378,7 @@ bool matchesSimple(const UidMap& uidMap, const FieldValueMatcher& matcher,
         case FieldValueMatcher::ValueMatcherCase::kLtFloat: {
             for (int i = start; i < end; i++) {
                 if (values[i].mValue.getType() == FLOAT &&
-                    (values[i].mValue.float_value < matcher.lt_float())) {
+                    (values[i].mValue.float_value < matcher.floatValue)) {
                     return true;
                 }
             }
@@ -317,7 +387,7 @@ bool matchesSimple(const UidMap& uidMap, const FieldValueMatcher& matcher,
         case FieldValueMatcher::ValueMatcherCase::kGtFloat: {
             for (int i = start; i < end; i++) {
                 if (values[i].mValue.getType() == FLOAT &&
-                    (values[i].mValue.float_value > matcher.gt_float())) {
+                    (values[i].mValue.float_value > matcher.floatValue)) {
                     return true;
                 }
             }
@@ -326,12 +396,12 @@ bool matchesSimple(const UidMap& uidMap, const FieldValueMatcher& matcher,
         case FieldValueMatcher::ValueMatcherCase::kLteInt: {
             for (int i = start; i < end; i++) {
                 if (values[i].mValue.getType() == INT &&
-                    (values[i].mValue.int_value <= matcher.lte_int())) {
+                    (values[i].mValue.int_value <= matcher.intValue)) {
                     return true;
                 }
                 // lte_int covers both int and long.
                 if (values[i].mValue.getType() == LONG &&
-                    (values[i].mValue.long_value <= matcher.lte_int())) {
+                    (values[i].mValue.long_value <= matcher.intValue)) {
                     return true;
                 }
             }
@@ -340,12 +410,12 @@ bool matchesSimple(const UidMap& uidMap, const FieldValueMatcher& matcher,
         case FieldValueMatcher::ValueMatcherCase::kGteInt: {
             for (int i = start; i < end; i++) {
                 if (values[i].mValue.getType() == INT &&
-                    (values[i].mValue.int_value >= matcher.gte_int())) {
+                    (values[i].mValue.int_value >= matcher.intValue)) {
                     return true;
                 }
                 // gte_int covers both int and long.
                 if (values[i].mValue.getType() == LONG &&
-                    (values[i].mValue.long_value >= matcher.gte_int())) {
+                    (values[i].mValue.long_value >= matcher.intValue)) {
                     return true;
                 }
             }
@@ -356,19 +426,25 @@ bool matchesSimple(const UidMap& uidMap, const FieldValueMatcher& matcher,
     }
 }
 
-bool matchesSimple(const UidMap& uidMap, const SimpleAtomMatcher& simpleMatcher,
+bool matchesSimple(const UidMap& uidMap, const CompiledAtomMatcher& matcher,
                    const LogEvent& event) {
-    if (simpleMatcher.field_value_matcher_size() <= 0) {
-        return event.GetTagId() == simpleMatcher.atom_id();
+    if (matcher.fieldValueMatchers.empty()) {
+        return event.GetTagId() == matcher.atomId;
     }
-    for (const auto& matcher : simpleMatcher.field_value_matcher()) {
-        if (!matchesSimple(uidMap, matcher, event.getValues(), 0, event.getValues().size(), 0)) {
+    for (const auto& fieldValueMatcher : matcher.fieldValueMatchers) {
+        if (!matchesSimple(uidMap, fieldValueMatcher, event.getValues(), 0,
+                           event.getValues().size(), 0)) {
             return false;
         }
     }
     return true;
 }
 
+bool matchesSimple(const UidMap& uidMap, const SimpleAtomMatcher& simpleMatcher,
+                   const LogEvent& event) {
+    return matchesSimple(uidMap, compileAtomMatcher(simpleMatcher), event);
+}
+
 }  // namespace statsd
 }  // namespace os
 }  // namespace android
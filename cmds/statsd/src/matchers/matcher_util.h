@@ -23,6 +23,7 @@
 #include <set>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include "frameworks/base/cmds/statsd/src/statsd_config.pb.h"
 #include "packages/UidMap.h"
@@ -41,6 +42,45 @@ enum MatchingState {
 bool combinationMatch(const std::vector<int>& children, const LogicalOperation& operation,
                       const std::vector<MatchingState>& matcherResults);
 
+// A FieldValueMatcher with everything that doesn't depend on the event worked out when the
+// config is loaded, so that matching an event doesn't read any protobuf object.
+struct CompiledFieldValueMatcher {
+    int32_t field;
+
+    bool hasPosition;
+    Position position;
+
+    FieldValueMatcher::ValueMatcherCase valueMatcherCase;
+
+    // The operand of the eq_bool, eq_int, lt_int, ... value matchers.
+    bool boolValue;
+    int64_t intValue;
+    float floatValue;
+
+    // The strings of eq_string, eq_any_string and neq_any_string. When the matched value is an
+    // attribution uid, the strings that name an AID match by uid, and the rest match by the
+    // package names of the uid.
+    std::unordered_set<std::string> strings;
+    std::unordered_set<int32_t> aidUids;
+    // Whether any of the strings is not an AID, so package names need to be looked up.
+    bool hasPackageNames;
+
+    // The compiled matches_tuple.
+    std::vector<CompiledFieldValueMatcher> children;
+};
+
+struct CompiledAtomMatcher {
+    int32_t atomId;
+    std::vector<CompiledFieldValueMatcher> fieldValueMatchers;
+};
+
+CompiledAtomMatcher compileAtomMatcher(const SimpleAtomMatcher& simpleMatcher);
+
+bool matchesSimple(const UidMap& uidMap, const CompiledAtomMatcher& matcher,
+                   const LogEvent& event);
+
+// Compiles the matcher for this one event. Use the CompiledAtomMatcher overload for matchers
+// that are evaluated repeatedly.
 bool matchesSimple(const UidMap& uidMap,
     const SimpleAtomMatcher& simpleMatcher, const LogEvent& wrapper);
 
@@ -344,7 +344,7 @@ void CountMetricProducer::flushCurrentBucketLocked(const int64_t& eventTimeNs) {
             for (auto& tracker : mAnomalyTrackers) {
                 tracker->addPastBucket(mCurrentFullCounters, mCurrentBucketNum);
             }
-            mCurrentFullCounters = std::make_shared<DimToValMap>();
+            mCurrentFullCounters->clear();
         } else {
             // Skip aggregating the partial buckets since there's no previous partial bucket.
             for (auto& tracker : mAnomalyTrackers) {
@@ -359,8 +359,8 @@ void CountMetricProducer::flushCurrentBucketLocked(const int64_t& eventTimeNs) {
     }
 
     // Only resets the counters, but doesn't setup the times nor numbers.
-    // (Do not clear since the old one is still referenced in mAnomalyTrackers).
-    mCurrentSlicedCounter = std::make_shared<DimToValMap>();
+    // The anomaly trackers copy the values, so the map can be reused.
+    mCurrentSlicedCounter->clear();
 }
 
 // Rough estimate of CountMetricProducer buffer stored. This number will be
@@ -18,9 +18,12 @@
 #include "Log.h"
 
 #include "EventMetricProducer.h"
+#include "guardrail/StatsdStats.h"
 #include "stats_util.h"
 #include "stats_log_util.h"
+#include "storage/StorageManager.h"
 
+#include <atomic>
 #include <limits.h>
 #include <stdlib.h>
 
@@ -51,11 +54,16 @@ const int FIELD_ID_ELAPSED_TIMESTAMP_NANOS = 1;
 const int FIELD_ID_ATOMS = 2;
 const int FIELD_ID_WALL_CLOCK_TIMESTAMP_NANOS = 3;
 
+// Spill ids only need to be unique while statsd runs. Chunks left from before a restart are
+// deleted at startup.
+static std::atomic<int64_t> sNextSpillId(0);
+
 EventMetricProducer::EventMetricProducer(const ConfigKey& key, const EventMetric& metric,
                                          const int conditionIndex,
                                          const sp<ConditionWizard>& wizard,
                                          const int64_t startTimeNs)
-    : MetricProducer(metric.id(), key, startTimeNs, conditionIndex, wizard) {
+    : MetricProducer(metric.id(), key, startTimeNs, conditionIndex, wizard),
+      mSpillId(sNextSpillId++) {
     if (metric.links().size() > 0) {
         for (const auto& link : metric.links()) {
             Metric2Condition mc;
@@ -73,10 +81,12 @@ EventMetricProducer::EventMetricProducer(const ConfigKey& key, const EventMetric
 
 EventMetricProducer::~EventMetricProducer() {
     VLOG("~EventMetricProducer() called");
+    clearSpilledLocked();
 }
 
 void EventMetricProducer::dropDataLocked(const int64_t dropTimeNs) {
     mProto->clear();
+    clearSpilledLocked();
 }
 
 void EventMetricProducer::onSlicedConditionMayChangeLocked(bool overallCondition,
@@ -102,24 +112,56 @@ std::unique_ptr<std::vector<uint8_t>> serializeProtoLocked(ProtoOutputStream& pr
 
 void EventMetricProducer::clearPastBucketsLocked(const int64_t dumpTimeNs) {
     mProto->clear();
+    clearSpilledLocked();
+}
+
+void EventMetricProducer::spillLocked() {
+    // bytesWritten() is never less than the serialized size, and is cheap to get.
+    if (mSpilledBytes + mProto->bytesWritten() > StatsdStats::kMaxSpilledBytesPerMetric) {
+        return;
+    }
+    std::unique_ptr<std::vector<uint8_t>> buffer = serializeProtoLocked(*mProto);
+    if (StorageManager::appendEventMetricChunk(mConfigKey, mMetricId, mSpillId, *buffer)) {
+        mSpilledBytes += buffer->size();
+        mProto->clear();
+    }
+}
+
+void EventMetricProducer::clearSpilledLocked() {
+    if (mSpilledBytes > 0) {
+        StorageManager::deleteEventMetricChunks(mConfigKey, mMetricId, mSpillId);
+        mSpilledBytes = 0;
+    }
 }
 
 void EventMetricProducer::onDumpReportLocked(const int64_t dumpTimeNs,
                                              const bool include_current_partial_bucket,
                                              std::set<string> *str_set,
                                              ProtoOutputStream* protoOutput) {
-    if (mProto->size() <= 0) {
+    if (mProto->size() <= 0 && mSpilledBytes == 0) {
         return;
     }
     protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_ID, (long long)mMetricId);
 
     size_t bufferSize = mProto->size();
-    VLOG("metric %lld dump report now... proto size: %zu ",
-        (long long)mMetricId, bufferSize);
-    std::unique_ptr<std::vector<uint8_t>> buffer = serializeProtoLocked(*mProto);
-
-    protoOutput->write(FIELD_TYPE_MESSAGE | FIELD_ID_EVENT_METRICS,
-                       reinterpret_cast<char*>(buffer.get()->data()), buffer.get()->size());
+    VLOG("metric %lld dump report now... proto size: %zu spilled: %zu",
+        (long long)mMetricId, bufferSize, mSpilledBytes);
+
+    // A message field that appears more than once is parsed as the merge of all its occurrences,
+    // and merging concatenates the repeated data. So each chunk goes out as it is, instead of
+    // being joined into one EventMetricDataWrapper first.
+    if (mSpilledBytes > 0) {
+        StorageManager::readEventMetricChunks(
+                mConfigKey, mMetricId, mSpillId, [protoOutput](const char* chunk, size_t size) {
+                    protoOutput->write(FIELD_TYPE_MESSAGE | FIELD_ID_EVENT_METRICS, chunk, size);
+                });
+        clearSpilledLocked();
+    }
+    if (bufferSize > 0) {
+        std::unique_ptr<std::vector<uint8_t>> buffer = serializeProtoLocked(*mProto);
+        protoOutput->write(FIELD_TYPE_MESSAGE | FIELD_ID_EVENT_METRICS,
+                           reinterpret_cast<char*>(buffer.get()->data()), buffer.get()->size());
+    }
 
     mProto->clear();
 }
@@ -159,12 +201,20 @@ void EventMetricProducer::onMatchedLogEventInternalLocked(
     event.ToProto(*mProto);
     mProto->end(eventToken);
     mProto->end(wrapperToken);
+
+    if (mProto->bytesWritten() >= StatsdStats::kEventMetricSpillChunkBytes) {
+        spillLocked();
+    }
 }
 
 size_t EventMetricProducer::byteSizeLocked() const {
     return mProto->bytesWritten();
 }
 
+size_t EventMetricProducer::spilledByteSizeLocked() const {
+    return mSpilledBytes;
+}
+
 }  // namespace statsd
 }  // namespace os
 }  // namespace android
@@ -20,6 +20,7 @@
 #include <unordered_map>
 
 #include <android/util/ProtoOutputStream.h>
+#include <gtest/gtest_prod.h>
 
 #include "../condition/ConditionTracker.h"
 #include "../matchers/matcher_util.h"
@@ -63,11 +64,31 @@ private:
     // Internal function to calculate the current used bytes.
     size_t byteSizeLocked() const override;
 
+    size_t spilledByteSizeLocked() const override;
+
+    // Moves the events in mProto to disk. Leaves them in memory if the metric already has
+    // kMaxSpilledBytesPerMetric on disk or the write fails.
+    void spillLocked();
+
+    // Deletes the events that were moved to disk.
+    void clearSpilledLocked();
+
     void dumpStatesLocked(FILE* out, bool verbose) const override{};
 
     // Maps to a EventMetricDataWrapper. Storing atom events in ProtoOutputStream
     // is more space efficient than storing LogEvent.
     std::unique_ptr<android::util::ProtoOutputStream> mProto;
+
+    // Tells apart the chunks of this producer from those of other producers of the same metric,
+    // e.g. the one replaced by a config update that is yet to be dumped.
+    const int64_t mSpillId;
+
+    // Bytes of serialized EventMetricDataWrapper this metric moved to disk since the last dump.
+    size_t mSpilledBytes = 0;
+
+    FRIEND_TEST(EventMetricProducerTest, TestSpilledEventsAreDumpedInOrder);
+    FRIEND_TEST(EventMetricProducerTest, TestSpilledEventsAreDeletedWithConfig);
+    FRIEND_TEST(EventMetricProducerTest, TestProducersOfSameMetricKeepOwnChunks);
 };
 
 }  // namespace statsd
@@ -535,7 +535,7 @@ void GaugeMetricProducer::flushCurrentBucketLocked(const int64_t& eventTimeNs) {
             for (auto& tracker : mAnomalyTrackers) {
                 tracker->addPastBucket(mCurrentSlicedBucketForAnomaly, mCurrentBucketNum);
             }
-            mCurrentSlicedBucketForAnomaly = std::make_shared<DimToValMap>();
+            mCurrentSlicedBucketForAnomaly->clear();
         }
     }
 
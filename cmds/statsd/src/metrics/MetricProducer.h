@@ -138,6 +138,12 @@ public:
         return byteSizeLocked();
     }
 
+    // Returns the bytes of this metric's data that were moved to disk. Does not change state.
+    size_t spilledByteSize() const {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return spilledByteSizeLocked();
+    }
+
     /* If alert is valid, adds an AnomalyTracker and returns it. If invalid, returns nullptr. */
     virtual sp<AnomalyTracker> addAnomalyTracker(const Alert &alert,
                                                  const sp<AlarmMonitor>& anomalyAlarmMonitor) {
@@ -187,6 +193,9 @@ protected:
                                     android::util::ProtoOutputStream* protoOutput) = 0;
     virtual void clearPastBucketsLocked(const int64_t dumpTimeNs) = 0;
     virtual size_t byteSizeLocked() const = 0;
+    virtual size_t spilledByteSizeLocked() const {
+        return 0;
+    }
     virtual void dumpStatesLocked(FILE* out, bool verbose) const = 0;
 
     /**
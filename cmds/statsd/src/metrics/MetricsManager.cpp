@@ -75,6 +75,7 @@ MetricsManager::MetricsManager(const ConfigKey& key, const StatsdConfig& config,
                              mTrackerToConditionMap, mNoReportMetricIds);
 
     mHashStringsInReport = config.hash_strings_in_metric_report();
+    mUidMapDeltaSnapshots = config.uid_map_delta_snapshots();
 
     if (config.allowed_log_source_size() == 0) {
         mConfigValid = false;
@@ -114,12 +115,80 @@ MetricsManager::MetricsManager(const ConfigKey& key, const StatsdConfig& config,
         ALOGE("This config has too many alerts! Reject!");
         mConfigValid = false;
     }
+    if (mConfigValid) {
+        initAtomDispatchMap();
+    }
     // no matter whether this config is valid, log it in the stats.
     StatsdStats::getInstance().noteConfigReceived(
             key, mAllMetricProducers.size(), mAllConditionTrackers.size(), mAllAtomMatchers.size(),
             mAllAnomalyTrackers.size(), mAnnotations, mConfigValid);
 }
 
+void MetricsManager::initAtomDispatchMap() {
+    mMatcherCache.assign(mAllAtomMatchers.size(), MatchingState::kNotComputed);
+    mConditionToBeEvaluated.assign(mAllConditionTrackers.size(), false);
+    mConditionCache.assign(mAllConditionTrackers.size(), ConditionState::kNotEvaluated);
+    mConditionChangedCache.assign(mAllConditionTrackers.size(), false);
+
+    for (const int tagId : mTagIds) {
+        // Mark the matchers that care about this atom and, transitively, their children.
+        vector<bool> matcherTouched(mAllAtomMatchers.size(), false);
+        vector<int> stack;
+        for (size_t i = 0; i < mAllAtomMatchers.size(); i++) {
+            const auto& atomIds = mAllAtomMatchers[i]->getAtomIds();
+            if (atomIds.find(tagId) != atomIds.end()) {
+                stack.push_back(i);
+            }
+        }
+        while (!stack.empty()) {
+            const int index = stack.back();
+            stack.pop_back();
+            if (matcherTouched[index]) {
+                continue;
+            }
+            matcherTouched[index] = true;
+            for (const int child : mAllAtomMatchers[index]->getChildren()) {
+                stack.push_back(child);
+            }
+        }
+
+        // Mark the conditions that use any of those matchers and, transitively, their children.
+        vector<bool> conditionTouched(mAllConditionTrackers.size(), false);
+        for (size_t i = 0; i < mAllAtomMatchers.size(); i++) {
+            if (!matcherTouched[i]) {
+                continue;
+            }
+            auto it = mTrackerToConditionMap.find(i);
+            if (it != mTrackerToConditionMap.end()) {
+                stack.insert(stack.end(), it->second.begin(), it->second.end());
+            }
+        }
+        while (!stack.empty()) {
+            const int index = stack.back();
+            stack.pop_back();
+            if (conditionTouched[index]) {
+                continue;
+            }
+            conditionTouched[index] = true;
+            for (const int child : mAllConditionTrackers[index]->getChildren()) {
+                stack.push_back(child);
+            }
+        }
+
+        AtomDispatchInfo& info = mAtomDispatchMap[tagId];
+        for (size_t i = 0; i < matcherTouched.size(); i++) {
+            if (matcherTouched[i]) {
+                info.matcherIndices.push_back(i);
+            }
+        }
+        for (size_t i = 0; i < conditionTouched.size(); i++) {
+            if (conditionTouched[i]) {
+                info.conditionIndices.push_back(i);
+            }
+        }
+    }
+}
+
 MetricsManager::~MetricsManager() {
     VLOG("~MetricsManager()");
 }
@@ -299,81 +368,89 @@ void MetricsManager::onLogEvent(const LogEvent& event) {
 
     int tagId = event.GetTagId();
     int64_t eventTime = event.GetElapsedTimestampNs();
-    if (mTagIds.find(tagId) == mTagIds.end()) {
+    auto dispatchIt = mAtomDispatchMap.find(tagId);
+    if (dispatchIt == mAtomDispatchMap.end()) {
         // not interesting...
         return;
     }
+    const vector<int>& matcherIndices = dispatchIt->second.matcherIndices;
+    const vector<int>& conditionIndices = dispatchIt->second.conditionIndices;
 
-    vector<MatchingState> matcherCache(mAllAtomMatchers.size(), MatchingState::kNotComputed);
-
-    for (auto& matcher : mAllAtomMatchers) {
-        matcher->onLogEvent(event, mAllAtomMatchers, matcherCache);
+    // Matchers that don't care about this atom would all be kNotMatched, and nothing reads them.
+    for (const int matcherIndex : matcherIndices) {
+        mAllAtomMatchers[matcherIndex]->onLogEvent(event, mAllAtomMatchers, mMatcherCache);
     }
 
-    // A bitmap to see which ConditionTracker needs to be re-evaluated.
-    vector<bool> conditionToBeEvaluated(mAllConditionTrackers.size(), false);
-
-    for (const auto& pair : mTrackerToConditionMap) {
-        if (matcherCache[pair.first] == MatchingState::kMatched) {
-            const auto& conditionList = pair.second;
-            for (const int conditionIndex : conditionList) {
-                conditionToBeEvaluated[conditionIndex] = true;
+    // Find out which ConditionTracker needs to be re-evaluated.
+    for (const int matcherIndex : matcherIndices) {
+        if (mMatcherCache[matcherIndex] == MatchingState::kMatched) {
+            auto pair = mTrackerToConditionMap.find(matcherIndex);
+            if (pair != mTrackerToConditionMap.end()) {
+                for (const int conditionIndex : pair->second) {
+                    mConditionToBeEvaluated[conditionIndex] = true;
+                }
             }
         }
     }
 
-    vector<ConditionState> conditionCache(mAllConditionTrackers.size(),
-                                          ConditionState::kNotEvaluated);
-    // A bitmap to track if a condition has changed value.
-    vector<bool> changedCache(mAllConditionTrackers.size(), false);
-    for (size_t i = 0; i < mAllConditionTrackers.size(); i++) {
-        if (conditionToBeEvaluated[i] == false) {
+    for (const int conditionIndex : conditionIndices) {
+        if (mConditionToBeEvaluated[conditionIndex] == false) {
             continue;
         }
-        sp<ConditionTracker>& condition = mAllConditionTrackers[i];
-        condition->evaluateCondition(event, matcherCache, mAllConditionTrackers, conditionCache,
-                                     changedCache);
+        sp<ConditionTracker>& condition = mAllConditionTrackers[conditionIndex];
+        condition->evaluateCondition(event, mMatcherCache, mAllConditionTrackers, mConditionCache,
+                                     mConditionChangedCache);
     }
 
-    for (size_t i = 0; i < mAllConditionTrackers.size(); i++) {
-        if (changedCache[i] == false) {
+    for (const int conditionIndex : conditionIndices) {
+        if (mConditionChangedCache[conditionIndex] == false) {
             continue;
         }
-        auto pair = mConditionToMetricMap.find(i);
+        auto pair = mConditionToMetricMap.find(conditionIndex);
         if (pair != mConditionToMetricMap.end()) {
             auto& metricList = pair->second;
             for (auto metricIndex : metricList) {
                 // metric cares about non sliced condition, and it's changed.
                 // Push the new condition to it directly.
                 if (!mAllMetricProducers[metricIndex]->isConditionSliced()) {
-                    mAllMetricProducers[metricIndex]->onConditionChanged(conditionCache[i],
-                                                                         eventTime);
+                    mAllMetricProducers[metricIndex]->onConditionChanged(
+                            mConditionCache[conditionIndex], eventTime);
                     // metric cares about sliced conditions, and it may have changed. Send
                     // notification, and the metric can query the sliced conditions that are
                     // interesting to it.
                 } else {
-                    mAllMetricProducers[metricIndex]->onSlicedConditionMayChange(conditionCache[i],
-                                                                                 eventTime);
+                    mAllMetricProducers[metricIndex]->onSlicedConditionMayChange(
+                            mConditionCache[conditionIndex], eventTime);
                 }
             }
         }
     }
 
     // For matched AtomMatchers, tell relevant metrics that a matched event has come.
-    for (size_t i = 0; i < mAllAtomMatchers.size(); i++) {
-        if (matcherCache[i] == MatchingState::kMatched) {
+    for (const int matcherIndex : matcherIndices) {
+        if (mMatcherCache[matcherIndex] == MatchingState::kMatched) {
             StatsdStats::getInstance().noteMatcherMatched(mConfigKey,
-                                                          mAllAtomMatchers[i]->getId());
-            auto pair = mTrackerToMetricMap.find(i);
+                                                          mAllAtomMatchers[matcherIndex]->getId());
+            auto pair = mTrackerToMetricMap.find(matcherIndex);
             if (pair != mTrackerToMetricMap.end()) {
                 auto& metricList = pair->second;
                 for (const int metricIndex : metricList) {
                     // pushed metrics are never scheduled pulls
-                    mAllMetricProducers[metricIndex]->onMatchedLogEvent(i, event);
+                    mAllMetricProducers[metricIndex]->onMatchedLogEvent(matcherIndex, event);
                 }
             }
         }
     }
+
+    // Only the entries of this atom's trackers can have been written, so reset just those.
+    for (const int matcherIndex : matcherIndices) {
+        mMatcherCache[matcherIndex] = MatchingState::kNotComputed;
+    }
+    for (const int conditionIndex : conditionIndices) {
+        mConditionToBeEvaluated[conditionIndex] = false;
+        mConditionCache[conditionIndex] = ConditionState::kNotEvaluated;
+        mConditionChangedCache[conditionIndex] = false;
+    }
 }
 
 void MetricsManager::onAnomalyAlarmFired(
@@ -401,6 +478,15 @@ size_t MetricsManager::byteSize() {
     return totalSize;
 }
 
+// Returns the total byte size of the data that metrics of a single config moved to disk.
+size_t MetricsManager::spilledByteSize() {
+    size_t totalSize = 0;
+    for (auto metricProducer : mAllMetricProducers) {
+        totalSize += metricProducer->spilledByteSize();
+    }
+    return totalSize;
+}
+
 }  // namespace statsd
 }  // namespace os
 }  // namespace android
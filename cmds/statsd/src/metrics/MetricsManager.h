@@ -79,6 +79,12 @@ public:
 
     inline bool hashStringInReport() const {
         return mHashStringsInReport;
+    }
+
+    // The uid map snapshot in the last report of this config, which the next one is a delta of.
+    // Null if the config wants full snapshots.
+    inline int64_t* mutableLastUidMapSnapshotId() {
+        return mUidMapDeltaSnapshots ? &mLastUidMapSnapshotId : nullptr;
     };
 
     void refreshTtl(const int64_t currentTimestampNs) {
@@ -101,6 +107,11 @@ public:
         return mAllMetricProducers.size();
     }
 
+    // Ids of the atoms that any matcher of this config can match.
+    inline const std::set<int>& getTagIds() const {
+        return mTagIds;
+    }
+
     virtual void dropData(const int64_t dropTimeNs);
 
     virtual void onDumpReport(const int64_t dumpTimeNs,
@@ -112,6 +123,10 @@ public:
     // Does not change the state.
     virtual size_t byteSize();
 
+    // Computes the total byte size of the data its metrics moved to disk.
+    // Does not change the state.
+    virtual size_t spilledByteSize();
+
 private:
     // For test only.
     inline int64_t getTtlEndNs() const { return mTtlEndNs; }
@@ -124,6 +139,10 @@ private:
 
     bool mHashStringsInReport = false;
 
+    bool mUidMapDeltaSnapshots = false;
+
+    int64_t mLastUidMapSnapshotId = UidMap::kNoSnapshotId;
+
     const int64_t mTtlNs;
     int64_t mTtlEndNs;
 
@@ -193,8 +212,30 @@ private:
     // maps from ConditionTracker to MetricProducer
     std::unordered_map<int, std::vector<int>> mConditionToMetricMap;
 
+    // The matchers and conditions that can be touched by an event of one atom. Both lists are
+    // sorted so that they are visited in the same order as the full config.
+    struct AtomDispatchInfo {
+        // Matchers that may match the atom, plus the children they evaluate.
+        std::vector<int> matcherIndices;
+        // Conditions that use one of the matchers above, plus the children they evaluate.
+        std::vector<int> conditionIndices;
+    };
+
+    // 5th filter: maps from the atom id to the matchers and conditions that care about it, so
+    // that an event only pays for the trackers relevant to its atom.
+    std::unordered_map<int, AtomDispatchInfo> mAtomDispatchMap;
+
+    // Scratch state for onLogEvent(), reused across events. Between events every entry holds
+    // its default value; onLogEvent() only resets the entries it touched.
+    std::vector<MatchingState> mMatcherCache;
+    std::vector<bool> mConditionToBeEvaluated;
+    std::vector<ConditionState> mConditionCache;
+    std::vector<bool> mConditionChangedCache;
+
     void initLogSourceWhiteList();
 
+    void initAtomDispatchMap();
+
     // The metrics that don't need to be uploaded or even reported.
     std::set<int64_t> mNoReportMetricIds;
 
@@ -228,6 +269,7 @@ private:
 
     FRIEND_TEST(AlarmE2eTest, TestMultipleAlarms);
     FRIEND_TEST(ConfigTtlE2eTest, TestCountMetric);
+    FRIEND_TEST(MetricsManagerTest, TestAtomDispatchMap);
 };
 
 }  // namespace statsd
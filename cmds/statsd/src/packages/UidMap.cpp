@@ -51,6 +51,8 @@ const int FIELD_ID_SNAPSHOT_PACKAGE_DELETED = 4;
 const int FIELD_ID_SNAPSHOT_PACKAGE_NAME_HASH = 5;
 const int FIELD_ID_SNAPSHOT_TIMESTAMP = 1;
 const int FIELD_ID_SNAPSHOT_PACKAGE_INFO = 2;
+const int FIELD_ID_SNAPSHOT_ID = 3;
+const int FIELD_ID_SNAPSHOT_BASE_ID = 4;
 const int FIELD_ID_SNAPSHOTS = 1;
 const int FIELD_ID_CHANGES = 2;
 const int FIELD_ID_CHANGE_DELETION = 1;
@@ -118,10 +120,12 @@ void UidMap::updateMap(const int64_t& timestamp, const vector<int32_t>& uid,
             }
         }
 
+        // The new map replaces the old one, so the next snapshot of every config is a full one.
+        mFullSnapshotId = ++mSnapshotId;
         mMap.clear();
         for (size_t j = 0; j < uid.size(); j++) {
             string package = string(String8(packageName[j]).string());
-            mMap[std::make_pair(uid[j], package)] = AppData(versionCode[j]);
+            mMap[std::make_pair(uid[j], package)] = AppData(versionCode[j], mSnapshotId);
         }
 
         for (const auto& kv : deletedApps) {
@@ -157,16 +161,18 @@ void UidMap::updateApp(const int64_t& timestamp, const String16& app_16, const i
         lock_guard<mutex> lock(mMutex);
         int32_t prevVersion = 0;
         bool found = false;
+        mSnapshotId++;
         auto it = mMap.find(std::make_pair(uid, appName));
         if (it != mMap.end()) {
             found = true;
             prevVersion = it->second.versionCode;
             it->second.versionCode = versionCode;
             it->second.deleted = false;
+            it->second.snapshotId = mSnapshotId;
         }
         if (!found) {
             // Otherwise, we need to add an app at this uid.
-            mMap[std::make_pair(uid, appName)] = AppData(versionCode);
+            mMap[std::make_pair(uid, appName)] = AppData(versionCode, mSnapshotId);
         } else {
             // Only notify the listeners if this is an app upgrade. If this app is being installed
             // for the first time, then we don't notify the listeners.
@@ -231,13 +237,15 @@ void UidMap::removeApp(const int64_t& timestamp, const String16& app_16, const i
         if (it != mMap.end() && !it->second.deleted) {
             prevVersion = it->second.versionCode;
             it->second.deleted = true;
+            it->second.snapshotId = ++mSnapshotId;
             mDeletedApps.push_back(key);
         }
         if (mDeletedApps.size() > StatsdStats::kMaxDeletedAppsInUidMap) {
-            // Delete the oldest one.
+            // Delete the oldest one. A delta can't express that, so send full snapshots again.
             auto oldest = mDeletedApps.front();
             mDeletedApps.pop_front();
             mMap.erase(oldest);
+            mFullSnapshotId = ++mSnapshotId;
             StatsdStats::getInstance().noteUidMapAppDeletionDropped();
         }
         mChanges.emplace_back(true, timestamp, app, uid, 0, prevVersion);
@@ -293,6 +301,9 @@ int UidMap::getHostUidOrSelf(int uid) const {
 
 void UidMap::clearOutput() {
     mChanges.clear();
+    // Deltas can't be told from the changes that were cleared, so every config gets a full
+    // snapshot next.
+    mFullSnapshotId = ++mSnapshotId;
     // Also update the guardrail trackers.
     StatsdStats::getInstance().setUidMapChanges(0);
     mBytesUsed = 0;
@@ -316,7 +327,8 @@ size_t UidMap::getBytesUsed() const {
 }
 
 void UidMap::appendUidMap(const int64_t& timestamp, const ConfigKey& key,
-                          std::set<string> *str_set, ProtoOutputStream* proto) {
+                          std::set<string> *str_set, int64_t* lastSnapshotId,
+                          ProtoOutputStream* proto) {
     lock_guard<mutex> lock(mMutex);  // Lock for updates
 
     for (const ChangeRecord& record : mChanges) {
@@ -342,11 +354,22 @@ void UidMap::appendUidMap(const int64_t& timestamp, const ConfigKey& key,
         }
     }
 
-    // Write snapshot from current uid map state.
+    // Write snapshot from current uid map state. A delta snapshot leaves out the apps that are
+    // unchanged since the snapshot in the previous output for this config.
+    const bool writeDelta = lastSnapshotId != nullptr && *lastSnapshotId != kNoSnapshotId &&
+                            *lastSnapshotId >= mFullSnapshotId;
+    const int64_t baseSnapshotId = writeDelta ? *lastSnapshotId : 0;
     uint64_t snapshotsToken =
             proto->start(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | FIELD_ID_SNAPSHOTS);
     proto->write(FIELD_TYPE_INT64 | FIELD_ID_SNAPSHOT_TIMESTAMP, (long long)timestamp);
+    proto->write(FIELD_TYPE_INT64 | FIELD_ID_SNAPSHOT_ID, (long long)mSnapshotId);
+    if (writeDelta) {
+        proto->write(FIELD_TYPE_INT64 | FIELD_ID_SNAPSHOT_BASE_ID, (long long)baseSnapshotId);
+    }
     for (const auto& kv : mMap) {
+        if (writeDelta && kv.second.snapshotId <= baseSnapshotId) {
+            continue;
+        }
         uint64_t token = proto->start(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED |
                                       FIELD_ID_SNAPSHOT_PACKAGE_INFO);
 
@@ -365,6 +388,9 @@ void UidMap::appendUidMap(const int64_t& timestamp, const ConfigKey& key,
         proto->end(token);
     }
     proto->end(snapshotsToken);
+    if (lastSnapshotId != nullptr) {
+        *lastSnapshotId = mSnapshotId;
+    }
 
     int64_t prevMin = getMinimumTimestampNs();
     mLastUpdatePerConfigKey[key] = timestamp;
@@ -398,10 +424,12 @@ void UidMap::printUidMap(FILE* out) const {
 }
 
 void UidMap::OnConfigUpdated(const ConfigKey& key) {
+    lock_guard<mutex> lock(mMutex);
     mLastUpdatePerConfigKey[key] = -1;
 }
 
 void UidMap::OnConfigRemoved(const ConfigKey& key) {
+    lock_guard<mutex> lock(mMutex);
     mLastUpdatePerConfigKey.erase(key);
 }
 
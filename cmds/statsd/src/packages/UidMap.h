@@ -45,11 +45,14 @@ namespace statsd {
 struct AppData {
     int64_t versionCode;
     bool deleted;
+    // The first uid map snapshot in which the app is in its current state.
+    int64_t snapshotId;
 
     // Empty constructor needed for unordered map.
     AppData() {
     }
-    AppData(const int64_t v) : versionCode(v), deleted(false){};
+    AppData(const int64_t v, const int64_t snapshot)
+        : versionCode(v), deleted(false), snapshotId(snapshot){};
 };
 
 // When calling appendUidMap, we retrieve all the ChangeRecords since the last
@@ -126,9 +129,16 @@ public:
 
     // Gets all snapshots and changes that have occurred since the last output.
     // If every config key has received a change or snapshot record, then this
-    // record is deleted.
+    // record is deleted. If lastSnapshotId is given, the snapshot only lists the apps that changed
+    // since that snapshot, when there is one, and lastSnapshotId is set to the snapshot written.
+    // The caller keeps it with the config instance, so an updated config starts over with a full
+    // snapshot.
     void appendUidMap(const int64_t& timestamp, const ConfigKey& key,
-                      std::set<string> *str_set, util::ProtoOutputStream* proto);
+                      std::set<string> *str_set, int64_t* lastSnapshotId,
+                      util::ProtoOutputStream* proto);
+
+    // The lastSnapshotId of a config that hasn't received a snapshot yet.
+    static const int64_t kNoSnapshotId = -1;
 
     // Forces the output to be cleared. We still generate a snapshot based on the current state.
     // This results in extra data uploaded but helps us reconstruct the uid mapping on the server
@@ -177,6 +187,13 @@ private:
     // Value of -1 denotes this config key has never received an upload.
     std::unordered_map<ConfigKey, int64_t> mLastUpdatePerConfigKey;
 
+    // Identifies the current state of mMap. Bumped by every change to it.
+    int64_t mSnapshotId = 0;
+
+    // Apps were dropped from mMap when this snapshot was taken, so a delta against an earlier
+    // snapshot can't express the current state.
+    int64_t mFullSnapshotId = 0;
+
     // Returns the minimum value from mConfigKeys.
     int64_t getMinimumTimestampNs();
 
@@ -199,6 +216,7 @@ private:
     FRIEND_TEST(UidMapTest, TestOutputIncludesAtLeastOneSnapshot);
     FRIEND_TEST(UidMapTest, TestMemoryComputed);
     FRIEND_TEST(UidMapTest, TestMemoryGuardrail);
+    FRIEND_TEST(UidMapTest, TestDeltaSnapshots);
 };
 
 }  // namespace statsd
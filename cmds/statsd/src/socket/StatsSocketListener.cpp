@@ -29,7 +29,9 @@
 #include <cutils/sockets.h>
 #include <private/android_filesystem_config.h>
 #include <private/android_logger.h>
+#include <memory>
 #include <unordered_map>
+#include <vector>
 
 #include "StatsSocketListener.h"
 #include "guardrail/StatsdStats.h"
@@ -39,10 +41,10 @@ namespace android {
 namespace os {
 namespace statsd {
 
-static const int kLogMsgHeaderSize = 28;
-
-StatsSocketListener::StatsSocketListener(const sp<LogListener>& listener)
-    : SocketListener(getLogSocket(), false /*start listen*/), mListener(listener) {
+StatsSocketListener::StatsSocketListener(const sp<LogListener>& listener, bool batchReads)
+    : SocketListener(getLogSocket(), false /*start listen*/),
+      mListener(listener),
+      mBatchSize(batchReads ? kMaxBatchSize : 1) {
 }
 
 StatsSocketListener::~StatsSocketListener() {
@@ -55,15 +57,13 @@ bool StatsSocketListener::onDataAvailable(SocketClient* cli) {
         name_set = true;
     }
 
-    // + 1 to ensure null terminator if MAX_PAYLOAD buffer is received
-    char buffer[sizeof_log_id_t + sizeof(uint16_t) + sizeof(log_time) + LOGGER_ENTRY_MAX_PAYLOAD +
-                1];
-    struct iovec iov = {buffer, sizeof(buffer) - 1};
-
-    alignas(4) char control[CMSG_SPACE(sizeof(struct ucred))];
-    struct msghdr hdr = {
-            NULL, 0, &iov, 1, control, sizeof(control), 0,
-    };
+    for (int i = 0; i < mBatchSize; i++) {
+        mIovecs[i] = {mBuffers[i], kBufferSize - 1};
+        mMsgs[i].msg_hdr = {
+                NULL, 0, &mIovecs[i], 1, mControls[i], sizeof(mControls[i]), 0,
+        };
+        mMsgs[i].msg_len = 0;
+    }
 
     int socket = cli->getSocket();
 
@@ -71,47 +71,69 @@ bool StatsSocketListener::onDataAvailable(SocketClient* cli) {
     // overhead under logging load. We are safe because we check counts, but
     // still need to clear null terminator
     // memset(buffer, 0, sizeof(buffer));
-    ssize_t n = recvmsg(socket, &hdr, 0);
-    if (n <= (ssize_t)(sizeof(android_log_header_t))) {
+    //
+    // We are only called once the socket is readable, so the first datagram is always there.
+    // MSG_DONTWAIT makes recvmmsg return as soon as the queued datagrams are drained instead of
+    // waiting for the whole batch to fill up.
+    int received = recvmmsg(socket, mMsgs, mBatchSize, MSG_DONTWAIT, nullptr);
+    if (received <= 0) {
         return false;
     }
 
-    buffer[n] = 0;
+    // Parse everything before handing the events over, so that the processor lock is only
+    // taken once per batch and never while decoding.
+    std::vector<std::unique_ptr<LogEvent>> events;
+    events.reserve(received);
+    for (int i = 0; i < received; i++) {
+        ssize_t n = mMsgs[i].msg_len;
+        if (n <= (ssize_t)(sizeof(android_log_header_t))) {
+            continue;
+        }
 
-    struct ucred* cred = NULL;
+        char* buffer = mBuffers[i];
+        buffer[n] = 0;
 
-    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr);
-    while (cmsg != NULL) {
-        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_CREDENTIALS) {
-            cred = (struct ucred*)CMSG_DATA(cmsg);
-            break;
+        struct ucred* cred = NULL;
+
+        struct msghdr* hdr = &mMsgs[i].msg_hdr;
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(hdr);
+        while (cmsg != NULL) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_CREDENTIALS) {
+                cred = (struct ucred*)CMSG_DATA(cmsg);
+                break;
+            }
+            cmsg = CMSG_NXTHDR(hdr, cmsg);
         }
-        cmsg = CMSG_NXTHDR(&hdr, cmsg);
-    }
 
-    struct ucred fake_cred;
-    if (cred == NULL) {
-        cred = &fake_cred;
-        cred->pid = 0;
-        cred->uid = DEFAULT_OVERFLOWUID;
-    }
+        struct ucred fake_cred;
+        if (cred == NULL) {
+            cred = &fake_cred;
+            cred->pid = 0;
+            cred->uid = DEFAULT_OVERFLOWUID;
+        }
 
-    char* ptr = ((char*)buffer) + sizeof(android_log_header_t);
-    n -= sizeof(android_log_header_t);
+        char* ptr = buffer + sizeof(android_log_header_t);
+        n -= sizeof(android_log_header_t);
 
-    log_msg msg;
+        // Skip the event tag shared by all stats logs. The events point into mBuffers, which
+        // are only reused by the next read, after the listener is done with this batch.
+        if (n <= (ssize_t)sizeof(uint32_t)) {
+            continue;
+        }
+        events.push_back(std::make_unique<LogEvent>(ptr + sizeof(uint32_t), n - sizeof(uint32_t),
+                                                    cred->uid, time(nullptr) * NS_PER_SEC));
+    }
 
-    msg.entry.len = n;
-    msg.entry.hdr_size = kLogMsgHeaderSize;
-    msg.entry.sec = time(nullptr);
-    msg.entry.pid = cred->pid;
-    msg.entry.uid = cred->uid;
+    if (events.empty()) {
+        return false;
+    }
 
-    memcpy(msg.buf + kLogMsgHeaderSize, ptr, n + 1);
-    LogEvent event(msg);
+    if (mBatchSize > 1) {
+        StatsdStats::getInstance().noteLogEventBatch(events.size());
+    }
 
     // Call the listener
-    mListener->OnLogEvent(&event, false /*reconnected, N/A in statsd socket*/);
+    mListener->OnLogEventBatch(events);
 
     return true;
 }
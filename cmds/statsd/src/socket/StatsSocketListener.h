@@ -15,10 +15,13 @@
  */
 #pragma once
 
+#include <sys/socket.h>
 #include <sysutils/SocketListener.h>
 #include <utils/RefBase.h>
 #include "logd/LogListener.h"
 
+#include <private/android_logger.h>
+
 // DEFAULT_OVERFLOWUID is defined in linux/highuid.h, which is not part of
 // the uapi headers for userspace to use.  This value is filled in on the
 // out-of-band socket credentials if the OS fails to find one available.
@@ -35,19 +38,40 @@ namespace statsd {
 
 class StatsSocketListener : public SocketListener, public virtual android::RefBase {
 public:
-    StatsSocketListener(const sp<LogListener>& listener);
+    /**
+     * When batchReads is true, every wakeup drains up to kMaxBatchSize datagrams with one
+     * recvmmsg call and hands the parsed events to the listener as a single batch.
+     */
+    StatsSocketListener(const sp<LogListener>& listener, bool batchReads = true);
 
     virtual ~StatsSocketListener();
 
+    // Max number of datagrams read from the socket in one wakeup.
+    static const int kMaxBatchSize = 32;
+
 protected:
     virtual bool onDataAvailable(SocketClient* cli);
 
 private:
     static int getLogSocket();
+
+    // + 1 to ensure null terminator if MAX_PAYLOAD buffer is received
+    static const size_t kBufferSize =
+            sizeof_log_id_t + sizeof(uint16_t) + sizeof(log_time) + LOGGER_ENTRY_MAX_PAYLOAD + 1;
+
     /**
      * Who is going to get the events when they're read.
      */
     sp<LogListener> mListener;
+
+    // Number of datagrams to read per wakeup. Either 1 or kMaxBatchSize.
+    const int mBatchSize;
+
+    // Receive buffers, only touched by the listener thread.
+    char mBuffers[kMaxBatchSize][kBufferSize];
+    alignas(struct cmsghdr) char mControls[kMaxBatchSize][CMSG_SPACE(sizeof(struct ucred))];
+    struct iovec mIovecs[kMaxBatchSize];
+    struct mmsghdr mMsgs[kMaxBatchSize];
 };
 }  // namespace statsd
 }  // namespace os
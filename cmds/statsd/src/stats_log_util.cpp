@@ -58,6 +58,9 @@ const int FIELD_ID_PULL_ATOM_ID = 1;
 const int FIELD_ID_TOTAL_PULL = 2;
 const int FIELD_ID_TOTAL_PULL_FROM_CACHE = 3;
 const int FIELD_ID_MIN_PULL_INTERVAL_SEC = 4;
+const int FIELD_ID_AVERAGE_PULL_TIME_NANOS = 5;
+const int FIELD_ID_MAX_PULL_TIME_NANOS = 6;
+const int FIELD_ID_PULL_TIME_HISTOGRAM = 7;
 
 namespace {
 
@@ -405,6 +408,21 @@ void writePullerStatsToStream(const std::pair<int, StatsdStats::PulledAtomStats>
                        (long long)pair.second.totalPullFromCache);
     protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_MIN_PULL_INTERVAL_SEC,
                        (long long)pair.second.minPullIntervalSec);
+    long timedPulls = 0;
+    for (int i = 0; i < StatsdStats::kPullTimeHistogramBuckets; i++) {
+        timedPulls += pair.second.pullTimeHistogram[i];
+    }
+    if (timedPulls > 0) {
+        protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_AVERAGE_PULL_TIME_NANOS,
+                           (long long)(pair.second.totalPullTimeNs / timedPulls));
+        protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_MAX_PULL_TIME_NANOS,
+                           (long long)pair.second.maxPullTimeNs);
+        for (int i = 0; i < StatsdStats::kPullTimeHistogramBuckets; i++) {
+            protoOutput->write(FIELD_TYPE_INT64 | FIELD_COUNT_REPEATED |
+                                       FIELD_ID_PULL_TIME_HISTOGRAM,
+                               (long long)pair.second.pullTimeHistogram[i]);
+        }
+    }
     protoOutput->end(token);
 }
 
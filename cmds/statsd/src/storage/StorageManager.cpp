@@ -18,15 +18,23 @@
 #include "Log.h"
 
 #include "android-base/stringprintf.h"
+#include "frameworks/base/cmds/statsd/src/stats_log.pb.h"
 #include "guardrail/StatsdStats.h"
 #include "storage/StorageManager.h"
 #include "stats_log_util.h"
 
 #include <android-base/file.h>
+#include <android-base/unique_fd.h>
 #include <dirent.h>
+#include <errno.h>
 #include <private/android_filesystem_config.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <utils/JenkinsHash.h>
 #include <fstream>
 #include <iostream>
+#include <mutex>
+#include <tuple>
 
 namespace android {
 namespace os {
@@ -38,6 +46,9 @@ using std::map;
 
 #define STATS_DATA_DIR "/data/misc/stats-data"
 #define STATS_SERVICE_DIR "/data/misc/stats-service"
+// Event metrics move their data here as it piles up. The directory name doesn't parse as a report
+// file name, so the report code skips it.
+#define STATS_EVENT_SPILL_DIR "/data/misc/stats-data/event-spill"
 
 // for ConfigMetricsReportList
 const int FIELD_ID_REPORTS = 2;
@@ -45,12 +56,12 @@ const int FIELD_ID_REPORTS = 2;
 using android::base::StringPrintf;
 using std::unique_ptr;
 
-// Returns array of int64_t which contains timestamp in seconds, uid, and
-// configID.
+// Returns array of int64_t which contains timestamp in seconds, uid, configID and the sequence
+// number, which is 0 when the name has none.
 static void parseFileName(char* name, int64_t* result) {
     int index = 0;
     char* substr = strtok(name, "_");
-    while (substr != nullptr && index < 3) {
+    while (substr != nullptr && index < 4) {
         result[index] = StrToInt64(substr);
         index++;
         substr = strtok(nullptr, "_");
@@ -61,13 +72,103 @@ static void parseFileName(char* name, int64_t* result) {
     if (index < 3) {
         result[0] = -1;
     }
+    if (index < 4) {
+        result[3] = 0;
+    }
 }
 
-static string getFilePath(const char* path, int64_t timestamp, int64_t uid, int64_t configID) {
+// A sequence number tells apart the report segments of a config started within the same second.
+static string getFilePath(const char* path, int64_t timestamp, int64_t uid, int64_t configID,
+                          int64_t sequence = 0) {
+    if (sequence > 0) {
+        return StringPrintf("%s/%lld_%d_%lld_%lld", path, (long long)timestamp, (int)uid,
+                            (long long)configID, (long long)sequence);
+    }
     return StringPrintf("%s/%lld_%d_%lld", path, (long long)timestamp, (int)uid,
                         (long long)configID);
 }
 
+// Reports are saved in segment files, named like any other file in the data directory. A segment
+// starts with kReportSegmentMagic, followed by one record per report: the size and checksum of
+// the report as uint32_t, then the serialized ConfigMetricsReport. Files without the magic hold a
+// single report, the way older builds saved them.
+static const char kReportSegmentMagic[] = {'S', 'T', 'A', 'T', 'S', 'E', 'G', '1'};
+static const size_t kReportRecordHeaderSize = 2 * sizeof(uint32_t);
+
+// The segment the reports of a config are appended to, and its size as this process wrote it.
+struct ActiveSegment {
+    string path;
+    off_t size = 0;
+};
+
+// Keeps a report from being saved while the reports of the same config are read and deleted.
+static std::mutex sSegmentMutex;
+
+// Keyed by directory and config. Guarded by sSegmentMutex.
+static map<std::pair<string, ConfigKey>, ActiveSegment> sActiveSegments;
+
+static uint32_t getReportChecksum(const char* report, size_t size) {
+    return JenkinsHashWhiten(
+            JenkinsHashMixBytes(0, reinterpret_cast<const uint8_t*>(report), size));
+}
+
+// Calls onReport for each intact report in a segment and returns the size of the intact part.
+// Parsing stops at the first record that is cut short or fails its checksum, which is what a
+// crash in the middle of an append leaves behind. Returns -1 if content is not a segment.
+static ssize_t parseReportSegment(const string& content,
+                                  const std::function<void(const char*, size_t)>& onReport) {
+    if (content.size() < sizeof(kReportSegmentMagic) ||
+        memcmp(content.data(), kReportSegmentMagic, sizeof(kReportSegmentMagic)) != 0) {
+        return -1;
+    }
+    size_t pos = sizeof(kReportSegmentMagic);
+    while (content.size() - pos >= kReportRecordHeaderSize) {
+        uint32_t size;
+        uint32_t checksum;
+        memcpy(&size, content.data() + pos, sizeof(size));
+        memcpy(&checksum, content.data() + pos + sizeof(size), sizeof(checksum));
+        const char* report = content.data() + pos + kReportRecordHeaderSize;
+        if (content.size() - pos - kReportRecordHeaderSize < size ||
+            getReportChecksum(report, size) != checksum) {
+            VLOG("Ignoring torn report at offset %zu", pos);
+            break;
+        }
+        onReport(report, size);
+        pos += kReportRecordHeaderSize + size;
+    }
+    return pos;
+}
+
+// New segments are written here first. The name starts with a dot, so nothing that lists the
+// directory for reports picks it up, and a copy left by a crash is overwritten by the next one.
+static const char kReportSegmentTempName[] = ".segment.tmp";
+
+// Writes a segment holding a single record to tempPath, then renames it to path.
+static bool writeNewReportSegment(const string& tempPath, const string& path,
+                                  const uint32_t recordHeader[2], const vector<uint8_t>& record) {
+    android::base::unique_fd fd(open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                                     S_IRUSR | S_IWUSR));
+    if (fd == -1) {
+        ALOGE("Attempt to write %s but failed", tempPath.c_str());
+        return false;
+    }
+    struct iovec iov[3];
+    iov[0].iov_base = const_cast<char*>(kReportSegmentMagic);
+    iov[0].iov_len = sizeof(kReportSegmentMagic);
+    iov[1].iov_base = const_cast<uint32_t*>(recordHeader);
+    iov[1].iov_len = kReportRecordHeaderSize;
+    iov[2].iov_base = const_cast<uint8_t*>(record.data());
+    iov[2].iov_len = record.size();
+    const ssize_t expected = iov[0].iov_len + iov[1].iov_len + iov[2].iov_len;
+    if (TEMP_FAILURE_RETRY(writev(fd.get(), iov, 3)) != expected || fdatasync(fd.get()) != 0 ||
+        rename(tempPath.c_str(), path.c_str()) != 0) {
+        ALOGE("Failed to write %s", path.c_str());
+        remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
 void StorageManager::writeFile(const char* file, const void* buffer, int numBytes) {
     int fd = open(file, O_WRONLY | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
     if (fd == -1) {
@@ -150,7 +251,7 @@ void StorageManager::sendBroadcast(const char* path,
         if (name[0] == '.') continue;
         VLOG("file %s", name);
 
-        int64_t result[3];
+        int64_t result[4];
         parseFileName(name, result);
         if (result[0] == -1) continue;
         int64_t uid = result[1];
@@ -167,21 +268,15 @@ bool StorageManager::hasConfigMetricsReport(const ConfigKey& key) {
         return false;
     }
 
-    string suffix = StringPrintf("%d_%lld", key.GetUid(), (long long)key.GetId());
-
     dirent* de;
     while ((de = readdir(dir.get()))) {
         char* name = de->d_name;
         if (name[0] == '.') continue;
 
-        size_t nameLen = strlen(name);
-        size_t suffixLen = suffix.length();
-        if (suffixLen <= nameLen &&
-            strncmp(name + nameLen - suffixLen, suffix.c_str(), suffixLen) == 0) {
-            // Check again that the file name is parseable.
-            int64_t result[3];
-            parseFileName(name, result);
-            if (result[0] == -1) continue;
+        int64_t result[4];
+        parseFileName(name, result);
+        if (result[0] == -1) continue;
+        if (result[1] == key.GetUid() && result[2] == key.GetId()) {
             return true;
         }
     }
@@ -189,47 +284,274 @@ bool StorageManager::hasConfigMetricsReport(const ConfigKey& key) {
 }
 
 void StorageManager::appendConfigMetricsReport(const ConfigKey& key, ProtoOutputStream* proto) {
-    unique_ptr<DIR, decltype(&closedir)> dir(opendir(STATS_DATA_DIR), closedir);
-    if (dir == NULL) {
-        VLOG("Path %s does not exist", STATS_DATA_DIR);
+    appendConfigMetricsReport(STATS_DATA_DIR, key, proto);
+}
+
+void StorageManager::appendConfigMetricsReport(const char* dir, const ConfigKey& key,
+                                               ProtoOutputStream* proto) {
+    std::lock_guard<std::mutex> lock(sSegmentMutex);
+    // The segments are deleted below, so the next report starts a new one.
+    sActiveSegments.erase(std::make_pair(string(dir), key));
+
+    unique_ptr<DIR, decltype(&closedir)> dirHandle(opendir(dir), closedir);
+    if (dirHandle == NULL) {
+        VLOG("Path %s does not exist", dir);
         return;
     }
 
-    string suffix = StringPrintf("%d_%lld", key.GetUid(), (long long)key.GetId());
-
+    // Segments are read oldest first, so that the reports stay in the order they were written.
+    vector<std::tuple<int64_t, int64_t, string>> segments;
     dirent* de;
-    while ((de = readdir(dir.get()))) {
+    while ((de = readdir(dirHandle.get()))) {
         char* name = de->d_name;
         if (name[0] == '.') continue;
 
-        size_t nameLen = strlen(name);
-        size_t suffixLen = suffix.length();
-        if (suffixLen <= nameLen &&
-            strncmp(name + nameLen - suffixLen, suffix.c_str(), suffixLen) == 0) {
-            int64_t result[3];
-            parseFileName(name, result);
-            if (result[0] == -1) continue;
-            int64_t timestamp = result[0];
-            int64_t uid = result[1];
-            int64_t configID = result[2];
-
-            string file_name = getFilePath(STATS_DATA_DIR, timestamp, uid, configID);
-            int fd = open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
-            if (fd != -1) {
-                string content;
-                if (android::base::ReadFdToString(fd, &content)) {
-                    proto->write(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | FIELD_ID_REPORTS,
-                                content.c_str(), content.size());
-                }
-                close(fd);
+        int64_t result[4];
+        parseFileName(name, result);
+        if (result[0] == -1) continue;
+        int64_t timestamp = result[0];
+        int64_t uid = result[1];
+        int64_t configID = result[2];
+        int64_t sequence = result[3];
+        if (uid != key.GetUid() || configID != key.GetId()) continue;
+        segments.push_back(std::make_tuple(timestamp, sequence,
+                                           getFilePath(dir, timestamp, uid, configID, sequence)));
+    }
+    sort(segments.begin(), segments.end());
+
+    auto appendReport = [proto](const char* report, size_t size) {
+        proto->write(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | FIELD_ID_REPORTS, report, size);
+    };
+    for (const auto& segment : segments) {
+        const string& file_name = std::get<2>(segment);
+        string content;
+        if (readFileToString(file_name.c_str(), &content) &&
+            parseReportSegment(content, appendReport) < 0) {
+            // Saved by an older build as a single report, unless it is garbage.
+            if (ConfigMetricsReport().ParseFromString(content)) {
+                appendReport(content.c_str(), content.size());
+            } else {
+                ALOGE("Dropping unreadable report file %s", file_name.c_str());
             }
+        }
+
+        // Remove file from disk after reading.
+        remove(file_name.c_str());
+    }
+}
+
+bool StorageManager::writeConfigMetricsReport(const ConfigKey& key, ProtoOutputStream* report) {
+    vector<uint8_t> buffer(report->size());
+    size_t pos = 0;
+    auto iter = report->data();
+    while (iter.readBuffer() != NULL) {
+        size_t toRead = iter.currentToRead();
+        std::memcpy(&buffer[pos], iter.readBuffer(), toRead);
+        pos += toRead;
+        iter.rp()->move(toRead);
+    }
+    return writeConfigMetricsReport(STATS_DATA_DIR, key, getWallClockSec(), buffer);
+}
 
-            // Remove file from disk after reading.
-            remove(file_name.c_str());
+bool StorageManager::writeConfigMetricsReport(const char* dir, const ConfigKey& key,
+                                              int64_t timestampSec,
+                                              const vector<uint8_t>& report) {
+    std::lock_guard<std::mutex> lock(sSegmentMutex);
+    const auto segmentKey = std::make_pair(string(dir), key);
+    ActiveSegment& segment = sActiveSegments[segmentKey];
+    const off_t recordSize = kReportRecordHeaderSize + report.size();
+    if (segment.path.empty() || segment.size + recordSize > StatsdStats::kMaxReportSegmentSize) {
+        // Only trim when a segment is started, not for every report.
+        trimToFit(dir);
+        // A segment that rolled over within the same second, or is left from before a restart,
+        // may already have the name. Each segment gets a name of its own.
+        const string previousPath = segment.path;
+        int64_t sequence = 0;
+        struct stat existing;
+        do {
+            segment.path = getFilePath(dir, timestampSec, key.GetUid(), key.GetId(), sequence++);
+        } while (segment.path == previousPath || stat(segment.path.c_str(), &existing) == 0);
+        segment.size = 0;
+    }
+    const string file_name = segment.path;
+
+    struct stat fileStat;
+    if (stat(file_name.c_str(), &fileStat) != 0) {
+        if (errno != ENOENT) {
+            ALOGE("Failed to stat %s", file_name.c_str());
+            sActiveSegments.erase(segmentKey);
+            return false;
+        }
+        fileStat.st_size = 0;
+    }
+    if (fileStat.st_size != segment.size) {
+        // The segment was deleted or trimmed behind our back, and may end in a torn report.
+        // Keep its intact part and append after that.
+        string content;
+        ssize_t intactSize = 0;
+        if (fileStat.st_size > 0) {
+            intactSize = readFileToString(file_name.c_str(), &content)
+                                 ? parseReportSegment(content, [](const char*, size_t) {})
+                                 : -1;
+        }
+        if (intactSize < 0) {
+            ALOGE("Cannot append to %s", file_name.c_str());
+            sActiveSegments.erase(segmentKey);
+            return false;
         }
+        segment.size = intactSize > (ssize_t)sizeof(kReportSegmentMagic) ? intactSize : 0;
+    }
+
+    uint32_t recordHeader[2] = {
+            (uint32_t)report.size(),
+            getReportChecksum(reinterpret_cast<const char*>(report.data()), report.size())};
+    if (segment.size == 0) {
+        // A new segment is written out in full before it gets its name, so there is never a
+        // file with a report name but no magic, which would be taken for an old single report.
+        if (!writeNewReportSegment(StringPrintf("%s/%s", dir, kReportSegmentTempName), file_name,
+                                   recordHeader, report)) {
+            sActiveSegments.erase(segmentKey);
+            return false;
+        }
+        segment.size = sizeof(kReportSegmentMagic) + recordSize;
+        VLOG("Started %s with %zu bytes of reports", file_name.c_str(), report.size());
+        return true;
+    }
+
+    android::base::unique_fd fd(open(file_name.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC));
+    if (fd == -1) {
+        ALOGE("Attempt to write %s but failed", file_name.c_str());
+        sActiveSegments.erase(segmentKey);
+        return false;
+    }
+    if (fileStat.st_size != segment.size && ftruncate(fd.get(), segment.size) != 0) {
+        ALOGE("Cannot append to %s", file_name.c_str());
+        sActiveSegments.erase(segmentKey);
+        return false;
+    }
+
+    // The header and the report go out in one write, so a crash can only leave a torn record at
+    // the end of the segment.
+    struct iovec iov[2];
+    iov[0].iov_base = recordHeader;
+    iov[0].iov_len = sizeof(recordHeader);
+    iov[1].iov_base = const_cast<uint8_t*>(report.data());
+    iov[1].iov_len = report.size();
+    if (TEMP_FAILURE_RETRY(writev(fd.get(), iov, 2)) != recordSize) {
+        ALOGE("Failed to write report to %s", file_name.c_str());
+        // Drop what made it to disk, so the next report isn't appended after a torn one.
+        if (ftruncate(fd.get(), segment.size) != 0) {
+            sActiveSegments.erase(segmentKey);
+        }
+        return false;
+    }
+    if (fdatasync(fd.get()) != 0) {
+        ALOGE("Failed to sync %s", file_name.c_str());
+    }
+    segment.size += recordSize;
+    VLOG("Appended %zu bytes of reports to %s", report.size(), file_name.c_str());
+    return true;
+}
+
+static string getEventMetricChunkPath(const ConfigKey& key, int64_t metricId, int64_t spillId) {
+    return StringPrintf("%s/%d_%lld_%lld_%lld", STATS_EVENT_SPILL_DIR, key.GetUid(),
+                        (long long)key.GetId(), (long long)metricId, (long long)spillId);
+}
+
+// Chunks are saved as the records of a report segment, so a chunk torn by a crash is dropped the
+// same way a torn report is.
+bool StorageManager::appendEventMetricChunk(const ConfigKey& key, int64_t metricId,
+                                            int64_t spillId, const vector<uint8_t>& chunk) {
+    const string file_name = getEventMetricChunkPath(key, metricId, spillId);
+    android::base::unique_fd fd(open(file_name.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                                     S_IRUSR | S_IWUSR));
+    if (fd == -1 && errno == ENOENT && mkdir(STATS_EVENT_SPILL_DIR, S_IRWXU) == 0) {
+        fd.reset(open(file_name.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                      S_IRUSR | S_IWUSR));
+    }
+    if (fd == -1) {
+        ALOGE("Attempt to write %s but failed", file_name.c_str());
+        return false;
+    }
+    struct stat fileStat;
+    if (fstat(fd.get(), &fileStat) != 0) {
+        ALOGE("Failed to stat %s", file_name.c_str());
+        return false;
+    }
+
+    uint32_t recordHeader[2] = {
+            (uint32_t)chunk.size(),
+            getReportChecksum(reinterpret_cast<const char*>(chunk.data()), chunk.size())};
+    struct iovec iov[3];
+    iov[0].iov_base = const_cast<char*>(kReportSegmentMagic);
+    iov[0].iov_len = fileStat.st_size == 0 ? sizeof(kReportSegmentMagic) : 0;
+    iov[1].iov_base = recordHeader;
+    iov[1].iov_len = sizeof(recordHeader);
+    iov[2].iov_base = const_cast<uint8_t*>(chunk.data());
+    iov[2].iov_len = chunk.size();
+    const ssize_t expected = iov[0].iov_len + iov[1].iov_len + iov[2].iov_len;
+    if (TEMP_FAILURE_RETRY(writev(fd.get(), iov, 3)) != expected) {
+        ALOGE("Failed to write chunk to %s", file_name.c_str());
+        if (ftruncate(fd.get(), fileStat.st_size) != 0) {
+            ALOGE("Failed to drop the torn chunk from %s", file_name.c_str());
+        }
+        return false;
+    }
+    VLOG("Appended %zu bytes of events to %s", chunk.size(), file_name.c_str());
+    return true;
+}
+
+void StorageManager::readEventMetricChunks(
+        const ConfigKey& key, int64_t metricId, int64_t spillId,
+        const std::function<void(const char*, size_t)>& onChunk) {
+    const string file_name = getEventMetricChunkPath(key, metricId, spillId);
+    string content;
+    if (!readFileToString(file_name.c_str(), &content)) {
+        return;
+    }
+    if (parseReportSegment(content, onChunk) < 0) {
+        ALOGE("Ignoring malformed event chunks in %s", file_name.c_str());
     }
 }
 
+void StorageManager::deleteEventMetricChunks(const ConfigKey& key, int64_t metricId,
+                                             int64_t spillId) {
+    deleteFile(getEventMetricChunkPath(key, metricId, spillId).c_str());
+}
+
+// Returns the chunk files with their sizes. If key is given, only those of that config.
+static vector<std::pair<string, int>> listEventMetricChunks(const ConfigKey* key) {
+    vector<std::pair<string, int>> files;
+    unique_ptr<DIR, decltype(&closedir)> dir(opendir(STATS_EVENT_SPILL_DIR), closedir);
+    if (dir == NULL) {
+        return files;
+    }
+    const string prefix =
+            key == nullptr ? ""
+                           : StringPrintf("%d_%lld_", key->GetUid(), (long long)key->GetId());
+    dirent* de;
+    while ((de = readdir(dir.get()))) {
+        const char* name = de->d_name;
+        if (name[0] == '.' || strncmp(name, prefix.c_str(), prefix.size()) != 0) continue;
+        struct stat fileStat;
+        const int fileSize =
+                fstatat(dirfd(dir.get()), name, &fileStat, 0) == 0 ? fileStat.st_size : 0;
+        files.push_back(std::make_pair(StringPrintf("%s/%s", STATS_EVENT_SPILL_DIR, name),
+                                       fileSize));
+    }
+    return files;
+}
+
+void StorageManager::deleteEventMetricChunks(const ConfigKey& key) {
+    for (const auto& file : listEventMetricChunks(&key)) {
+        deleteFile(file.first.c_str());
+    }
+}
+
+void StorageManager::deleteAllEventMetricChunks() {
+    deleteAllFiles(STATS_EVENT_SPILL_DIR);
+}
+
 bool StorageManager::readFileToString(const char* file, string* content) {
     int fd = open(file, O_RDONLY | O_CLOEXEC);
     bool res = false;
@@ -258,7 +580,7 @@ void StorageManager::readConfigFromDisk(map<ConfigKey, StatsdConfig>& configsMap
         if (name[0] == '.') continue;
         VLOG("file %s", name);
 
-        int64_t result[3];
+        int64_t result[4];
         parseFileName(name, result);
         if (result[0] == -1) continue;
         int64_t timestamp = result[0];
@@ -339,56 +661,64 @@ void StorageManager::trimToFit(const char* path) {
     }
     dirent* de;
     int totalFileSize = 0;
-    vector<string> fileNames;
+    // File names with their sizes, which are looked up once while listing the directory.
+    vector<std::pair<string, int>> files;
     while ((de = readdir(dir.get()))) {
         char* name = de->d_name;
         if (name[0] == '.') continue;
 
-        int64_t result[3];
+        struct stat fileStat;
+        const int fileSize =
+                fstatat(dirfd(dir.get()), name, &fileStat, 0) == 0 ? fileStat.st_size : 0;
+
+        int64_t result[4];
         parseFileName(name, result);
         if (result[0] == -1) continue;
         int64_t timestamp = result[0];
         int64_t uid = result[1];
         int64_t configID = result[2];
-        string file_name = getFilePath(path, timestamp, uid, configID);
+        string file_name = getFilePath(path, timestamp, uid, configID, result[3]);
 
         // Check for timestamp and delete if it's too old.
         long fileAge = getWallClockSec() - timestamp;
         if (fileAge > StatsdStats::kMaxAgeSecond) {
             deleteFile(file_name.c_str());
+            continue;
         }
 
-        fileNames.push_back(file_name);
-        ifstream file(file_name.c_str(), ifstream::in | ifstream::binary);
-        if (file.is_open()) {
-            file.seekg(0, ios::end);
-            int fileSize = file.tellg();
-            file.close();
-            totalFileSize += fileSize;
+        files.push_back(std::make_pair(file_name, fileSize));
+        totalFileSize += fileSize;
+    }
+
+    // Event data moved to disk lives under the data directory too, and counts toward its limit.
+    vector<std::pair<string, int>> chunks;
+    if (strcmp(path, STATS_DATA_DIR) == 0) {
+        chunks = listEventMetricChunks(nullptr);
+        for (const auto& chunk : chunks) {
+            totalFileSize += chunk.second;
         }
     }
 
-    if (fileNames.size() > StatsdStats::kMaxFileNumber ||
-        totalFileSize > StatsdStats::kMaxFileSize) {
+    if (files.size() > StatsdStats::kMaxFileNumber || totalFileSize > StatsdStats::kMaxFileSize) {
         // Reverse sort to effectively remove from the back (oldest entries).
         // This will sort files in reverse-chronological order.
-        sort(fileNames.begin(), fileNames.end(), std::greater<std::string>());
+        sort(files.begin(), files.end(), std::greater<std::pair<string, int>>());
     }
 
     // Start removing files from oldest to be under the limit.
-    while (fileNames.size() > 0 && (fileNames.size() > StatsdStats::kMaxFileNumber ||
-                                    totalFileSize > StatsdStats::kMaxFileSize)) {
-        string file_name = fileNames.at(fileNames.size() - 1);
-        ifstream file(file_name.c_str(), ifstream::in | ifstream::binary);
-        if (file.is_open()) {
-            file.seekg(0, ios::end);
-            int fileSize = file.tellg();
-            file.close();
-            totalFileSize -= fileSize;
-        }
+    while (files.size() > 0 && (files.size() > StatsdStats::kMaxFileNumber ||
+                                totalFileSize > StatsdStats::kMaxFileSize)) {
+        totalFileSize -= files.back().second;
+        deleteFile(files.back().first.c_str());
+        files.pop_back();
+    }
 
-        deleteFile(file_name.c_str());
-        fileNames.pop_back();
+    // Reports go first. Event data is only dropped if it alone is over the limit; its metric then
+    // reports whatever is left.
+    while (chunks.size() > 0 && totalFileSize > StatsdStats::kMaxFileSize) {
+        totalFileSize -= chunks.back().second;
+        deleteFile(chunks.back().first.c_str());
+        chunks.pop_back();
     }
 }
 
@@ -412,7 +742,7 @@ void StorageManager::printDirStats(FILE* out, const char* path) {
         if (name[0] == '.') {
             continue;
         }
-        int64_t result[3];
+        int64_t result[4];
         parseFileName(name, result);
         if (result[0] == -1) continue;
         int64_t timestamp = result[0];
@@ -423,7 +753,7 @@ void StorageManager::printDirStats(FILE* out, const char* path) {
                 (long long)timestamp,
                 (int)uid,
                 (long long)configID);
-        string file_name = getFilePath(path, timestamp, uid, configID);
+        string file_name = getFilePath(path, timestamp, uid, configID, result[3]);
         ifstream file(file_name.c_str(), ifstream::in | ifstream::binary);
         if (file.is_open()) {
             file.seekg(0, ios::end);
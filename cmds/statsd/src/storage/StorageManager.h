@@ -18,6 +18,7 @@
 #define STORAGE_MANAGER_H
 
 #include <android/util/ProtoOutputStream.h>
+#include <gtest/gtest_prod.h>
 #include <utils/Log.h>
 #include <utils/RefBase.h>
 
@@ -73,6 +74,43 @@ public:
      */
     static void appendConfigMetricsReport(const ConfigKey& key, ProtoOutputStream* proto);
 
+    /**
+     * Saves a ConfigMetricsReport to disk by appending it to the newest report segment of the
+     * config. Only the new report is written; earlier ones are neither rewritten nor read back.
+     * Returns false if the report could not be saved.
+     */
+    static bool writeConfigMetricsReport(const ConfigKey& key, ProtoOutputStream* report);
+
+    /**
+     * Appends a chunk of serialized EventMetricDataWrapper to the chunks saved for an event
+     * metric. spillId tells apart the producers of the same metric, e.g. before and after a
+     * config update. Returns false if the chunk could not be saved.
+     */
+    static bool appendEventMetricChunk(const ConfigKey& key, int64_t metricId, int64_t spillId,
+                                       const vector<uint8_t>& chunk);
+
+    /**
+     * Calls onChunk for each intact chunk saved for an event metric, oldest first.
+     */
+    static void readEventMetricChunks(const ConfigKey& key, int64_t metricId, int64_t spillId,
+                                      const std::function<void(const char*, size_t)>& onChunk);
+
+    /**
+     * Deletes the chunks saved for an event metric.
+     */
+    static void deleteEventMetricChunks(const ConfigKey& key, int64_t metricId, int64_t spillId);
+
+    /**
+     * Deletes the chunks saved for all event metrics of a config.
+     */
+    static void deleteEventMetricChunks(const ConfigKey& key);
+
+    /**
+     * Deletes the chunks saved for all event metrics. Chunks left from before a restart have no
+     * metric to report them any more.
+     */
+    static void deleteAllEventMetricChunks();
+
     /**
      * Call to load the saved configs from disk.
      */
@@ -107,6 +145,16 @@ private:
      * Prints disk usage statistics about a directory related to statsd.
      */
     static void printDirStats(FILE* out, const char* path);
+
+    static void appendConfigMetricsReport(const char* dir, const ConfigKey& key,
+                                          ProtoOutputStream* proto);
+
+    static bool writeConfigMetricsReport(const char* dir, const ConfigKey& key,
+                                         int64_t timestampSec, const vector<uint8_t>& report);
+
+    FRIEND_TEST(StorageManagerTest, TestReportSegments);
+    FRIEND_TEST(StorageManagerTest, TestTornReportIsDropped);
+    FRIEND_TEST(StorageManagerTest, TestLegacyReportFile);
 };
 
 }  // namespace statsd
@@ -130,6 +130,123 @@ TEST(AtomMatcherTest, TestFilter_ALL) {
     EXPECT_EQ("some value", output.getValues()[6].mValue.str_value);
 }
 
+static void createAttributionChainEvent(LogEvent* event) {
+    std::vector<AttributionNodeInternal> attribution_nodes(3);
+    attribution_nodes[0].set_uid(1111);
+    attribution_nodes[0].set_tag("location1");
+    attribution_nodes[1].set_uid(2222);
+    attribution_nodes[1].set_tag("location2");
+    attribution_nodes[2].set_uid(3333);
+    attribution_nodes[2].set_tag("location3");
+    event->write(attribution_nodes);
+    event->write("some value");
+    event->init();
+}
+
+static void addFirstUidLastTagMatchers(FieldMatcher* matcher) {
+    FieldMatcher* child = matcher->add_child();
+    child->set_field(1);
+    child->set_position(Position::FIRST);
+    child->add_child()->set_field(1);
+
+    child = matcher->add_child();
+    child->set_field(1);
+    child->set_position(Position::LAST);
+    child->add_child()->set_field(2);
+}
+
+TEST(AtomMatcherTest, TestFilter_FIRST_LAST) {
+    // Matchers in the same order as the fields of the atom.
+    FieldMatcher sortedMatcher;
+    sortedMatcher.set_field(10);
+    addFirstUidLastTagMatchers(&sortedMatcher);
+    sortedMatcher.add_child()->set_field(2);
+
+    // The same matchers, with the top-level field first.
+    FieldMatcher unsortedMatcher;
+    unsortedMatcher.set_field(10);
+    unsortedMatcher.add_child()->set_field(2);
+    addFirstUidLastTagMatchers(&unsortedMatcher);
+
+    LogEvent event(10, 12345);
+    createAttributionChainEvent(&event);
+
+    for (const auto& fieldMatcher : {sortedMatcher, unsortedMatcher}) {
+        vector<Matcher> matchers;
+        translateFieldMatcher(fieldMatcher, &matchers);
+
+        HashableDimensionKey output;
+        EXPECT_TRUE(filterValues(matchers, event.getValues(), &output));
+
+        // Dimension values come out in the order of the event.
+        EXPECT_EQ((size_t)3, output.getValues().size());
+        EXPECT_EQ((int32_t)0x02010101, output.getValues()[0].mField.getField());
+        EXPECT_EQ((int32_t)1111, output.getValues()[0].mValue.int_value);
+        EXPECT_EQ((int32_t)0x02018002, output.getValues()[1].mField.getField());
+        EXPECT_EQ("location3", output.getValues()[1].mValue.str_value);
+        EXPECT_EQ((int32_t)0x00020000, output.getValues()[2].mField.getField());
+        EXPECT_EQ("some value", output.getValues()[2].mValue.str_value);
+    }
+
+    // Gauge values come out in the order of the matchers, without any modification.
+    vector<Matcher> matchers;
+    translateFieldMatcher(unsortedMatcher, &matchers);
+    vector<FieldValue> gaugeValues;
+    filterGaugeValues(matchers, event.getValues(), &gaugeValues);
+    EXPECT_EQ((size_t)3, gaugeValues.size());
+    EXPECT_EQ("some value", gaugeValues[0].mValue.str_value);
+    EXPECT_EQ((int32_t)0x02010101, gaugeValues[1].mField.getField());
+    EXPECT_EQ((int32_t)1111, gaugeValues[1].mValue.int_value);
+    EXPECT_EQ((int32_t)0x02018382, gaugeValues[2].mField.getField());
+    EXPECT_EQ("location3", gaugeValues[2].mValue.str_value);
+}
+
+TEST(AtomMatcherTest, TestFilter_FIRST_StopsAtFirstNode) {
+    FieldMatcher matcher;
+    matcher.set_field(10);
+    FieldMatcher* child = matcher.add_child();
+    child->set_field(1);
+    child->set_position(Position::FIRST);
+    child->add_child()->set_field(1);
+    vector<Matcher> matchers;
+    translateFieldMatcher(matcher, &matchers);
+
+    LogEvent event(10, 12345);
+    createAttributionChainEvent(&event);
+
+    // Repeat the first node's uid at the end of the chain. A real event never does this; it
+    // is only there to show that the nodes after the first one are not looked at.
+    vector<FieldValue> values = event.getValues();
+    FieldValue repeatedUid = values[0];
+    repeatedUid.mValue.int_value = 4444;
+    values.insert(values.begin() + 6, repeatedUid);
+
+    HashableDimensionKey output;
+    EXPECT_TRUE(filterValues(matchers, values, &output));
+    EXPECT_EQ((size_t)1, output.getValues().size());
+    EXPECT_EQ((int32_t)1111, output.getValues()[0].mValue.int_value);
+
+    vector<FieldValue> gaugeValues;
+    filterGaugeValues(matchers, values, &gaugeValues);
+    EXPECT_EQ((size_t)1, gaugeValues.size());
+    EXPECT_EQ((int32_t)1111, gaugeValues[0].mValue.int_value);
+}
+
+TEST(AtomMatcherTest, TestFilter_NoMatch) {
+    FieldMatcher matcher;
+    matcher.set_field(10);
+    matcher.add_child()->set_field(5);
+    vector<Matcher> matchers;
+    translateFieldMatcher(matcher, &matchers);
+
+    LogEvent event(10, 12345);
+    createAttributionChainEvent(&event);
+
+    HashableDimensionKey output;
+    EXPECT_FALSE(filterValues(matchers, event.getValues(), &output));
+    EXPECT_EQ((size_t)0, output.getValues().size());
+}
+
 TEST(AtomMatcherTest, TestSubDimension) {
     HashableDimensionKey dim;
 
@@ -171,6 +288,42 @@ TEST(AtomMatcherTest, TestSubDimension) {
     EXPECT_TRUE(dim.contains(subDim4));
 }
 
+TEST(AtomMatcherTest, TestDimensionHashIsUpToDate) {
+    int pos1[] = {1, 1, 1};
+    int pos2[] = {1, 1, 2};
+    Field field1(10, pos1, 2);
+    Field field2(10, pos2, 2);
+
+    HashableDimensionKey dim1;
+    dim1.addValue(FieldValue(field1, Value((int32_t)10025)));
+    dim1.addValue(FieldValue(field2, Value("tag")));
+
+    HashableDimensionKey dim2;
+    dim2.addValue(FieldValue(field1, Value((int32_t)10025)));
+    dim2.addValue(FieldValue(field2, Value("tag")));
+
+    EXPECT_EQ(hashDimension(dim1), hashDimension(dim2));
+    EXPECT_TRUE(dim1 == dim2);
+
+    // A copy keeps the hash of the original.
+    HashableDimensionKey copy(dim1);
+    EXPECT_EQ(hashDimension(dim1), hashDimension(copy));
+
+    // A key built from the values at once hashes the same as one built value by value.
+    HashableDimensionKey dim3(dim1.getValues());
+    EXPECT_EQ(hashDimension(dim1), hashDimension(dim3));
+    EXPECT_TRUE(dim1 == dim3);
+
+    std::vector<FieldValue> values = dim1.getValues();
+    values[0].mValue.setInt(10026);
+    HashableDimensionKey dim4(values);
+    EXPECT_NE(hashDimension(dim1), hashDimension(dim4));
+    EXPECT_FALSE(dim1 == dim4);
+
+    dim2.addValue(FieldValue(field1, Value((int32_t)1)));
+    EXPECT_NE(hashDimension(dim1), hashDimension(dim2));
+}
+
 TEST(AtomMatcherTest, TestMetric2ConditionLink) {
     AttributionNodeInternal attribution_node1;
     attribution_node1.set_uid(1111);
@@ -446,6 +446,61 @@ TEST(AtomMatcherTest, TestEqAnyStringMatcher) {
     EXPECT_FALSE(matchesSimple(uidMap, *simpleMatcher, event));
 }
 
+TEST(AtomMatcherTest, TestCompiledAllowList) {
+    UidMap uidMap;
+    uidMap.updateMap(1, {1111, 2222} /* uid list */, {1, 1} /* version list */,
+                     {android::String16("pkg1"), android::String16("pkg2")} /* package names */);
+
+    AttributionNodeInternal attribution_node1;
+    attribution_node1.set_uid(1111);
+    attribution_node1.set_tag("location1");
+    AttributionNodeInternal attribution_node2;
+    attribution_node2.set_uid(3333);
+    attribution_node2.set_tag("location2");
+    std::vector<AttributionNodeInternal> attribution_nodes = {attribution_node1, attribution_node2};
+
+    LogEvent event(TAG_ID, 0);
+    event.write(attribution_nodes);
+    event.init();
+
+    AtomMatcher matcher;
+    auto simpleMatcher = matcher.mutable_simple_atom_matcher();
+    simpleMatcher->set_atom_id(TAG_ID);
+    auto attributionMatcher = simpleMatcher->add_field_value_matcher();
+    attributionMatcher->set_field(FIELD_ID_1);
+    attributionMatcher->set_position(Position::LAST);
+    attributionMatcher->mutable_matches_tuple()->add_field_value_matcher()->set_field(
+            ATTRIBUTION_UID_FIELD_ID);
+    auto eqStringList = attributionMatcher->mutable_matches_tuple()
+                                ->mutable_field_value_matcher(0)
+                                ->mutable_eq_any_string();
+    for (int i = 0; i < 1000; i++) {
+        eqStringList->add_str_value("com.example.app" + std::to_string(i));
+    }
+    eqStringList->add_str_value("pkg3");
+    eqStringList->add_str_value("AID_STATSD");
+
+    CompiledAtomMatcher compiled = compileAtomMatcher(*simpleMatcher);
+    ASSERT_EQ(1u, compiled.fieldValueMatchers.size());
+    ASSERT_EQ(1u, compiled.fieldValueMatchers[0].children.size());
+    EXPECT_EQ(1002u, compiled.fieldValueMatchers[0].children[0].strings.size());
+    EXPECT_EQ(1u, compiled.fieldValueMatchers[0].children[0].aidUids.size());
+
+    // The last node has uid 3333, which has no package yet.
+    EXPECT_FALSE(matchesSimple(uidMap, compiled, event));
+
+    // Packages are looked up when the event is matched, not when the matcher is compiled.
+    uidMap.updateApp(2, android::String16("pkg3"), 3333, 1);
+    EXPECT_TRUE(matchesSimple(uidMap, compiled, event));
+
+    // AID names match by uid.
+    attribution_nodes[1].set_uid(1066);
+    LogEvent statsdEvent(TAG_ID, 0);
+    statsdEvent.write(attribution_nodes);
+    statsdEvent.init();
+    EXPECT_TRUE(matchesSimple(uidMap, compiled, statsdEvent));
+}
+
 TEST(AtomMatcherTest, TestBoolMatcher) {
     UidMap uidMap;
     // Set up the matcher
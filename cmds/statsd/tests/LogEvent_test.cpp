@@ -159,6 +159,42 @@ TEST(LogEventTest, TestLogParsing2) {
 }
 
 
+TEST(LogEventTest, TestLazyParsing) {
+    // Encode an event the way the statsd socket receives it, after the event tag.
+    android_log_context context = create_android_logger(1937006964);
+    android_log_write_int64(context, 3000);  // elapsed timestamp
+    android_log_write_int32(context, 10);    // atom id
+    android_log_write_int32(context, 100);
+    android_log_write_string8(context, "hello");
+    const char* buffer;
+    size_t len = android_log_write_list_buffer(context, &buffer);
+
+    LogEvent event(buffer, len, 1000 /* uid */, 2000 /* logd timestamp */);
+    EXPECT_EQ(10, event.GetTagId());
+    EXPECT_EQ(3000, event.GetElapsedTimestampNs());
+    EXPECT_EQ(2000, event.GetLogdTimestampNs());
+    EXPECT_EQ(1000u, event.GetUid());
+    EXPECT_FALSE(event.isParsed());
+
+    // Reading the values parses them.
+    const auto& items = event.getValues();
+    EXPECT_TRUE(event.isParsed());
+    EXPECT_EQ((size_t)2, items.size());
+    EXPECT_EQ(0x10000, items[0].mField.getField());
+    EXPECT_EQ(100, items[0].mValue.int_value);
+    EXPECT_EQ(0x20000, items[1].mField.getField());
+    EXPECT_EQ("hello", items[1].mValue.str_value);
+
+    // Copies don't refer to the buffer.
+    LogEvent event2(buffer, len, 1000, 2000);
+    LogEvent copy(event2);
+    android_log_destroy(&context);
+    EXPECT_TRUE(copy.isParsed());
+    EXPECT_EQ(10, copy.GetTagId());
+    EXPECT_EQ((size_t)2, copy.getValues().size());
+    EXPECT_EQ("hello", copy.getValues()[1].mValue.str_value);
+}
+
 }  // namespace statsd
 }  // namespace os
 }  // namespace android
@@ -18,6 +18,7 @@
 #include "src/matchers/LogMatchingTracker.h"
 #include "src/metrics/CountMetricProducer.h"
 #include "src/metrics/GaugeMetricProducer.h"
+#include "src/metrics/MetricsManager.h"
 #include "src/metrics/MetricProducer.h"
 #include "src/metrics/ValueMetricProducer.h"
 #include "src/metrics/metrics_manager_util.h"
@@ -445,6 +446,79 @@ TEST(MetricsManagerTest, testAlertWithUnknownMetric) {
                                   noReportMetricIds));
 }
 
+namespace android {
+namespace os {
+namespace statsd {
+
+TEST(MetricsManagerTest, TestAtomDispatchMap) {
+    StatsdConfig config;
+    config.set_id(12345);
+    config.add_allowed_log_source("AID_ROOT");  // LogEvent defaults to UID of root.
+    *config.add_atom_matcher() = CreateScreenTurnedOnAtomMatcher();
+    *config.add_atom_matcher() = CreateScreenTurnedOffAtomMatcher();
+    *config.add_atom_matcher() = CreateAcquireWakelockAtomMatcher();
+    *config.add_atom_matcher() = CreateReleaseWakelockAtomMatcher();
+    *config.add_atom_matcher() = CreateSyncStartAtomMatcher();
+
+    auto screenIsOffPredicate = CreateScreenIsOffPredicate();
+    auto holdingWakelockPredicate = CreateHoldingWakelockPredicate();
+    *config.add_predicate() = screenIsOffPredicate;
+    *config.add_predicate() = holdingWakelockPredicate;
+    auto combinationPredicate = config.add_predicate();
+    combinationPredicate->set_id(StringToId("CombinationPredicate"));
+    combinationPredicate->mutable_combination()->set_operation(LogicalOperation::AND);
+    addPredicateToPredicateCombination(screenIsOffPredicate, combinationPredicate);
+    addPredicateToPredicateCombination(holdingWakelockPredicate, combinationPredicate);
+
+    auto metric = config.add_count_metric();
+    metric->set_id(StringToId("SyncWhileScreenOffHoldingWakelock"));
+    metric->set_what(StringToId("SyncStart"));
+    metric->set_condition(combinationPredicate->id());
+    metric->set_bucket(FIVE_MINUTES);
+
+    sp<UidMap> uidMap = new UidMap();
+    sp<AlarmMonitor> anomalyAlarmMonitor;
+    sp<AlarmMonitor> periodicAlarmMonitor;
+    MetricsManager metricsManager(kConfigKey, config, timeBaseSec, timeBaseSec, uidMap,
+                                  anomalyAlarmMonitor, periodicAlarmMonitor);
+    EXPECT_TRUE(metricsManager.isConfigValid());
+    EXPECT_EQ(3u, metricsManager.mAtomDispatchMap.size());
+
+    // Screen events touch the screen matchers, the screen predicate and the combination, which
+    // also evaluates its wakelock child.
+    const auto& screenInfo =
+            metricsManager.mAtomDispatchMap[android::util::SCREEN_STATE_CHANGED];
+    EXPECT_EQ(vector<int>({0, 1}), screenInfo.matcherIndices);
+    EXPECT_EQ(vector<int>({0, 1, 2}), screenInfo.conditionIndices);
+
+    const auto& wakelockInfo =
+            metricsManager.mAtomDispatchMap[android::util::WAKELOCK_STATE_CHANGED];
+    EXPECT_EQ(vector<int>({2, 3}), wakelockInfo.matcherIndices);
+    EXPECT_EQ(vector<int>({0, 1, 2}), wakelockInfo.conditionIndices);
+
+    // No predicate uses the sync matcher.
+    const auto& syncInfo = metricsManager.mAtomDispatchMap[android::util::SYNC_STATE_CHANGED];
+    EXPECT_EQ(vector<int>({4}), syncInfo.matcherIndices);
+    EXPECT_TRUE(syncInfo.conditionIndices.empty());
+
+    // The scratch state is back to its defaults after each event.
+    auto event = CreateScreenStateChangedEvent(android::view::DISPLAY_STATE_OFF,
+                                               timeBaseSec * NS_PER_SEC + 10);
+    metricsManager.onLogEvent(*event);
+    for (const auto& state : metricsManager.mMatcherCache) {
+        EXPECT_EQ(MatchingState::kNotComputed, state);
+    }
+    for (size_t i = 0; i < metricsManager.mConditionCache.size(); i++) {
+        EXPECT_EQ(ConditionState::kNotEvaluated, metricsManager.mConditionCache[i]);
+        EXPECT_FALSE(metricsManager.mConditionToBeEvaluated[i]);
+        EXPECT_FALSE(metricsManager.mConditionChangedCache[i]);
+    }
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
+
 #else
 GTEST_LOG_(INFO) << "This test does nothing.\n";
 #endif
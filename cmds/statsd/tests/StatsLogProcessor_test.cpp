@@ -27,6 +27,9 @@
 #include "tests/statsd_test_util.h"
 
 #include <stdio.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 using namespace android;
 using namespace testing;
@@ -339,6 +342,277 @@ TEST(StatsLogProcessorTest, TestOutOfOrderLogs) {
     EXPECT_FALSE(p.mInReconnection);
 }
 
+StatsdConfig MakeScreenOnCountConfig() {
+    StatsdConfig config;
+    config.add_allowed_log_source("AID_ROOT");  // LogEvent defaults to UID of root.
+    auto screenOnMatcher = CreateScreenTurnedOnAtomMatcher();
+    *config.add_atom_matcher() = screenOnMatcher;
+    auto countMetric = config.add_count_metric();
+    countMetric->set_id(StringToId("ScreenOnCount"));
+    countMetric->set_what(screenOnMatcher.id());
+    countMetric->set_bucket(FIVE_MINUTES);
+    return config;
+}
+
+int64_t GetScreenOnCount(StatsLogProcessor* p, const ConfigKey& key, int64_t dumpTimeNs) {
+    vector<uint8_t> bytes;
+    p->onDumpReport(key, dumpTimeNs, true /* include_current_partial_bucket */, ADB_DUMP,
+                    &bytes);
+    ConfigMetricsReportList output;
+    output.ParseFromArray(bytes.data(), bytes.size());
+    EXPECT_EQ(1, output.reports_size());
+    EXPECT_EQ(1, output.reports(0).metrics_size());
+    auto countMetrics = output.reports(0).metrics(0).count_metrics();
+    EXPECT_EQ(1, countMetrics.data_size());
+    int64_t count = 0;
+    for (const auto& bucket : countMetrics.data(0).bucket_info()) {
+        count += bucket.count();
+    }
+    return count;
+}
+
+TEST(StatsLogProcessorTest, TestLogEventBatch) {
+    sp<UidMap> m = new UidMap();
+    sp<AlarmMonitor> anomalyAlarmMonitor;
+    sp<AlarmMonitor> subscriberAlarmMonitor;
+    StatsLogProcessor p(m, anomalyAlarmMonitor, subscriberAlarmMonitor, 0,
+                        [](const ConfigKey& key) { return true; });
+    ConfigKey key(3, 4);
+    p.OnConfigUpdated(0, key, MakeScreenOnCountConfig());
+
+    std::vector<std::unique_ptr<LogEvent>> events;
+    events.push_back(CreateScreenStateChangedEvent(android::view::DISPLAY_STATE_ON, 1001));
+    events.push_back(CreateScreenStateChangedEvent(android::view::DISPLAY_STATE_OFF, 1005));
+    // No config uses this atom, so it is dropped before any processing.
+    events.push_back(std::make_unique<LogEvent>(0, 4 /*logd timestamp*/, 1007 /*elapsed*/));
+    events.back()->init();
+    events.push_back(CreateScreenStateChangedEvent(android::view::DISPLAY_STATE_ON, 1003));
+
+    // The batch is processed in order, exactly as if each event was logged on its own.
+    p.OnLogEventBatch(events);
+    EXPECT_EQ(3UL, p.mLogCount);
+    EXPECT_EQ(1005LL, p.mLargestTimestampSeen);
+    EXPECT_EQ(1003LL, p.mLastTimestampSeen);
+    EXPECT_FALSE(p.mInReconnection);
+    EXPECT_EQ(2, GetScreenOnCount(&p, key, 2000));
+}
+
+TEST(StatsLogProcessorTest, TestAtomsOfInterest) {
+    sp<UidMap> m = new UidMap();
+    sp<AlarmMonitor> anomalyAlarmMonitor;
+    sp<AlarmMonitor> subscriberAlarmMonitor;
+    StatsLogProcessor p(m, anomalyAlarmMonitor, subscriberAlarmMonitor, 0,
+                        [](const ConfigKey& key) { return true; });
+    EXPECT_TRUE(p.isAtomOfInterest(android::util::ISOLATED_UID_CHANGED));
+    EXPECT_FALSE(p.isAtomOfInterest(android::util::SCREEN_STATE_CHANGED));
+
+    ConfigKey key(3, 4);
+    p.OnConfigUpdated(0, key, MakeScreenOnCountConfig());
+    EXPECT_TRUE(p.isAtomOfInterest(android::util::SCREEN_STATE_CHANGED));
+    EXPECT_FALSE(p.isAtomOfInterest(android::util::WAKELOCK_STATE_CHANGED));
+
+    p.OnConfigRemoved(key);
+    EXPECT_TRUE(p.isAtomOfInterest(android::util::ISOLATED_UID_CHANGED));
+    EXPECT_FALSE(p.isAtomOfInterest(android::util::SCREEN_STATE_CHANGED));
+}
+
+TEST(StatsLogProcessorTest, TestEventQueuedWhileConfigBusy) {
+    sp<UidMap> m = new UidMap();
+    sp<AlarmMonitor> anomalyAlarmMonitor;
+    sp<AlarmMonitor> subscriberAlarmMonitor;
+    StatsLogProcessor p(m, anomalyAlarmMonitor, subscriberAlarmMonitor, 0,
+                        [](const ConfigKey& key) { return true; });
+    ConfigKey key(3, 4);
+    p.OnConfigUpdated(0, key, MakeScreenOnCountConfig());
+
+    auto event1 = CreateScreenStateChangedEvent(android::view::DISPLAY_STATE_ON, 100);
+    p.OnLogEvent(event1.get());
+
+    // Pretend another thread is dumping the config.
+    auto configLock = p.getConfigLockLocked(key);
+    configLock->mutex.lock();
+
+    auto event2 = CreateScreenStateChangedEvent(android::view::DISPLAY_STATE_ON, 200);
+    p.OnLogEvent(event2.get());
+    EXPECT_EQ(1UL, configLock->pendingEvents.size());
+
+    // Releasing the config replays the queued event.
+    p.unlockConfig(configLock.get());
+    EXPECT_TRUE(configLock->pendingEvents.empty());
+
+    EXPECT_EQ(2, GetScreenOnCount(&p, key, 1000));
+}
+
+TEST(StatsLogProcessorTest, TestWorkerPool) {
+    sp<UidMap> m = new UidMap();
+    sp<AlarmMonitor> anomalyAlarmMonitor;
+    sp<AlarmMonitor> subscriberAlarmMonitor;
+    StatsLogProcessor p(m, anomalyAlarmMonitor, subscriberAlarmMonitor, 0,
+                        [](const ConfigKey& key) { return true; });
+    p.startWorkerPool(2);
+    ConfigKey key1(3, 4);
+    ConfigKey key2(3, 5);
+    ConfigKey key3(6, 4);
+    p.OnConfigUpdated(0, key1, MakeScreenOnCountConfig());
+    p.OnConfigUpdated(0, key2, MakeScreenOnCountConfig());
+    p.OnConfigUpdated(0, key3, MakeScreenOnCountConfig());
+
+    std::vector<std::unique_ptr<LogEvent>> events;
+    for (int i = 0; i < 10; i++) {
+        events.push_back(CreateScreenStateChangedEvent(
+                i % 2 ? android::view::DISPLAY_STATE_OFF : android::view::DISPLAY_STATE_ON,
+                100 + i));
+    }
+    p.OnLogEventBatch(events);
+
+    // Every config sees every event.
+    EXPECT_EQ(5, GetScreenOnCount(&p, key1, 1000));
+    EXPECT_EQ(5, GetScreenOnCount(&p, key2, 1000));
+    EXPECT_EQ(5, GetScreenOnCount(&p, key3, 1000));
+}
+
+TEST(StatsLogProcessorTest, TestDumpWhileConfigsChange) {
+    sp<UidMap> m = new UidMap();
+    sp<AlarmMonitor> anomalyAlarmMonitor;
+    sp<AlarmMonitor> subscriberAlarmMonitor;
+    StatsLogProcessor p(m, anomalyAlarmMonitor, subscriberAlarmMonitor, 0,
+                        [](const ConfigKey& key) { return true; });
+    ConfigKey key(3, 4);
+    p.OnConfigUpdated(0, key, MakeScreenOnCountConfig());
+    auto event = CreateScreenStateChangedEvent(android::view::DISPLAY_STATE_ON, 100);
+    p.OnLogEvent(event.get());
+
+    // Dumping writes the uid map state of the dumped config while other configs come and go.
+    std::thread churn([&p] {
+        ConfigKey otherKey(3, 5);
+        for (int i = 0; i < 200; i++) {
+            p.OnConfigUpdated(0, otherKey, MakeScreenOnCountConfig());
+            p.OnConfigRemoved(otherKey);
+        }
+    });
+    for (int i = 0; i < 200; i++) {
+        vector<uint8_t> bytes;
+        p.onDumpReport(key, 1000 + i, true /* include_current_partial_bucket */, ADB_DUMP,
+                       &bytes);
+        ConfigMetricsReportList output;
+        ASSERT_TRUE(output.ParseFromArray(bytes.data(), bytes.size()));
+        ASSERT_EQ(1, output.reports_size());
+        EXPECT_TRUE(output.reports(0).has_uid_map());
+    }
+    churn.join();
+}
+
+TEST(StatsLogProcessorTest, TestBusyConfigDoesNotStallOthers) {
+    sp<UidMap> m = new UidMap();
+    sp<AlarmMonitor> anomalyAlarmMonitor;
+    sp<AlarmMonitor> subscriberAlarmMonitor;
+    StatsLogProcessor p(m, anomalyAlarmMonitor, subscriberAlarmMonitor, 0,
+                        [](const ConfigKey& key) { return true; });
+    ConfigKey busyKey(3, 4);
+    ConfigKey otherKey(3, 5);
+    p.OnConfigUpdated(0, busyKey, MakeScreenOnCountConfig());
+    p.OnConfigUpdated(0, otherKey, MakeScreenOnCountConfig());
+
+    // Another thread holds the busy config, as if dumping it, until it is told to stop.
+    auto configLock = p.getConfigLockLocked(busyKey);
+    std::mutex syncMutex;
+    std::condition_variable syncCv;
+    bool busy = false;
+    bool done = false;
+    std::thread dump([&] {
+        configLock->mutex.lock();
+        {
+            std::unique_lock<std::mutex> lock(syncMutex);
+            busy = true;
+            syncCv.notify_all();
+            syncCv.wait(lock, [&done] { return done; });
+        }
+        p.unlockConfig(configLock.get());
+    });
+    {
+        std::unique_lock<std::mutex> lock(syncMutex);
+        syncCv.wait(lock, [&busy] { return busy; });
+    }
+
+    // Events and dumps of the other config go on meanwhile.
+    auto event = CreateScreenStateChangedEvent(android::view::DISPLAY_STATE_ON, 100);
+    p.OnLogEvent(event.get());
+    EXPECT_EQ(1UL, configLock->pendingEvents.size());
+    EXPECT_EQ(1, GetScreenOnCount(&p, otherKey, 2000));
+
+    {
+        std::lock_guard<std::mutex> lock(syncMutex);
+        done = true;
+    }
+    syncCv.notify_all();
+    dump.join();
+
+    EXPECT_TRUE(configLock->pendingEvents.empty());
+    EXPECT_EQ(1, GetScreenOnCount(&p, busyKey, 2000));
+}
+
+TEST(StatsLogProcessorTest, TestPendingEventsAreCapped) {
+    sp<UidMap> m = new UidMap();
+    sp<AlarmMonitor> anomalyAlarmMonitor;
+    sp<AlarmMonitor> subscriberAlarmMonitor;
+    StatsLogProcessor p(m, anomalyAlarmMonitor, subscriberAlarmMonitor, 0,
+                        [](const ConfigKey& key) { return true; });
+    ConfigKey key(3, 4);
+    p.OnConfigUpdated(0, key, MakeScreenOnCountConfig());
+
+    // Pretend another thread is dumping the config.
+    auto configLock = p.getConfigLockLocked(key);
+    configLock->mutex.lock();
+
+    const size_t eventCount = StatsdStats::kMaxPendingEventsPerConfig + 1;
+    for (size_t i = 0; i < eventCount; i++) {
+        auto event = CreateScreenStateChangedEvent(android::view::DISPLAY_STATE_ON, 100 + i);
+        p.OnLogEvent(event.get());
+    }
+    // The event past the cap is dropped.
+    EXPECT_EQ(StatsdStats::kMaxPendingEventsPerConfig, configLock->pendingEvents.size());
+
+    p.unlockConfig(configLock.get());
+    EXPECT_EQ((int)StatsdStats::kMaxPendingEventsPerConfig,
+              GetScreenOnCount(&p, key, 100 + eventCount));
+}
+
+TEST(StatsLogProcessorTest, TestFullUidMapSnapshotAfterConfigUpdate) {
+    sp<UidMap> m = new UidMap();
+    sp<AlarmMonitor> anomalyAlarmMonitor;
+    sp<AlarmMonitor> subscriberAlarmMonitor;
+    StatsLogProcessor p(m, anomalyAlarmMonitor, subscriberAlarmMonitor, 0,
+                        [](const ConfigKey& key) { return true; });
+    ConfigKey key(3, 4);
+    StatsdConfig config = MakeScreenOnCountConfig();
+    config.set_uid_map_delta_snapshots(true);
+    p.OnConfigUpdated(0, key, config);
+    m->updateMap(1, {1, 2}, {1, 2}, {String16("p1"), String16("p2")});
+
+    vector<uint8_t> bytes;
+    ConfigMetricsReportList output;
+    p.onDumpReport(key, 2, true /* include_current_partial_bucket */, ADB_DUMP, &bytes);
+    output.ParseFromArray(bytes.data(), bytes.size());
+    ASSERT_EQ(1, output.reports_size());
+    ASSERT_EQ(1, output.reports(0).uid_map().snapshots_size());
+    EXPECT_FALSE(output.reports(0).uid_map().snapshots(0).has_base_snapshot_id());
+
+    // The report of the old config is saved on update, after the new config is in place.
+    p.OnConfigUpdated(3, key, config);
+
+    bytes.clear();
+    p.onDumpReport(key, 4, true /* include_current_partial_bucket */, ADB_DUMP, &bytes);
+    output.ParseFromArray(bytes.data(), bytes.size());
+    ASSERT_EQ(2, output.reports_size());
+    // The old config's report is a delta of its last one.
+    ASSERT_EQ(1, output.reports(0).uid_map().snapshots_size());
+    EXPECT_TRUE(output.reports(0).uid_map().snapshots(0).has_base_snapshot_id());
+    // The new config starts with everything.
+    ASSERT_EQ(1, output.reports(1).uid_map().snapshots_size());
+    EXPECT_FALSE(output.reports(1).uid_map().snapshots(0).has_base_snapshot_id());
+    EXPECT_EQ(2, output.reports(1).uid_map().snapshots(0).package_info_size());
+}
+
 #else
 GTEST_LOG_(INFO) << "This test does nothing.\n";
 #endif
@@ -193,7 +193,7 @@ TEST(UidMapTest, TestOutputIncludesAtLeastOneSnapshot) {
     m.mLastUpdatePerConfigKey[config1] = 2;
 
     ProtoOutputStream proto;
-    m.appendUidMap(3, config1, nullptr, &proto);
+    m.appendUidMap(3, config1, nullptr, nullptr, &proto);
 
     // Check there's still a uidmap attached this one.
     UidMapping results;
@@ -216,7 +216,7 @@ TEST(UidMapTest, TestRemovedAppRetained) {
     m.removeApp(2, String16(kApp2.c_str()), 1000);
 
     ProtoOutputStream proto;
-    m.appendUidMap(3, config1, nullptr, &proto);
+    m.appendUidMap(3, config1, nullptr, nullptr, &proto);
 
     // Snapshot should still contain this item as deleted.
     UidMapping results;
@@ -244,7 +244,7 @@ TEST(UidMapTest, TestRemovedAppOverGuardrail) {
     // First, verify that we have the expected number of items.
     UidMapping results;
     ProtoOutputStream proto;
-    m.appendUidMap(3, config1, nullptr, &proto);
+    m.appendUidMap(3, config1, nullptr, nullptr, &proto);
     protoOutputStreamToUidMapping(&proto, &results);
     EXPECT_EQ(maxDeletedApps + 10, results.snapshots(0).package_info_size());
 
@@ -255,7 +255,7 @@ TEST(UidMapTest, TestRemovedAppOverGuardrail) {
     }
 
     proto.clear();
-    m.appendUidMap(5, config1, nullptr, &proto);
+    m.appendUidMap(5, config1, nullptr, nullptr, &proto);
     // Snapshot drops the first nine items.
     protoOutputStreamToUidMapping(&proto, &results);
     EXPECT_EQ(maxDeletedApps, results.snapshots(0).package_info_size());
@@ -281,14 +281,14 @@ TEST(UidMapTest, TestClearingOutput) {
     m.updateMap(1, uids, versions, apps);
 
     ProtoOutputStream proto;
-    m.appendUidMap(2, config1, nullptr, &proto);
+    m.appendUidMap(2, config1, nullptr, nullptr, &proto);
     UidMapping results;
     protoOutputStreamToUidMapping(&proto, &results);
     EXPECT_EQ(1, results.snapshots_size());
 
     // We have to keep at least one snapshot in memory at all times.
     proto.clear();
-    m.appendUidMap(2, config1, nullptr, &proto);
+    m.appendUidMap(2, config1, nullptr, nullptr, &proto);
     protoOutputStreamToUidMapping(&proto, &results);
     EXPECT_EQ(1, results.snapshots_size());
 
@@ -297,7 +297,7 @@ TEST(UidMapTest, TestClearingOutput) {
     m.updateApp(5, String16(kApp1.c_str()), 1000, 40);
     EXPECT_EQ(1U, m.mChanges.size());
     proto.clear();
-    m.appendUidMap(6, config1, nullptr, &proto);
+    m.appendUidMap(6, config1, nullptr, nullptr, &proto);
     protoOutputStreamToUidMapping(&proto, &results);
     EXPECT_EQ(1, results.snapshots_size());
     EXPECT_EQ(1, results.changes_size());
@@ -309,14 +309,14 @@ TEST(UidMapTest, TestClearingOutput) {
 
     // We still can't remove anything.
     proto.clear();
-    m.appendUidMap(8, config1, nullptr, &proto);
+    m.appendUidMap(8, config1, nullptr, nullptr, &proto);
     protoOutputStreamToUidMapping(&proto, &results);
     EXPECT_EQ(1, results.snapshots_size());
     EXPECT_EQ(1, results.changes_size());
     EXPECT_EQ(2U, m.mChanges.size());
 
     proto.clear();
-    m.appendUidMap(9, config2, nullptr, &proto);
+    m.appendUidMap(9, config2, nullptr, nullptr, &proto);
     protoOutputStreamToUidMapping(&proto, &results);
     EXPECT_EQ(1, results.snapshots_size());
     EXPECT_EQ(2, results.changes_size());
@@ -343,10 +343,10 @@ TEST(UidMapTest, TestMemoryComputed) {
 
     ProtoOutputStream proto;
     vector<uint8_t> bytes;
-    m.appendUidMap(2, config1, nullptr, &proto);
+    m.appendUidMap(2, config1, nullptr, nullptr, &proto);
     size_t prevBytes = m.mBytesUsed;
 
-    m.appendUidMap(4, config1, nullptr, &proto);
+    m.appendUidMap(4, config1, nullptr, nullptr, &proto);
     EXPECT_TRUE(m.mBytesUsed < prevBytes);
 }
 
@@ -378,6 +378,83 @@ TEST(UidMapTest, TestMemoryGuardrail) {
     EXPECT_EQ(1U, m.mChanges.size());
 }
 
+TEST(UidMapTest, TestDeltaSnapshots) {
+    UidMap m;
+    ConfigKey config1(1, StringToId("config1"));
+    ConfigKey config2(1, StringToId("config2"));
+    m.OnConfigUpdated(config1);
+    m.OnConfigUpdated(config2);
+    vector<int32_t> uids;
+    vector<int64_t> versions;
+    vector<String16> apps;
+    uids.push_back(1000);
+    uids.push_back(1000);
+    apps.push_back(String16(kApp1.c_str()));
+    apps.push_back(String16(kApp2.c_str()));
+    versions.push_back(4);
+    versions.push_back(5);
+    m.updateMap(1, uids, versions, apps);
+    int64_t lastSnapshotId1 = UidMap::kNoSnapshotId;
+    int64_t lastSnapshotId2 = UidMap::kNoSnapshotId;
+
+    // The first output of a config has nothing to be a delta of.
+    ProtoOutputStream proto;
+    m.appendUidMap(2, config1, nullptr, &lastSnapshotId1, &proto);
+    UidMapping results;
+    protoOutputStreamToUidMapping(&proto, &results);
+    ASSERT_EQ(1, results.snapshots_size());
+    EXPECT_FALSE(results.snapshots(0).has_base_snapshot_id());
+    EXPECT_EQ(2, results.snapshots(0).package_info_size());
+    int64_t firstSnapshotId = results.snapshots(0).snapshot_id();
+
+    // Only the updated app is sent next.
+    m.updateApp(3, String16(kApp1.c_str()), 1000, 40);
+    ProtoOutputStream proto2;
+    m.appendUidMap(4, config1, nullptr, &lastSnapshotId1, &proto2);
+    protoOutputStreamToUidMapping(&proto2, &results);
+    ASSERT_EQ(1, results.snapshots_size());
+    EXPECT_EQ(firstSnapshotId, results.snapshots(0).base_snapshot_id());
+    ASSERT_EQ(1, results.snapshots(0).package_info_size());
+    EXPECT_EQ(kApp1, results.snapshots(0).package_info(0).name());
+    EXPECT_EQ(40, results.snapshots(0).package_info(0).version());
+
+    // Nothing changed since then.
+    int64_t secondSnapshotId = results.snapshots(0).snapshot_id();
+    ProtoOutputStream proto3;
+    m.appendUidMap(5, config1, nullptr, &lastSnapshotId1, &proto3);
+    protoOutputStreamToUidMapping(&proto3, &results);
+    ASSERT_EQ(1, results.snapshots_size());
+    EXPECT_EQ(secondSnapshotId, results.snapshots(0).base_snapshot_id());
+    EXPECT_EQ(0, results.snapshots(0).package_info_size());
+
+    // Other configs still get everything on their first output.
+    ProtoOutputStream proto4;
+    m.appendUidMap(6, config2, nullptr, &lastSnapshotId2, &proto4);
+    protoOutputStreamToUidMapping(&proto4, &results);
+    ASSERT_EQ(1, results.snapshots_size());
+    EXPECT_FALSE(results.snapshots(0).has_base_snapshot_id());
+    EXPECT_EQ(2, results.snapshots(0).package_info_size());
+
+    // A new map replaces the old one, so it's sent in full.
+    m.updateMap(7, uids, versions, apps);
+    ProtoOutputStream proto5;
+    m.appendUidMap(8, config1, nullptr, &lastSnapshotId1, &proto5);
+    protoOutputStreamToUidMapping(&proto5, &results);
+    ASSERT_EQ(1, results.snapshots_size());
+    EXPECT_FALSE(results.snapshots(0).has_base_snapshot_id());
+    EXPECT_EQ(2, results.snapshots(0).package_info_size());
+
+    // So is the first output of an updated config, whose baseline starts over.
+    int64_t updatedLastSnapshotId = UidMap::kNoSnapshotId;
+    m.OnConfigUpdated(config1);
+    ProtoOutputStream proto6;
+    m.appendUidMap(9, config1, nullptr, &updatedLastSnapshotId, &proto6);
+    protoOutputStreamToUidMapping(&proto6, &results);
+    ASSERT_EQ(1, results.snapshots_size());
+    EXPECT_FALSE(results.snapshots(0).has_base_snapshot_id());
+    EXPECT_EQ(2, results.snapshots(0).package_info_size());
+}
+
 #else
 GTEST_LOG_(INFO) << "This test does nothing.\n";
 #endif
@@ -643,6 +643,67 @@ TEST(SimpleConditionTrackerTest, TestStopAll) {
     }
 }
 
+TEST(SimpleConditionTrackerTest, TestPartialLinkIndex) {
+    // Sliced by uid and wake lock tag, queried by uid only.
+    SimplePredicate simplePredicate = getWakeLockHeldCondition(
+            true /*nesting*/, true /*default to false*/, true /*output slice by uid*/,
+            Position::FIRST);
+    simplePredicate.mutable_dimensions()->add_child()->set_field(2);
+    string conditionName = "WL_HELD_BY_UID_AND_TAG";
+
+    unordered_map<int64_t, int> trackerNameIndexMap;
+    trackerNameIndexMap[StringToId("WAKE_LOCK_ACQUIRE")] = 0;
+    trackerNameIndexMap[StringToId("WAKE_LOCK_RELEASE")] = 1;
+    trackerNameIndexMap[StringToId("RELEASE_ALL")] = 2;
+
+    SimpleConditionTracker conditionTracker(kConfigKey, StringToId(conditionName),
+                                            0 /*condition tracker index*/, simplePredicate,
+                                            trackerNameIndexMap);
+
+    vector<sp<ConditionTracker>> allPredicates;
+    vector<Matcher> dimensionInCondition;
+    std::unordered_set<HashableDimensionKey> dimensionKeys;
+    vector<ConditionState> conditionCache(1, ConditionState::kNotEvaluated);
+    vector<bool> changedCache(1, false);
+
+    auto evaluate = [&](int uid, const string& tag, bool acquire) {
+        LogEvent event(1 /*tagId*/, 0 /*timestamp*/);
+        makeWakeLockEvent(&event, {uid}, tag, acquire ? 1 : 0);
+        vector<MatchingState> matcherState(3, MatchingState::kNotMatched);
+        matcherState[acquire ? 0 : 1] = MatchingState::kMatched;
+        conditionCache[0] = ConditionState::kNotEvaluated;
+        conditionTracker.evaluateCondition(event, matcherState, allPredicates, conditionCache,
+                                           changedCache);
+    };
+    auto query = [&](int uid) {
+        conditionCache[0] = ConditionState::kNotEvaluated;
+        conditionTracker.isConditionMet(getWakeLockQueryKey(Position::FIRST, {uid}, conditionName),
+                                        allPredicates, dimensionInCondition, false,
+                                        true /*partial link*/, conditionCache, dimensionKeys);
+        return conditionCache[0];
+    };
+
+    evaluate(111, "wl1", true);
+    EXPECT_EQ(ConditionState::kTrue, query(111));
+    EXPECT_EQ(ConditionState::kFalse, query(222));
+    // The index is built by the first query, and kept up to date after that.
+    ASSERT_EQ(1UL, conditionTracker.mPartialKeyIndexes.size());
+    EXPECT_EQ(1UL, conditionTracker.mPartialKeyIndexes[0].slices.size());
+
+    evaluate(111, "wl2", true);
+    evaluate(222, "wl1", true);
+    EXPECT_EQ(3UL, conditionTracker.mSlicedConditionState.size());
+    EXPECT_EQ(2UL, conditionTracker.mPartialKeyIndexes[0].slices.size());
+    EXPECT_EQ(ConditionState::kTrue, query(222));
+
+    evaluate(111, "wl1", false);
+    EXPECT_EQ(ConditionState::kTrue, query(111));
+    evaluate(111, "wl2", false);
+    EXPECT_EQ(ConditionState::kFalse, query(111));
+    EXPECT_EQ(1UL, conditionTracker.mPartialKeyIndexes[0].slices.size());
+    EXPECT_EQ(1UL, conditionTracker.mPartialKeyIndexes.size());
+}
+
 }  // namespace statsd
 }  // namespace os
 }  // namespace android
@@ -17,6 +17,7 @@
 #include "tests/statsd_test_util.h"
 
 #include <gtest/gtest.h>
+#include <thread>
 #include <vector>
 
 #ifdef __ANDROID__
@@ -102,6 +103,27 @@ TEST(StatsdStatsTest, TestConfigRemove) {
     EXPECT_TRUE(configReport2.has_deletion_time_sec());
 }
 
+TEST(StatsdStatsTest, TestBusyConfigEventDropped) {
+    StatsdStats stats;
+    ConfigKey key(0, 12345);
+    stats.noteConfigReceived(key, 2, 3, 4, 5, {}, true);
+    stats.noteBusyConfigEventDropped(key);
+    stats.noteBusyConfigEventDropped(key);
+
+    vector<uint8_t> output;
+    stats.dumpStats(&output, true);
+    StatsdStatsReport report;
+    EXPECT_TRUE(report.ParseFromArray(&output[0], output.size()));
+    EXPECT_EQ(1, report.config_stats_size());
+    EXPECT_EQ(2, report.config_stats(0).busy_config_events_dropped());
+
+    // The count is reset with the rest of the stats.
+    stats.dumpStats(&output, false);
+    EXPECT_TRUE(report.ParseFromArray(&output[0], output.size()));
+    EXPECT_EQ(1, report.config_stats_size());
+    EXPECT_FALSE(report.config_stats(0).has_busy_config_events_dropped());
+}
+
 TEST(StatsdStatsTest, TestSubStats) {
     StatsdStats stats;
     ConfigKey key(0, 12345);
@@ -320,6 +342,116 @@ TEST(StatsdStatsTest, TestSystemServerCrash) {
     EXPECT_EQ(StatsdStats::kMaxSystemServerRestarts + 1, report.system_restart_sec(maxCount - 1));
 }
 
+TEST(StatsdStatsTest, TestLogEventBatch) {
+    StatsdStats stats;
+    vector<uint8_t> output;
+    stats.dumpStats(&output, false);
+    StatsdStatsReport report;
+    EXPECT_TRUE(report.ParseFromArray(&output[0], output.size()));
+    EXPECT_FALSE(report.has_log_event_batch_stats());
+
+    stats.noteLogEventBatch(3);
+    stats.noteLogEventBatch(10);
+    stats.noteLogEventBatch(1);
+    output.clear();
+    stats.dumpStats(&output, true /*reset stats*/);
+    EXPECT_TRUE(report.ParseFromArray(&output[0], output.size()));
+    EXPECT_EQ(3, report.log_event_batch_stats().batches());
+    EXPECT_EQ(14, report.log_event_batch_stats().events());
+    EXPECT_EQ(10, report.log_event_batch_stats().max_batch_size());
+
+    EXPECT_EQ(0, stats.mLogEventBatchStats.batches);
+    EXPECT_EQ(0, stats.mLogEventBatchStats.events);
+    EXPECT_EQ(0, stats.mLogEventBatchStats.maxBatchSize);
+}
+
+TEST(StatsdStatsTest, TestCountersFromManyThreads) {
+    StatsdStats stats;
+    ConfigKey key(0, 12345);
+    stats.noteConfigReceived(key, 2, 3, 4, 5, {}, true);
+
+    const int threadCount = 4;
+    const int iterations = 1000;
+    vector<std::thread> threads;
+    for (int t = 0; t < threadCount; t++) {
+        threads.emplace_back([&stats, &key, t]() {
+            for (int i = 0; i < iterations; i++) {
+                stats.noteAtomLogged(android::util::SENSOR_STATE_CHANGED, 0);
+                stats.noteMatcherMatched(key, StringToId("matcher1"));
+                stats.notePull(android::util::WIFI_BYTES_TRANSFER);
+            }
+            stats.noteMetricDimensionSize(key, StringToId("metric1"), 100 + t);
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    // One shard per thread that reported, nothing from this thread yet.
+    EXPECT_EQ((size_t)threadCount, stats.mShards.size());
+
+    vector<uint8_t> output;
+    stats.dumpStats(&output, false);
+    StatsdStatsReport report;
+    EXPECT_TRUE(report.ParseFromArray(&output[0], output.size()));
+
+    EXPECT_EQ(1, report.atom_stats_size());
+    EXPECT_EQ(android::util::SENSOR_STATE_CHANGED, report.atom_stats(0).tag());
+    EXPECT_EQ(threadCount * iterations, report.atom_stats(0).count());
+
+    EXPECT_EQ(1, report.config_stats_size());
+    const auto& configReport = report.config_stats(0);
+    EXPECT_EQ(1, configReport.matcher_stats_size());
+    EXPECT_EQ(threadCount * iterations, configReport.matcher_stats(0).matched_times());
+    EXPECT_EQ(1, configReport.metric_stats_size());
+    EXPECT_EQ(100 + threadCount - 1, configReport.metric_stats(0).max_tuple_counts());
+
+    EXPECT_EQ(1, report.pulled_atom_stats_size());
+    EXPECT_EQ(threadCount * iterations, report.pulled_atom_stats(0).total_pull());
+    // The threads are gone, so their shards were dropped once merged.
+    EXPECT_EQ(0UL, stats.mShards.size());
+
+    // Matches noted before the removal go to the ice box, the ones after it are dropped.
+    stats.noteMatcherMatched(key, StringToId("matcher1"));
+    stats.noteConfigRemoved(key);
+    stats.noteMatcherMatched(key, StringToId("matcher1"));
+    output.clear();
+    stats.dumpStats(&output, false);
+    EXPECT_TRUE(report.ParseFromArray(&output[0], output.size()));
+    EXPECT_EQ(1, report.config_stats_size());
+    EXPECT_EQ(threadCount * iterations + 1,
+              report.config_stats(0).matcher_stats(0).matched_times());
+}
+
+TEST(StatsdStatsTest, TestPullTimeHistogram) {
+    StatsdStats stats;
+    stats.notePull(android::util::WIFI_BYTES_TRANSFER);
+    stats.notePullTime(android::util::WIFI_BYTES_TRANSFER, 500000);        // 0.5ms
+    stats.notePull(android::util::WIFI_BYTES_TRANSFER);
+    stats.notePullTime(android::util::WIFI_BYTES_TRANSFER, 3000000);       // 3ms
+    stats.notePull(android::util::WIFI_BYTES_TRANSFER);
+    stats.notePullTime(android::util::WIFI_BYTES_TRANSFER, 10 * NS_PER_SEC);
+    stats.notePull(android::util::WIFI_BYTES_TRANSFER);
+    stats.notePullFromCache(android::util::WIFI_BYTES_TRANSFER);
+
+    vector<uint8_t> output;
+    stats.dumpStats(&output, false);
+    StatsdStatsReport report;
+    EXPECT_TRUE(report.ParseFromArray(&output[0], output.size()));
+    ASSERT_EQ(1, report.pulled_atom_stats_size());
+    const auto& pullStats = report.pulled_atom_stats(0);
+    EXPECT_EQ(4, pullStats.total_pull());
+    EXPECT_EQ(1, pullStats.total_pull_from_cache());
+    EXPECT_EQ(10 * NS_PER_SEC, pullStats.max_pull_time_nanos());
+    EXPECT_EQ((500000 + 3000000 + 10 * NS_PER_SEC) / 3, pullStats.average_pull_time_nanos());
+    ASSERT_EQ(StatsdStats::kPullTimeHistogramBuckets, pullStats.pull_time_histogram_size());
+    EXPECT_EQ(1, pullStats.pull_time_histogram(0));
+    EXPECT_EQ(1, pullStats.pull_time_histogram(1));
+    for (int i = 2; i < StatsdStats::kPullTimeHistogramBuckets - 1; i++) {
+        EXPECT_EQ(0, pullStats.pull_time_histogram(i));
+    }
+    EXPECT_EQ(1, pullStats.pull_time_histogram(StatsdStats::kPullTimeHistogramBuckets - 1));
+}
+
 }  // namespace statsd
 }  // namespace os
 }  // namespace android
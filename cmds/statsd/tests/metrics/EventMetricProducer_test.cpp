@@ -12,7 +12,9 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include "src/guardrail/StatsdStats.h"
 #include "src/metrics/EventMetricProducer.h"
+#include "src/storage/StorageManager.h"
 #include "metrics_test_helper.h"
 #include "tests/statsd_test_util.h"
 
@@ -23,6 +25,7 @@
 
 using namespace testing;
 using android::sp;
+using android::util::ProtoOutputStream;
 using std::set;
 using std::unordered_map;
 using std::vector;
@@ -126,6 +129,135 @@ TEST(EventMetricProducerTest, TestEventsWithSlicedCondition) {
     // eventProducer.onDumpReport();
 }
 
+TEST(EventMetricProducerTest, TestSpilledEventsAreDumpedInOrder) {
+    int64_t bucketStartTimeNs = 10000000000;
+    const int eventCount = 3000;
+
+    EventMetric metric;
+    metric.set_id(2);
+
+    sp<MockConditionWizard> wizard = new NaggyMock<MockConditionWizard>();
+    EventMetricProducer eventProducer(kConfigKey, metric, -1 /*-1 meaning no condition*/, wizard,
+                                      bucketStartTimeNs);
+
+    for (int i = 0; i < eventCount; i++) {
+        auto event = CreateScreenBrightnessChangedEvent(i, bucketStartTimeNs + i + 1);
+        eventProducer.onMatchedLogEvent(1 /*matcher index*/, *event);
+    }
+    // Most of the events are on disk.
+    const size_t chunkBytes = StatsdStats::kEventMetricSpillChunkBytes;
+    EXPECT_GT(eventProducer.mSpilledBytes, chunkBytes);
+    EXPECT_LT(eventProducer.byteSize(), chunkBytes);
+
+    ProtoOutputStream output;
+    std::set<string> strSet;
+    eventProducer.onDumpReport(bucketStartTimeNs + eventCount + 1,
+                               true /* include current partial bucket */, &strSet, &output);
+    EXPECT_EQ(0UL, eventProducer.mSpilledBytes);
+
+    vector<uint8_t> bytes(output.size());
+    size_t pos = 0;
+    auto iter = output.data();
+    while (iter.readBuffer() != NULL) {
+        size_t toRead = iter.currentToRead();
+        std::memcpy(&bytes[pos], iter.readBuffer(), toRead);
+        pos += toRead;
+        iter.rp()->move(toRead);
+    }
+    StatsLogReport report;
+    EXPECT_TRUE(report.ParseFromArray(bytes.data(), bytes.size()));
+    EXPECT_EQ(2, report.metric_id());
+    ASSERT_EQ(eventCount, report.event_metrics().data_size());
+    for (int i = 0; i < eventCount; i++) {
+        EXPECT_EQ(i, report.event_metrics().data(i).atom().screen_brightness_changed().level());
+    }
+}
+
+TEST(EventMetricProducerTest, TestSpilledEventsAreDeletedWithConfig) {
+    int64_t bucketStartTimeNs = 10000000000;
+
+    EventMetric metric;
+    metric.set_id(3);
+
+    sp<MockConditionWizard> wizard = new NaggyMock<MockConditionWizard>();
+    EventMetricProducer eventProducer(kConfigKey, metric, -1 /*-1 meaning no condition*/, wizard,
+                                      bucketStartTimeNs);
+    for (int i = 0; i < 3000; i++) {
+        auto event = CreateScreenBrightnessChangedEvent(i, bucketStartTimeNs + i + 1);
+        eventProducer.onMatchedLogEvent(1 /*matcher index*/, *event);
+    }
+    ASSERT_GT(eventProducer.mSpilledBytes, 0UL);
+
+    int chunkCount = 0;
+    auto countChunk = [&chunkCount](const char*, size_t) { chunkCount++; };
+    StorageManager::readEventMetricChunks(kConfigKey, 3, eventProducer.mSpillId, countChunk);
+    EXPECT_GT(chunkCount, 0);
+
+    // Another config's chunks are left alone.
+    StorageManager::deleteEventMetricChunks(ConfigKey(1, 12345));
+    chunkCount = 0;
+    StorageManager::readEventMetricChunks(kConfigKey, 3, eventProducer.mSpillId, countChunk);
+    EXPECT_GT(chunkCount, 0);
+
+    StorageManager::deleteEventMetricChunks(kConfigKey);
+    chunkCount = 0;
+    StorageManager::readEventMetricChunks(kConfigKey, 3, eventProducer.mSpillId, countChunk);
+    EXPECT_EQ(0, chunkCount);
+}
+
+TEST(EventMetricProducerTest, TestProducersOfSameMetricKeepOwnChunks) {
+    int64_t bucketStartTimeNs = 10000000000;
+    const int eventCount = 3000;
+
+    EventMetric metric;
+    metric.set_id(4);
+
+    // As after a config update, the old producer is dumped after the new one started spilling.
+    sp<MockConditionWizard> wizard = new NaggyMock<MockConditionWizard>();
+    auto oldProducer = std::make_unique<EventMetricProducer>(
+            kConfigKey, metric, -1 /*-1 meaning no condition*/, wizard, bucketStartTimeNs);
+    EventMetricProducer newProducer(kConfigKey, metric, -1 /*-1 meaning no condition*/, wizard,
+                                    bucketStartTimeNs);
+    for (int i = 0; i < eventCount; i++) {
+        auto event = CreateScreenBrightnessChangedEvent(i, bucketStartTimeNs + i + 1);
+        oldProducer->onMatchedLogEvent(1 /*matcher index*/, *event);
+    }
+    for (int i = 0; i < eventCount; i++) {
+        auto event = CreateScreenBrightnessChangedEvent(eventCount + i,
+                                                        bucketStartTimeNs + eventCount + i + 1);
+        newProducer.onMatchedLogEvent(1 /*matcher index*/, *event);
+    }
+    ASSERT_GT(oldProducer->mSpilledBytes, 0UL);
+    ASSERT_GT(newProducer.mSpilledBytes, 0UL);
+
+    ProtoOutputStream output;
+    std::set<string> strSet;
+    oldProducer->onDumpReport(bucketStartTimeNs + 2 * eventCount + 1,
+                              true /* include current partial bucket */, &strSet, &output);
+    vector<uint8_t> bytes(output.size());
+    size_t pos = 0;
+    auto iter = output.data();
+    while (iter.readBuffer() != NULL) {
+        size_t toRead = iter.currentToRead();
+        std::memcpy(&bytes[pos], iter.readBuffer(), toRead);
+        pos += toRead;
+        iter.rp()->move(toRead);
+    }
+    StatsLogReport report;
+    EXPECT_TRUE(report.ParseFromArray(bytes.data(), bytes.size()));
+    ASSERT_EQ(eventCount, report.event_metrics().data_size());
+    for (int i = 0; i < eventCount; i++) {
+        EXPECT_EQ(i, report.event_metrics().data(i).atom().screen_brightness_changed().level());
+    }
+
+    // The old producer going away leaves the new one's chunks alone.
+    oldProducer.reset();
+    int chunkCount = 0;
+    StorageManager::readEventMetricChunks(kConfigKey, 4, newProducer.mSpillId,
+                                          [&chunkCount](const char*, size_t) { chunkCount++; });
+    EXPECT_GT(chunkCount, 0);
+}
+
 }  // namespace statsd
 }  // namespace os
 }  // namespace android
@@ -366,7 +366,7 @@ TEST(GaugeMetricProducerTest, TestWithSlicedCondition) {
                         int pos[] = {1, 0, 0};
                         Field f(conditionTag, pos, 0);
                         HashableDimensionKey key;
-                        key.mutableValues()->emplace_back(f, Value((int32_t)1000000));
+                        key.addValue(FieldValue(f, Value((int32_t)1000000)));
                         dimensionKeySet->insert(key);
 
                         return ConditionState::kTrue;
@@ -0,0 +1,203 @@
+// Copyright (C) 2018 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/storage/StorageManager.h"
+#include "frameworks/base/cmds/statsd/src/stats_log.pb.h"
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <android-base/test_utils.h>
+#include <dirent.h>
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#ifdef __ANDROID__
+
+namespace android {
+namespace os {
+namespace statsd {
+
+using android::base::StringPrintf;
+using std::vector;
+
+static vector<uint8_t> makeReport(int64_t elapsedNs, size_t stringSize = 0) {
+    ConfigMetricsReport report;
+    report.set_current_report_elapsed_nanos(elapsedNs);
+    if (stringSize > 0) {
+        report.add_strings(string(stringSize, 'x'));
+    }
+    string bytes;
+    report.SerializeToString(&bytes);
+    return vector<uint8_t>(bytes.begin(), bytes.end());
+}
+
+static ConfigMetricsReportList toReportList(ProtoOutputStream* proto) {
+    string bytes;
+    auto iter = proto->data();
+    while (iter.readBuffer() != NULL) {
+        size_t toRead = iter.currentToRead();
+        bytes.append(iter.readBuffer(), toRead);
+        iter.rp()->move(toRead);
+    }
+    ConfigMetricsReportList reports;
+    EXPECT_TRUE(reports.ParseFromString(bytes));
+    return reports;
+}
+
+static int countFiles(const char* path) {
+    std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(path), closedir);
+    int count = 0;
+    dirent* de;
+    while ((de = readdir(dir.get()))) {
+        if (de->d_name[0] != '.') count++;
+    }
+    return count;
+}
+
+static void appendTornReport(const string& file) {
+    // A record header that promises more bytes than the crash let through.
+    uint32_t recordHeader[2] = {100, 0};
+    FILE* out = fopen(file.c_str(), "ab");
+    ASSERT_NE(nullptr, out);
+    fwrite(recordHeader, sizeof(recordHeader), 1, out);
+    fwrite("abc", 3, 1, out);
+    fclose(out);
+}
+
+TEST(StorageManagerTest, TestReportSegments) {
+    TemporaryDir dir;
+    // Segments older than StatsdStats::kMaxAgeSecond would be trimmed.
+    const int64_t now = time(nullptr);
+    ConfigKey key(1, 2345);
+    ConfigKey otherKey(11, 2345);
+
+    EXPECT_TRUE(StorageManager::writeConfigMetricsReport(dir.path, key, now, makeReport(1)));
+    EXPECT_TRUE(StorageManager::writeConfigMetricsReport(dir.path, otherKey, now, makeReport(9)));
+    // Appended to the first segment.
+    EXPECT_TRUE(StorageManager::writeConfigMetricsReport(dir.path, key, now + 1,
+                                                         makeReport(2, 600 * 1024)));
+    EXPECT_EQ(2, countFiles(dir.path));
+    // Does not fit into the first segment any more.
+    EXPECT_TRUE(StorageManager::writeConfigMetricsReport(dir.path, key, now + 2,
+                                                         makeReport(3, 600 * 1024)));
+    EXPECT_EQ(3, countFiles(dir.path));
+
+    ProtoOutputStream proto;
+    StorageManager::appendConfigMetricsReport(dir.path, key, &proto);
+    ConfigMetricsReportList reports = toReportList(&proto);
+    ASSERT_EQ(3, reports.reports_size());
+    EXPECT_EQ(1, reports.reports(0).current_report_elapsed_nanos());
+    EXPECT_EQ(2, reports.reports(1).current_report_elapsed_nanos());
+    EXPECT_EQ(3, reports.reports(2).current_report_elapsed_nanos());
+
+    // Only the segment of the other config is left.
+    EXPECT_EQ(1, countFiles(dir.path));
+
+    // The next report starts a new segment.
+    EXPECT_TRUE(StorageManager::writeConfigMetricsReport(dir.path, key, now + 3, makeReport(4)));
+    EXPECT_EQ(2, countFiles(dir.path));
+}
+
+TEST(StorageManagerTest, TestRolloversWithinOneSecond) {
+    TemporaryDir dir;
+    const int64_t now = time(nullptr);
+    ConfigKey key(1, 2345);
+
+    // Each report fills a segment, so every write starts a new one within the same second.
+    for (int i = 1; i <= 3; i++) {
+        EXPECT_TRUE(StorageManager::writeConfigMetricsReport(dir.path, key, now,
+                                                             makeReport(i, 600 * 1024)));
+    }
+    EXPECT_EQ(3, countFiles(dir.path));
+
+    ProtoOutputStream proto;
+    StorageManager::appendConfigMetricsReport(dir.path, key, &proto);
+    ConfigMetricsReportList reports = toReportList(&proto);
+    ASSERT_EQ(3, reports.reports_size());
+    EXPECT_EQ(1, reports.reports(0).current_report_elapsed_nanos());
+    EXPECT_EQ(2, reports.reports(1).current_report_elapsed_nanos());
+    EXPECT_EQ(3, reports.reports(2).current_report_elapsed_nanos());
+    EXPECT_EQ(0, countFiles(dir.path));
+}
+
+TEST(StorageManagerTest, TestTornReportIsDropped) {
+    TemporaryDir dir;
+    const int64_t now = time(nullptr);
+    ConfigKey key(1, 2345);
+    const string segment = StringPrintf("%s/%lld_1_2345", dir.path, (long long)now);
+
+    EXPECT_TRUE(StorageManager::writeConfigMetricsReport(dir.path, key, now, makeReport(1)));
+    appendTornReport(segment);
+    // The torn report is cut off before the next one is appended.
+    EXPECT_TRUE(StorageManager::writeConfigMetricsReport(dir.path, key, now + 1, makeReport(2)));
+    appendTornReport(segment);
+
+    ProtoOutputStream proto;
+    StorageManager::appendConfigMetricsReport(dir.path, key, &proto);
+    ConfigMetricsReportList reports = toReportList(&proto);
+    ASSERT_EQ(2, reports.reports_size());
+    EXPECT_EQ(1, reports.reports(0).current_report_elapsed_nanos());
+    EXPECT_EQ(2, reports.reports(1).current_report_elapsed_nanos());
+    EXPECT_EQ(0, countFiles(dir.path));
+}
+
+TEST(StorageManagerTest, TestLegacyReportFile) {
+    TemporaryDir dir;
+    const int64_t now = time(nullptr);
+    ConfigKey key(1, 2345);
+
+    // A report saved by an older build, as a plain ConfigMetricsReport.
+    vector<uint8_t> legacyReport = makeReport(1);
+    ASSERT_TRUE(android::base::WriteStringToFile(
+            string(legacyReport.begin(), legacyReport.end()),
+            StringPrintf("%s/%lld_1_2345", dir.path, (long long)now - 10)));
+    EXPECT_TRUE(StorageManager::writeConfigMetricsReport(dir.path, key, now, makeReport(2)));
+
+    ProtoOutputStream proto;
+    StorageManager::appendConfigMetricsReport(dir.path, key, &proto);
+    ConfigMetricsReportList reports = toReportList(&proto);
+    ASSERT_EQ(2, reports.reports_size());
+    EXPECT_EQ(1, reports.reports(0).current_report_elapsed_nanos());
+    EXPECT_EQ(2, reports.reports(1).current_report_elapsed_nanos());
+}
+
+TEST(StorageManagerTest, TestUnreadableLegacyFileIsDropped) {
+    TemporaryDir dir;
+    const int64_t now = time(nullptr);
+    ConfigKey key(1, 2345);
+
+    // Neither a segment nor a report, like a segment an older build started and crashed on.
+    ASSERT_TRUE(android::base::WriteStringToFile(
+            "\xff\xff\xff", StringPrintf("%s/%lld_1_2345", dir.path, (long long)now - 10)));
+    EXPECT_TRUE(StorageManager::writeConfigMetricsReport(dir.path, key, now, makeReport(1)));
+    // New segments are renamed into place, so no temporary file is left behind.
+    EXPECT_NE(0, access(StringPrintf("%s/.segment.tmp", dir.path).c_str(), F_OK));
+
+    ProtoOutputStream proto;
+    StorageManager::appendConfigMetricsReport(dir.path, key, &proto);
+    ConfigMetricsReportList reports = toReportList(&proto);
+    ASSERT_EQ(1, reports.reports_size());
+    EXPECT_EQ(1, reports.reports(0).current_report_elapsed_nanos());
+    EXPECT_EQ(0, countFiles(dir.path));
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
+#else
+GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif
@@ -30,6 +30,8 @@
 #include <string.h>
 #include <unistd.h>
 
+#include <vector>
+
 #include <androidfw/CursorWindow.h>
 
 #include <sqlite3.h>
@@ -581,18 +583,11 @@ enum CopyRowResult {
 };
 
 static CopyRowResult copyRow(JNIEnv* env, CursorWindow* window,
-        sqlite3_stmt* statement, int numColumns, int startPos, int addedRows) {
-    // Allocate a new field directory for the row.
-    status_t status = window->allocRow();
-    if (status) {
-        LOG_WINDOW("Failed allocating fieldDir at startPos %d row %d, error=%d",
-                startPos, addedRows, status);
-        return CPR_FULL;
-    }
-
-    // Pack the row into the window.
-    CopyRowResult result = CPR_OK;
+        sqlite3_stmt* statement, int numColumns, int startPos, int addedRows,
+        CursorWindow::FieldValue* values) {
+    // Collect the row's values, then pack the row into the window in one go.
     for (int i = 0; i < numColumns; i++) {
+        CursorWindow::FieldValue& value = values[i];
         int type = sqlite3_column_type(statement, i);
         if (type == SQLITE_TEXT) {
             // TEXT data
@@ -602,75 +597,48 @@ static CopyRowResult copyRow(JNIEnv* env, CursorWindow* window,
             // ensure all strings are NULL terminated, so increase size by
             // one to make sure we store the terminator.
             size_t sizeIncludingNull = sqlite3_column_bytes(statement, i) + 1;
-            status = window->putString(addedRows, i, text, sizeIncludingNull);
-            if (status) {
-                LOG_WINDOW("Failed allocating %u bytes for text at %d,%d, error=%d",
-                        sizeIncludingNull, startPos + addedRows, i, status);
-                result = CPR_FULL;
-                break;
-            }
+            value.type = CursorWindow::FIELD_TYPE_STRING;
+            value.data.buffer.data = text;
+            value.data.buffer.size = sizeIncludingNull;
             LOG_WINDOW("%d,%d is TEXT with %u bytes",
                     startPos + addedRows, i, sizeIncludingNull);
         } else if (type == SQLITE_INTEGER) {
             // INTEGER data
-            int64_t value = sqlite3_column_int64(statement, i);
-            status = window->putLong(addedRows, i, value);
-            if (status) {
-                LOG_WINDOW("Failed allocating space for a long in column %d, error=%d",
-                        i, status);
-                result = CPR_FULL;
-                break;
-            }
-            LOG_WINDOW("%d,%d is INTEGER 0x%016llx", startPos + addedRows, i, value);
+            value.type = CursorWindow::FIELD_TYPE_INTEGER;
+            value.data.l = sqlite3_column_int64(statement, i);
+            LOG_WINDOW("%d,%d is INTEGER 0x%016llx", startPos + addedRows, i, value.data.l);
         } else if (type == SQLITE_FLOAT) {
             // FLOAT data
-            double value = sqlite3_column_double(statement, i);
-            status = window->putDouble(addedRows, i, value);
-            if (status) {
-                LOG_WINDOW("Failed allocating space for a double in column %d, error=%d",
-                        i, status);
-                result = CPR_FULL;
-                break;
-            }
-            LOG_WINDOW("%d,%d is FLOAT %lf", startPos + addedRows, i, value);
+            value.type = CursorWindow::FIELD_TYPE_FLOAT;
+            value.data.d = sqlite3_column_double(statement, i);
+            LOG_WINDOW("%d,%d is FLOAT %lf", startPos + addedRows, i, value.data.d);
         } else if (type == SQLITE_BLOB) {
             // BLOB data
-            const void* blob = sqlite3_column_blob(statement, i);
-            size_t size = sqlite3_column_bytes(statement, i);
-            status = window->putBlob(addedRows, i, blob, size);
-            if (status) {
-                LOG_WINDOW("Failed allocating %u bytes for blob at %d,%d, error=%d",
-                        size, startPos + addedRows, i, status);
-                result = CPR_FULL;
-                break;
-            }
+            value.type = CursorWindow::FIELD_TYPE_BLOB;
+            value.data.buffer.data = sqlite3_column_blob(statement, i);
+            value.data.buffer.size = sqlite3_column_bytes(statement, i);
             LOG_WINDOW("%d,%d is Blob with %u bytes",
-                    startPos + addedRows, i, size);
+                    startPos + addedRows, i, value.data.buffer.size);
         } else if (type == SQLITE_NULL) {
             // NULL field
-            status = window->putNull(addedRows, i);
-            if (status) {
-                LOG_WINDOW("Failed allocating space for a null in column %d, error=%d",
-                        i, status);
-                result = CPR_FULL;
-                break;
-            }
-
+            value.type = CursorWindow::FIELD_TYPE_NULL;
             LOG_WINDOW("%d,%d is NULL", startPos + addedRows, i);
         } else {
             // Unknown data
             ALOGE("Unknown column type when filling database window");
             throw_sqlite3_exception(env, "Unknown column type when filling window");
-            result = CPR_ERROR;
-            break;
+            return CPR_ERROR;
         }
     }
 
-    // Free the last row if if was not successfully copied.
-    if (result != CPR_OK) {
-        window->freeLastRow();
+    // The window is left unchanged if the row doesn't fit.
+    status_t status = window->appendRow(values);
+    if (status) {
+        LOG_WINDOW("Failed appending row at startPos %d row %d, error=%d",
+                startPos, addedRows, status);
+        return CPR_FULL;
     }
-    return result;
+    return CPR_OK;
 }
 
 static jlong nativeExecuteForCursorWindow(JNIEnv* env, jclass clazz,
@@ -698,6 +666,7 @@ static jlong nativeExecuteForCursorWindow(JNIEnv* env, jclass clazz,
         return 0;
     }
 
+    std::vector<CursorWindow::FieldValue> values(numColumns);
     int retryCount = 0;
     int totalRows = 0;
     int addedRows = 0;
@@ -715,7 +684,8 @@ static jlong nativeExecuteForCursorWindow(JNIEnv* env, jclass clazz,
                 continue;
             }
 
-            CopyRowResult cpr = copyRow(env, window, statement, numColumns, startPos, addedRows);
+            CopyRowResult cpr = copyRow(env, window, statement, numColumns, startPos, addedRows,
+                    values.data());
             if (cpr == CPR_FULL && addedRows && startPos + addedRows <= requiredPos) {
                 // We filled the window before we got to the one row that we really wanted.
                 // Clear the window and start filling it again from here.
@@ -724,7 +694,8 @@ static jlong nativeExecuteForCursorWindow(JNIEnv* env, jclass clazz,
                 window->setNumColumns(numColumns);
                 startPos += addedRows;
                 addedRows = 0;
-                cpr = copyRow(env, window, statement, numColumns, startPos, addedRows);
+                cpr = copyRow(env, window, statement, numColumns, startPos, addedRows,
+                        values.data());
             }
 
             if (cpr == CPR_OK) {
@@ -175,8 +175,14 @@ std::unique_ptr<Asset> ApkAssets::Open(const std::string& path, Asset::AccessMod
       return {};
     }
 
-    std::unique_ptr<Asset> asset =
-        Asset::createFromCompressedMap(std::move(map), entry.uncompressed_length, mode);
+    // Large entries are shared with other opens of the same entry through the cache of
+    // inflated assets. The CRC keeps an APK replaced in place from hitting stale data.
+    std::string cache_key;
+    if (entry.uncompressed_length >= Asset::kInflatedCacheMinSize) {
+      cache_key = path_ + "!" + path + "@" + std::to_string(entry.crc32);
+    }
+    std::unique_ptr<Asset> asset = Asset::createFromCompressedMap(
+        std::move(map), entry.uncompressed_length, mode, cache_key);
     if (asset == nullptr) {
       LOG(ERROR) << "Failed to decompress '" << path << "'.";
       return {};
@@ -40,6 +40,12 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <deque>
+#include <list>
+#include <new>
+#include <thread>
+#include <unordered_map>
+
 using namespace android;
 
 #ifndef O_BINARY
@@ -120,6 +126,205 @@ String8 Asset::getAssetAllocations()
     return res;
 }
 
+/*
+ * Process-wide cache of recently inflated compressed assets, so that large
+ * entries (fonts, models) that are opened again don't get inflated again.
+ * An entry may still be inflating on a read-ahead thread; whoever needs it
+ * first waits for it.  Entries are evicted least recently used first once
+ * their total inflated size goes over the limit.
+ */
+namespace {
+
+typedef std::shared_future<std::shared_ptr<unsigned char>> InflatedBuffer;
+
+class InflatedAssetCache {
+public:
+    InflatedAssetCache() : mSize(0), mMaxSize(kDefaultMaxSize) {}
+
+    bool get(const std::string& key, InflatedBuffer* outBuffer)
+    {
+        AutoMutex _l(mLock);
+        auto iter = mIndex.find(key);
+        if (iter == mIndex.end()) {
+            return false;
+        }
+        mEntries.splice(mEntries.begin(), mEntries, iter->second);
+        *outBuffer = iter->second->buffer;
+        return true;
+    }
+
+    void put(const std::string& key, size_t size, const InflatedBuffer& buffer)
+    {
+        AutoMutex _l(mLock);
+        removeLocked(key);
+        if (size > mMaxSize) {
+            return;
+        }
+        mEntries.push_front(Entry{key, size, buffer});
+        mIndex[key] = mEntries.begin();
+        mSize += size;
+        trimLocked();
+    }
+
+    void remove(const std::string& key)
+    {
+        AutoMutex _l(mLock);
+        removeLocked(key);
+    }
+
+    void setMaxSize(size_t maxSize)
+    {
+        AutoMutex _l(mLock);
+        mMaxSize = maxSize;
+        trimLocked();
+    }
+
+private:
+    static const size_t kDefaultMaxSize = 8 * 1024 * 1024;
+
+    struct Entry {
+        std::string key;
+        size_t size;
+        InflatedBuffer buffer;
+    };
+
+    void removeLocked(const std::string& key)
+    {
+        auto iter = mIndex.find(key);
+        if (iter != mIndex.end()) {
+            mSize -= iter->second->size;
+            mEntries.erase(iter->second);
+            mIndex.erase(iter);
+        }
+    }
+
+    void trimLocked()
+    {
+        while (mSize > mMaxSize) {
+            const Entry& last = mEntries.back();
+            mSize -= last.size;
+            mIndex.erase(last.key);
+            mEntries.pop_back();
+        }
+    }
+
+    Mutex mLock;
+    std::list<Entry> mEntries;  // most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> mIndex;
+    size_t mSize;
+    size_t mMaxSize;
+};
+
+// Never destroyed, so that exiting doesn't wait for read-aheads still in flight.
+InflatedAssetCache& inflatedAssetCache()
+{
+    static InflatedAssetCache* cache = new InflatedAssetCache();
+    return *cache;
+}
+
+std::shared_ptr<unsigned char> allocInflatedBuffer(size_t size)
+{
+    std::shared_ptr<unsigned char> buf(new (std::nothrow) unsigned char[size],
+            std::default_delete<unsigned char[]>());
+    if (buf == nullptr) {
+        ALOGW("alloc %ld bytes failed\n", (long) size);
+    }
+    return buf;
+}
+
+std::shared_ptr<unsigned char> inflateMappedData(const void* data, size_t uncompressedLen,
+        size_t compressedLen)
+{
+    std::shared_ptr<unsigned char> buf = allocInflatedBuffer(uncompressedLen);
+    if (buf == nullptr ||
+            !ZipUtils::inflateToBuffer(data, buf.get(), uncompressedLen, compressedLen)) {
+        return nullptr;
+    }
+    return buf;
+}
+
+/*
+ * Runs read-aheads on a fixed number of worker threads, so that opening many
+ * large assets at once doesn't start a thread for each of them.  When enough
+ * read-aheads are already waiting, no more are taken; those assets are
+ * inflated on the calling thread when they are first read, as without
+ * read-ahead.
+ */
+class ReadAheadPool {
+public:
+    typedef std::packaged_task<std::shared_ptr<unsigned char>()> Task;
+
+    ReadAheadPool() : mEnabled(false), mThreadsStarted(false) {}
+
+    void setEnabled(bool enabled)
+    {
+        AutoMutex _l(mLock);
+        mEnabled = enabled;
+    }
+
+    bool trySubmit(Task&& task)
+    {
+        AutoMutex _l(mLock);
+        if (!mEnabled || mQueue.size() >= kMaxQueuedTasks) {
+            return false;
+        }
+        if (!mThreadsStarted) {
+            for (size_t i = 0; i < kThreadCount; i++) {
+                std::thread(&ReadAheadPool::run, this).detach();
+            }
+            mThreadsStarted = true;
+        }
+        mQueue.push_back(std::move(task));
+        mCondition.signal();
+        return true;
+    }
+
+private:
+    static const size_t kThreadCount = 2;
+    static const size_t kMaxQueuedTasks = 8;
+
+    void run()
+    {
+        while (true) {
+            Task task;
+            {
+                AutoMutex _l(mLock);
+                while (mQueue.empty()) {
+                    mCondition.wait(mLock);
+                }
+                task = std::move(mQueue.front());
+                mQueue.pop_front();
+            }
+            task();
+        }
+    }
+
+    Mutex mLock;
+    Condition mCondition;
+    std::deque<Task> mQueue;
+    bool mEnabled;
+    bool mThreadsStarted;
+};
+
+// Never destroyed, like the cache, since its threads run until the process exits.
+ReadAheadPool& readAheadPool()
+{
+    static ReadAheadPool* pool = new ReadAheadPool();
+    return *pool;
+}
+
+} // namespace
+
+/*static*/ void Asset::setInflatedCacheMaxSize(size_t maxSize)
+{
+    inflatedAssetCache().setMaxSize(maxSize);
+}
+
+/*static*/ void Asset::setReadAheadEnabled(bool enabled)
+{
+    readAheadPool().setEnabled(enabled);
+}
+
 Asset::Asset(void)
     : mAccessMode(ACCESS_UNKNOWN), mNext(NULL), mPrev(NULL)
 {
@@ -334,7 +539,7 @@ Asset::Asset(void)
 }
 
 /*static*/ std::unique_ptr<Asset> Asset::createFromCompressedMap(std::unique_ptr<FileMap> dataMap,
-    size_t uncompressedLen, AccessMode mode)
+    size_t uncompressedLen, AccessMode mode, const std::string& cacheKey)
 {
   std::unique_ptr<_CompressedAsset> pAsset = util::make_unique<_CompressedAsset>();
 
@@ -346,6 +551,10 @@ Asset::Asset(void)
   // We succeeded, so relinquish control of dataMap
   (void) dataMap.release();
   pAsset->mAccessMode = mode;
+
+  if (!cacheKey.empty() && uncompressedLen >= kInflatedCacheMinSize) {
+      pAsset->setInflatedCacheKey(cacheKey, mode == ACCESS_BUFFER /*readAhead*/);
+  }
   return std::move(pAsset);
 }
 
@@ -728,7 +937,7 @@ const void* _FileAsset::ensureAlignment(FileMap* map)
  */
 _CompressedAsset::_CompressedAsset(void)
     : mStart(0), mCompressedLen(0), mUncompressedLen(0), mOffset(0),
-      mMap(NULL), mFd(-1), mZipInflater(NULL), mBuf(NULL)
+      mMap(nullptr), mFd(-1), mZipInflater(NULL)
 {
     // Register the Asset with the global list here after it is fully constructed and its
     // vtable pointer points to this concrete type. b/31113965
@@ -757,7 +966,7 @@ status_t _CompressedAsset::openChunk(int fd, off64_t offset,
     int compressionMethod, size_t uncompressedLen, size_t compressedLen)
 {
     assert(mFd < 0);        // no re-open
-    assert(mMap == NULL);
+    assert(mMap == nullptr);
     assert(fd >= 0);
     assert(offset >= 0);
     assert(compressedLen > 0);
@@ -772,7 +981,7 @@ status_t _CompressedAsset::openChunk(int fd, off64_t offset,
     mUncompressedLen = uncompressedLen;
     assert(mOffset == 0);
     mFd = fd;
-    assert(mBuf == NULL);
+    assert(mBuf == nullptr);
 
     if (uncompressedLen > StreamingZipInflater::OUTPUT_CHUNK_SIZE) {
         mZipInflater = new StreamingZipInflater(mFd, offset, uncompressedLen, compressedLen);
@@ -789,10 +998,10 @@ status_t _CompressedAsset::openChunk(int fd, off64_t offset,
 status_t _CompressedAsset::openChunk(FileMap* dataMap, size_t uncompressedLen)
 {
     assert(mFd < 0);        // no re-open
-    assert(mMap == NULL);
+    assert(mMap == nullptr);
     assert(dataMap != NULL);
 
-    mMap = dataMap;
+    mMap.reset(dataMap);
     mStart = -1;        // not used
     mCompressedLen = dataMap->getDataLength();
     mUncompressedLen = uncompressedLen;
@@ -804,6 +1013,37 @@ status_t _CompressedAsset::openChunk(FileMap* dataMap, size_t uncompressedLen)
     return NO_ERROR;
 }
 
+void _CompressedAsset::setInflatedCacheKey(const std::string& cacheKey, bool readAhead)
+{
+    assert(mMap != nullptr);
+    assert(mBuf == nullptr);
+    mCacheKey = cacheKey;
+
+    InflatedBuffer buffer;
+    if (!inflatedAssetCache().get(mCacheKey, &buffer)) {
+        if (!readAhead) {
+            return;
+        }
+        // The task holds on to the map, so that close doesn't have to wait for it.
+        std::shared_ptr<FileMap> map = mMap;
+        size_t uncompressedLen = mUncompressedLen;
+        size_t compressedLen = mCompressedLen;
+        ReadAheadPool::Task task([map, uncompressedLen, compressedLen]() {
+            return inflateMappedData(map->getDataPtr(), uncompressedLen, compressedLen);
+        });
+        buffer = task.get_future().share();
+        if (!readAheadPool().trySubmit(std::move(task))) {
+            return;
+        }
+        inflatedAssetCache().put(mCacheKey, mUncompressedLen, buffer);
+    }
+    mPendingBuf = buffer;
+
+    // The whole asset is going to be in memory, so skip the streaming inflater.
+    delete mZipInflater;
+    mZipInflater = NULL;
+}
+
 /*
  * Read data from a chunk of compressed data.
  *
@@ -820,11 +1060,11 @@ ssize_t _CompressedAsset::read(void* buf, size_t count)
     if (mZipInflater) {
         actual = mZipInflater->read(buf, count);
     } else {
-        if (mBuf == NULL) {
+        if (mBuf == nullptr) {
             if (getBuffer(false) == NULL)
                 return -1;
         }
-        assert(mBuf != NULL);
+        assert(mBuf != nullptr);
 
         /* adjust count if we're near EOF */
         maxLen = mUncompressedLen - mOffset;
@@ -836,7 +1076,7 @@ ssize_t _CompressedAsset::read(void* buf, size_t count)
 
         /* copy from buffer */
         //printf("comp buf read\n");
-        memcpy(buf, (char*)mBuf + mOffset, count);
+        memcpy(buf, (char*)mBuf.get() + mOffset, count);
         actual = count;
     }
 
@@ -872,13 +1112,12 @@ off64_t _CompressedAsset::seek(off64_t offset, int whence)
  */
 void _CompressedAsset::close(void)
 {
-    if (mMap != NULL) {
-        delete mMap;
-        mMap = NULL;
-    }
+    // A read-ahead still in flight keeps its own reference to the map, and
+    // finishes into the cache for whoever opens the entry next.
+    mPendingBuf = InflatedBuffer();
+    mMap.reset();
 
-    delete[] mBuf;
-    mBuf = NULL;
+    mBuf.reset();
 
     delete mZipInflater;
     mZipInflater = NULL;
@@ -897,39 +1136,49 @@ void _CompressedAsset::close(void)
  */
 const void* _CompressedAsset::getBuffer(bool)
 {
-    unsigned char* buf = NULL;
+    if (mBuf != nullptr)
+        return mBuf.get();
 
-    if (mBuf != NULL)
-        return mBuf;
+    if (mPendingBuf.valid()) {
+        /*
+         * Inflating in the background, by our read-ahead or by another
+         * asset on the same entry; wait for it.
+         */
+        mBuf = mPendingBuf.get();
+        mPendingBuf = InflatedBuffer();
+        if (mBuf == nullptr) {
+            inflatedAssetCache().remove(mCacheKey);
+        }
+        return mBuf.get();
+    }
 
     /*
      * Allocate a buffer and read the file into it.
      */
-    buf = new unsigned char[mUncompressedLen];
-    if (buf == NULL) {
-        ALOGW("alloc %ld bytes failed\n", (long) mUncompressedLen);
-        goto bail;
-    }
-
-    if (mMap != NULL) {
-        if (!ZipUtils::inflateToBuffer(mMap->getDataPtr(), buf,
-                mUncompressedLen, mCompressedLen))
-            goto bail;
+    std::shared_ptr<unsigned char> buf;
+    if (mMap != nullptr) {
+        buf = inflateMappedData(mMap->getDataPtr(), mUncompressedLen, mCompressedLen);
+        if (buf == nullptr)
+            return NULL;
     } else {
         assert(mFd >= 0);
 
+        buf = allocInflatedBuffer(mUncompressedLen);
+        if (buf == nullptr)
+            return NULL;
+
         /*
          * Seek to the start of the compressed data.
          */
         if (lseek(mFd, mStart, SEEK_SET) != mStart)
-            goto bail;
+            return NULL;
 
         /*
          * Expand the data into it.
          */
-        if (!ZipUtils::inflateToBuffer(mFd, buf, mUncompressedLen,
+        if (!ZipUtils::inflateToBuffer(mFd, buf.get(), mUncompressedLen,
                 mCompressedLen))
-            goto bail;
+            return NULL;
     }
 
     /*
@@ -940,10 +1189,10 @@ const void* _CompressedAsset::getBuffer(bool)
     mZipInflater = NULL;
 
     mBuf = buf;
-    buf = NULL;
-
-bail:
-    delete[] buf;
-    return mBuf;
+    if (!mCacheKey.empty()) {
+        std::promise<std::shared_ptr<unsigned char>> inflated;
+        inflated.set_value(mBuf);
+        inflatedAssetCache().put(mCacheKey, mUncompressedLen, inflated.get_future().share());
+    }
+    return mBuf.get();
 }
-
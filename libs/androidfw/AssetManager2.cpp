@@ -37,32 +37,7 @@
 
 namespace android {
 
-struct FindEntryResult {
-  // A pointer to the resource table entry for this resource.
-  // If the size of the entry is > sizeof(ResTable_entry), it can be cast to
-  // a ResTable_map_entry and processed as a bag/map.
-  const ResTable_entry* entry;
-
-  // The configuration for which the resulting entry was defined. This is already swapped to host
-  // endianness.
-  ResTable_config config;
-
-  // The bitmask of configuration axis with which the resource value varies.
-  uint32_t type_flags;
-
-  // The dynamic package ID map for the package from which this resource came from.
-  const DynamicRefTable* dynamic_ref_table;
-
-  // The string pool reference to the type's name. This uses a different string pool than
-  // the global string pool, but this is hidden from the caller.
-  StringPoolRef type_string_ref;
-
-  // The string pool reference to the entry's name. This uses a different string pool than
-  // the global string pool, but this is hidden from the caller.
-  StringPoolRef entry_string_ref;
-};
-
-AssetManager2::AssetManager2() {
+AssetManager2::AssetManager2() : package_groups_(std::make_shared<std::vector<PackageGroup>>()) {
   memset(&configuration_, 0, sizeof(configuration_));
 }
 
@@ -71,6 +46,11 @@ bool AssetManager2::SetApkAssets(const std::vector<const ApkAssets*>& apk_assets
   apk_assets_ = apk_assets;
   BuildDynamicRefTable();
   RebuildFilterList();
+
+  // Cached entries point into the package groups that were just rebuilt, so they are always
+  // dropped.
+  cached_entries_.clear();
+  generation_++;
   if (invalidate_caches) {
     InvalidateCaches(static_cast<uint32_t>(-1));
   }
@@ -78,7 +58,9 @@ bool AssetManager2::SetApkAssets(const std::vector<const ApkAssets*>& apk_assets
 }
 
 void AssetManager2::BuildDynamicRefTable() {
-  package_groups_.clear();
+  // Built from scratch, so there is nothing to copy even if the old groups are shared.
+  package_groups_ = std::make_shared<std::vector<PackageGroup>>();
+  std::vector<PackageGroup>& package_groups = *package_groups_;
   package_ids_.fill(0xff);
 
   // 0x01 is reserved for the android package.
@@ -99,13 +81,13 @@ void AssetManager2::BuildDynamicRefTable() {
       // Add the mapping for package ID to index if not present.
       uint8_t idx = package_ids_[package_id];
       if (idx == 0xff) {
-        package_ids_[package_id] = idx = static_cast<uint8_t>(package_groups_.size());
-        package_groups_.push_back({});
-        DynamicRefTable& ref_table = package_groups_.back().dynamic_ref_table;
+        package_ids_[package_id] = idx = static_cast<uint8_t>(package_groups.size());
+        package_groups.push_back({});
+        DynamicRefTable& ref_table = package_groups.back().dynamic_ref_table;
         ref_table.mAssignedPackageId = package_id;
         ref_table.mAppAsLib = package->IsDynamic() && package->GetPackageId() == 0x7f;
       }
-      PackageGroup* package_group = &package_groups_[idx];
+      PackageGroup* package_group = &package_groups[idx];
 
       // Add the package and to the set of packages with the same ID.
       package_group->packages_.push_back(ConfiguredPackage{package.get(), {}});
@@ -121,10 +103,10 @@ void AssetManager2::BuildDynamicRefTable() {
   }
 
   // Now assign the runtime IDs so that we have a build-time to runtime ID map.
-  const auto package_groups_end = package_groups_.end();
-  for (auto iter = package_groups_.begin(); iter != package_groups_end; ++iter) {
+  const auto package_groups_end = package_groups.end();
+  for (auto iter = package_groups.begin(); iter != package_groups_end; ++iter) {
     const std::string& package_name = iter->packages_[0].loaded_package_->GetPackageName();
-    for (auto iter2 = package_groups_.begin(); iter2 != package_groups_end; ++iter2) {
+    for (auto iter2 = package_groups.begin(); iter2 != package_groups_end; ++iter2) {
       iter2->dynamic_ref_table.addMapping(String16(package_name.c_str(), package_name.size()),
                                           iter->dynamic_ref_table.mAssignedPackageId);
     }
@@ -150,7 +132,7 @@ void AssetManager2::DumpToLog() const {
   }
   LOG(INFO) << "Package ID map: " << list;
 
-  for (const auto& package_group: package_groups_) {
+  for (const auto& package_group: *package_groups_) {
     list = "";
     for (const auto& package : package_group.packages_) {
       const LoadedPackage* loaded_package = package.loaded_package_;
@@ -180,11 +162,11 @@ const DynamicRefTable* AssetManager2::GetDynamicRefTableForPackage(uint32_t pack
   if (idx == 0xff) {
     return nullptr;
   }
-  return &package_groups_[idx].dynamic_ref_table;
+  return &(*package_groups_)[idx].dynamic_ref_table;
 }
 
 const DynamicRefTable* AssetManager2::GetDynamicRefTableForCookie(ApkAssetsCookie cookie) const {
-  for (const PackageGroup& package_group : package_groups_) {
+  for (const PackageGroup& package_group : *package_groups_) {
     for (const ApkAssetsCookie& package_cookie : package_group.cookies_) {
       if (package_cookie == cookie) {
         return &package_group.dynamic_ref_table;
@@ -199,8 +181,9 @@ void AssetManager2::SetConfiguration(const ResTable_config& configuration) {
   configuration_ = configuration;
 
   if (diff) {
-    RebuildFilterList();
+    RebuildFilterList(static_cast<uint32_t>(diff));
     InvalidateCaches(static_cast<uint32_t>(diff));
+    generation_++;
   }
 }
 
@@ -208,7 +191,7 @@ std::set<ResTable_config> AssetManager2::GetResourceConfigurations(bool exclude_
                                                                    bool exclude_mipmap) const {
   ATRACE_NAME("AssetManager::GetResourceConfigurations");
   std::set<ResTable_config> configurations;
-  for (const PackageGroup& package_group : package_groups_) {
+  for (const PackageGroup& package_group : *package_groups_) {
     for (const ConfiguredPackage& package : package_group.packages_) {
       if (exclude_system && package.loaded_package_->IsSystem()) {
         continue;
@@ -223,7 +206,7 @@ std::set<std::string> AssetManager2::GetResourceLocales(bool exclude_system,
                                                         bool merge_equivalent_languages) const {
   ATRACE_NAME("AssetManager::GetResourceLocales");
   std::set<std::string> locales;
-  for (const PackageGroup& package_group : package_groups_) {
+  for (const PackageGroup& package_group : *package_groups_) {
     for (const ConfiguredPackage& package : package_group.packages_) {
       if (exclude_system && package.loaded_package_->IsSystem()) {
         continue;
@@ -314,10 +297,19 @@ ApkAssetsCookie AssetManager2::FindEntry(uint32_t resid, uint16_t density_overri
 
   // Select our configuration or generate a density override configuration.
   const ResTable_config* desired_config = &configuration_;
+  uint16_t effective_density_override = 0u;
   if (density_override != 0 && density_override != configuration_.density) {
     density_override_config = configuration_;
     density_override_config.density = density_override;
     desired_config = &density_override_config;
+    effective_density_override = density_override;
+  }
+
+  const uint64_t cache_key = (static_cast<uint64_t>(effective_density_override) << 32) | resid;
+  auto cached_iter = cached_entries_.find(cache_key);
+  if (cached_iter != cached_entries_.end()) {
+    *out_entry = cached_iter->second.result;
+    return cached_iter->second.cookie;
   }
 
   if (!is_valid_resid(resid)) {
@@ -335,21 +327,19 @@ ApkAssetsCookie AssetManager2::FindEntry(uint32_t resid, uint16_t density_overri
     return kInvalidCookie;
   }
 
-  const PackageGroup& package_group = package_groups_[package_idx];
+  const PackageGroup& package_group = (*package_groups_)[package_idx];
   const size_t package_count = package_group.packages_.size();
 
   ApkAssetsCookie best_cookie = kInvalidCookie;
   const LoadedPackage* best_package = nullptr;
   const ResTable_type* best_type = nullptr;
   const ResTable_config* best_config = nullptr;
-  ResTable_config best_config_copy;
   uint32_t best_offset = 0u;
   uint32_t type_flags = 0u;
 
-  // If desired_config is the same as the set configuration, then we can use our filtered list
-  // and we don't need to match the configurations, since they already matched.
-  const bool use_fast_path = desired_config == &configuration_;
-
+  // The filtered list holds the configurations that match the set configuration. A density
+  // override doesn't change which configurations match, since density never affects matching,
+  // so the list serves it too. Only the ranking below uses the desired density.
   for (size_t pi = 0; pi < package_count; pi++) {
     const ConfiguredPackage& loaded_package_impl = package_group.packages_[pi];
     const LoadedPackage* loaded_package = loaded_package_impl.loaded_package_;
@@ -378,60 +368,28 @@ ApkAssetsCookie AssetManager2::FindEntry(uint32_t resid, uint16_t density_overri
     const bool package_is_overlay = loaded_package->IsOverlay();
 
     const FilteredConfigGroup& filtered_group = loaded_package_impl.filtered_configs_[type_idx];
-    if (use_fast_path) {
-      const std::vector<ResTable_config>& candidate_configs = filtered_group.configurations;
-      const size_t type_count = candidate_configs.size();
-      for (uint32_t i = 0; i < type_count; i++) {
-        const ResTable_config& this_config = candidate_configs[i];
-
-        // We can skip calling ResTable_config::match() because we know that all candidate
-        // configurations that do NOT match have been filtered-out.
-        if ((best_config == nullptr || this_config.isBetterThan(*best_config, desired_config)) ||
-            (package_is_overlay && this_config.compare(*best_config) == 0)) {
-          // The configuration matches and is better than the previous selection.
-          // Find the entry value if it exists for this configuration.
-          const ResTable_type* type_chunk = filtered_group.types[i];
-          const uint32_t offset = LoadedPackage::GetEntryOffset(type_chunk, local_entry_idx);
-          if (offset == ResTable_type::NO_ENTRY) {
-            continue;
-          }
-
-          best_cookie = cookie;
-          best_package = loaded_package;
-          best_type = type_chunk;
-          best_config = &this_config;
-          best_offset = offset;
+    const std::vector<ResTable_config>& candidate_configs = filtered_group.configurations;
+    const size_t type_count = candidate_configs.size();
+    for (uint32_t i = 0; i < type_count; i++) {
+      const ResTable_config& this_config = candidate_configs[i];
+
+      // We can skip calling ResTable_config::match() because we know that all candidate
+      // configurations that do NOT match have been filtered-out.
+      if ((best_config == nullptr || this_config.isBetterThan(*best_config, desired_config)) ||
+          (package_is_overlay && this_config.compare(*best_config) == 0)) {
+        // The configuration matches and is better than the previous selection.
+        // Find the entry value if it exists for this configuration.
+        const ResTable_type* type_chunk = filtered_group.types[i];
+        const uint32_t offset = LoadedPackage::GetEntryOffset(type_chunk, local_entry_idx);
+        if (offset == ResTable_type::NO_ENTRY) {
+          continue;
         }
-      }
-    } else {
-      // This is the slower path, which doesn't use the filtered list of configurations.
-      // Here we must read the ResTable_config from the mmapped APK, convert it to host endianness
-      // and fill in any new fields that did not exist when the APK was compiled.
-      // Furthermore when selecting configurations we can't just record the pointer to the
-      // ResTable_config, we must copy it.
-      const auto iter_end = type_spec->types + type_spec->type_count;
-      for (auto iter = type_spec->types; iter != iter_end; ++iter) {
-        ResTable_config this_config;
-        this_config.copyFromDtoH((*iter)->config);
-
-        if (this_config.match(*desired_config)) {
-          if ((best_config == nullptr || this_config.isBetterThan(*best_config, desired_config)) ||
-              (package_is_overlay && this_config.compare(*best_config) == 0)) {
-            // The configuration matches and is better than the previous selection.
-            // Find the entry value if it exists for this configuration.
-            const uint32_t offset = LoadedPackage::GetEntryOffset(*iter, local_entry_idx);
-            if (offset == ResTable_type::NO_ENTRY) {
-              continue;
-            }
 
-            best_cookie = cookie;
-            best_package = loaded_package;
-            best_type = *iter;
-            best_config_copy = this_config;
-            best_config = &best_config_copy;
-            best_offset = offset;
-          }
-        }
+        best_cookie = cookie;
+        best_package = loaded_package;
+        best_type = type_chunk;
+        best_config = &this_config;
+        best_offset = offset;
       }
     }
   }
@@ -452,6 +410,7 @@ ApkAssetsCookie AssetManager2::FindEntry(uint32_t resid, uint16_t density_overri
   out_entry->entry_string_ref =
       StringPoolRef(best_package->GetKeyStringPool(), best_entry->key.index);
   out_entry->dynamic_ref_table = &package_group.dynamic_ref_table;
+  cached_entries_.emplace(cache_key, CachedEntry{best_cookie, *out_entry});
   return best_cookie;
 }
 
@@ -567,6 +526,12 @@ ApkAssetsCookie AssetManager2::ResolveReference(ApkAssetsCookie cookie, Res_valu
   return cookie;
 }
 
+// Bags are malloc'ed, and may outlive this AssetManager in a Snapshot once cached.
+static std::shared_ptr<const ResolvedBag> ShareBag(util::unique_cptr<ResolvedBag> bag) {
+  return std::shared_ptr<const ResolvedBag>(
+      bag.release(), [](const ResolvedBag* b) { free(const_cast<ResolvedBag*>(b)); });
+}
+
 const ResolvedBag* AssetManager2::GetBag(uint32_t resid) {
   auto found_resids = std::vector<uint32_t>();
   return GetBag(resid, found_resids);
@@ -642,7 +607,7 @@ const ResolvedBag* AssetManager2::GetBag(uint32_t resid, std::vector<uint32_t>&
     new_bag->type_spec_flags = entry.type_flags;
     new_bag->entry_count = static_cast<uint32_t>(entry_count);
     ResolvedBag* result = new_bag.get();
-    cached_bags_[resid] = std::move(new_bag);
+    cached_bags_[resid] = ShareBag(std::move(new_bag));
     return result;
   }
 
@@ -752,7 +717,7 @@ const ResolvedBag* AssetManager2::GetBag(uint32_t resid, std::vector<uint32_t>&
   new_bag->type_spec_flags = entry.type_flags | parent_bag->type_spec_flags;
   new_bag->entry_count = static_cast<uint32_t>(actual_count);
   ResolvedBag* result = new_bag.get();
-  cached_bags_[resid] = std::move(new_bag);
+  cached_bags_[resid] = ShareBag(std::move(new_bag));
   return result;
 }
 
@@ -801,7 +766,7 @@ uint32_t AssetManager2::GetResourceId(const std::string& resource_name,
   const StringPiece16 kAttr16 = u"attr";
   const static std::u16string kAttrPrivate16 = u"^attr-private";
 
-  for (const PackageGroup& package_group : package_groups_) {
+  for (const PackageGroup& package_group : *package_groups_) {
     for (const ConfiguredPackage& package_impl : package_group.packages_) {
       const LoadedPackage* package = package_impl.loaded_package_;
       if (package_name != package->GetPackageName()) {
@@ -825,22 +790,45 @@ uint32_t AssetManager2::GetResourceId(const std::string& resource_name,
   return 0u;
 }
 
-void AssetManager2::RebuildFilterList() {
-  for (PackageGroup& group : package_groups_) {
+void AssetManager2::RebuildFilterList(uint32_t diff) {
+  const bool rebuild_all = diff == 0xffffffffu;
+
+  // Density never affects matching, since any density can be scaled (see
+  // ResTable_config::match()).
+  diff &= ~static_cast<uint32_t>(ResTable_config::CONFIG_DENSITY);
+
+  // A configuration only constrains the axes it specifies, i.e. those where it differs from the
+  // default configuration.
+  ResTable_config default_config;
+  memset(&default_config, 0, sizeof(default_config));
+
+  for (PackageGroup& group : MutablePackageGroups()) {
     for (ConfiguredPackage& impl : group.packages_) {
-      // Destroy it.
-      impl.filtered_configs_.~ByteBucketArray();
+      if (rebuild_all) {
+        // Destroy it.
+        impl.filtered_configs_.~ByteBucketArray();
 
-      // Re-create it.
-      new (&impl.filtered_configs_) ByteBucketArray<FilteredConfigGroup>();
+        // Re-create it.
+        new (&impl.filtered_configs_) ByteBucketArray<FilteredConfigGroup>();
+      }
 
       // Create the filters here.
       impl.loaded_package_->ForEachTypeSpec([&](const TypeSpec* spec, uint8_t type_index) {
         FilteredConfigGroup& group = impl.filtered_configs_.editItemAt(type_index);
+        if (!rebuild_all && (group.config_axes & diff) == 0u) {
+          // None of this type's configurations care about what changed, so the same ones match.
+          return;
+        }
+
+        group.configurations.clear();
+        group.types.clear();
+        group.config_axes = 0u;
         const auto iter_end = spec->types + spec->type_count;
         for (auto iter = spec->types; iter != iter_end; ++iter) {
           ResTable_config this_config;
           this_config.copyFromDtoH((*iter)->config);
+          group.config_axes |= static_cast<uint32_t>(this_config.diff(default_config)) &
+                               ~static_cast<uint32_t>(ResTable_config::CONFIG_DENSITY);
           if (this_config.match(configuration_)) {
             group.configurations.push_back(this_config);
             group.types.push_back(*iter);
@@ -855,6 +843,7 @@ void AssetManager2::InvalidateCaches(uint32_t diff) {
   if (diff == 0xffffffffu) {
     // Everything must go.
     cached_bags_.clear();
+    cached_entries_.clear();
     return;
   }
 
@@ -867,13 +856,57 @@ void AssetManager2::InvalidateCaches(uint32_t diff) {
       ++iter;
     }
   }
+
+  for (auto iter = cached_entries_.cbegin(); iter != cached_entries_.cend();) {
+    if (diff & iter->second.result.type_flags) {
+      iter = cached_entries_.erase(iter);
+    } else {
+      ++iter;
+    }
+  }
+}
+
+std::vector<AssetManager2::PackageGroup>& AssetManager2::MutablePackageGroups() {
+  if (package_groups_.use_count() > 1) {
+    package_groups_ = std::make_shared<std::vector<PackageGroup>>(*package_groups_);
+    // Cached entries point into the groups that are no longer ours.
+    cached_entries_.clear();
+  }
+  return *package_groups_;
+}
+
+std::unique_ptr<const AssetManager2::Snapshot> AssetManager2::TakeSnapshot() const {
+  ATRACE_NAME("AssetManager::TakeSnapshot");
+  std::unique_ptr<Snapshot> snapshot(new Snapshot());
+  snapshot->apk_assets_ = apk_assets_;
+  snapshot->configuration_ = configuration_;
+  snapshot->package_groups_ = package_groups_;
+  snapshot->package_ids_ = package_ids_;
+  snapshot->bags_ = cached_bags_;
+  return std::move(snapshot);
+}
+
+void AssetManager2::SetFromSnapshot(const Snapshot& snapshot) {
+  ATRACE_NAME("AssetManager::SetFromSnapshot");
+  apk_assets_ = snapshot.apk_assets_;
+  configuration_ = snapshot.configuration_;
+  // Never written while shared; MutablePackageGroups() copies it first.
+  package_groups_ =
+      std::const_pointer_cast<std::vector<PackageGroup>>(snapshot.package_groups_);
+  package_ids_ = snapshot.package_ids_;
+
+  // Cached entries point into the package groups that were just replaced.
+  cached_entries_.clear();
+  cached_bags_ = snapshot.bags_;
+  generation_++;
 }
 
 std::unique_ptr<Theme> AssetManager2::NewTheme() {
   return std::unique_ptr<Theme>(new Theme(this));
 }
 
-Theme::Theme(AssetManager2* asset_manager) : asset_manager_(asset_manager) {
+Theme::Theme(AssetManager2* asset_manager)
+    : asset_manager_(asset_manager), style_cache_generation_(asset_manager->generation_) {
 }
 
 Theme::~Theme() = default;
@@ -903,6 +936,7 @@ struct Theme::Package {
 
 bool Theme::ApplyStyle(uint32_t resid, bool force) {
   ATRACE_NAME("Theme::ApplyStyle");
+  style_cache_.clear();
 
   const ResolvedBag* bag = asset_manager_->GetBag(resid);
   if (bag == nullptr) {
@@ -1047,8 +1081,43 @@ ApkAssetsCookie Theme::ResolveAttributeReference(ApkAssetsCookie cookie, Res_val
                                           in_out_type_spec_flags, out_last_ref);
 }
 
+size_t Theme::StyleKeyHash::operator()(const StyleKey& key) const {
+  size_t hash = key.def_style_resid;
+  hash = hash * 31 + key.def_style_flags;
+  hash = hash * 31 + key.style_resid;
+  hash = hash * 31 + key.style_flags;
+  return hash;
+}
+
+void Theme::ValidateStyleCache() const {
+  if (style_cache_generation_ != asset_manager_->generation_) {
+    style_cache_.clear();
+    style_cache_generation_ = asset_manager_->generation_;
+  }
+}
+
+const Theme::StyleAttribute* Theme::GetStyleAttribute(const StyleKey& key, uint32_t attr) const {
+  ValidateStyleCache();
+  auto style_iter = style_cache_.find(key);
+  if (style_iter == style_cache_.end()) {
+    return nullptr;
+  }
+  auto attr_iter = style_iter->second.find(attr);
+  if (attr_iter == style_iter->second.end()) {
+    return nullptr;
+  }
+  return &attr_iter->second;
+}
+
+void Theme::SetStyleAttribute(const StyleKey& key, uint32_t attr,
+                              const StyleAttribute& value) const {
+  ValidateStyleCache();
+  style_cache_[key][attr] = value;
+}
+
 void Theme::Clear() {
   type_spec_flags_ = 0u;
+  style_cache_.clear();
   for (std::unique_ptr<Package>& package : packages_) {
     package.reset();
   }
@@ -1060,6 +1129,7 @@ bool Theme::SetTo(const Theme& o) {
   }
 
   type_spec_flags_ = o.type_spec_flags_;
+  style_cache_.clear();
 
   const bool copy_only_system = asset_manager_ != o.asset_manager_;
 
@@ -97,6 +97,9 @@ bool ResolveAttrs(Theme* theme, uint32_t def_style_attr, uint32_t def_style_res,
 
   BagAttributeFinder def_style_attr_finder(default_style_bag);
 
+  // Without an XML style, this resolves like ApplyStyle() does for attributes missing from the XML.
+  const Theme::StyleKey style_key{def_style_res, def_style_flags, 0u, 0u};
+
   // Now iterate through all of the attributes that the client has requested,
   // filling in each with whatever data we can find.
   for (size_t ii = 0; ii < attrs_length; ii++) {
@@ -117,62 +120,83 @@ bool ResolveAttrs(Theme* theme, uint32_t def_style_attr, uint32_t def_style_res,
     // coming from, first XML attributes, then XML style, then default
     // style, and finally the theme.
 
-    // Retrieve the current input value if available.
-    if (src_values_length > 0 && src_values[ii] != 0) {
-      value.dataType = Res_value::TYPE_ATTRIBUTE;
-      value.data = src_values[ii];
+    // Attributes without an input value only depend on the default style and the theme, so they
+    // may have been resolved before.
+    uint32_t resid = 0;
+    const bool from_values = src_values_length > 0 && src_values[ii] != 0;
+    const Theme::StyleAttribute* cached_attr =
+        from_values ? nullptr : theme->GetStyleAttribute(style_key, cur_ident);
+    if (cached_attr != nullptr) {
+      value = cached_attr->value;
+      cookie = cached_attr->cookie;
+      resid = cached_attr->resid;
+      type_set_flags = cached_attr->type_spec_flags;
+      config.density = cached_attr->density;
       if (kDebugStyles) {
-        ALOGI("-> From values: type=0x%x, data=0x%08x", value.dataType, value.data);
+        ALOGI("-> From style cache: type=0x%x, data=0x%08x", value.dataType, value.data);
       }
     } else {
-      const ResolvedBag::Entry* const entry = def_style_attr_finder.Find(cur_ident);
-      if (entry != def_style_attr_finder.end()) {
-        cookie = entry->cookie;
-        type_set_flags = def_style_flags;
-        value = entry->value;
+      // Retrieve the current input value if available.
+      if (from_values) {
+        value.dataType = Res_value::TYPE_ATTRIBUTE;
+        value.data = src_values[ii];
         if (kDebugStyles) {
-          ALOGI("-> From def style: type=0x%x, data=0x%08x", value.dataType, value.data);
+          ALOGI("-> From values: type=0x%x, data=0x%08x", value.dataType, value.data);
+        }
+      } else {
+        const ResolvedBag::Entry* const entry = def_style_attr_finder.Find(cur_ident);
+        if (entry != def_style_attr_finder.end()) {
+          cookie = entry->cookie;
+          type_set_flags = def_style_flags;
+          value = entry->value;
+          if (kDebugStyles) {
+            ALOGI("-> From def style: type=0x%x, data=0x%08x", value.dataType, value.data);
+          }
         }
       }
-    }
 
-    uint32_t resid = 0;
-    if (value.dataType != Res_value::TYPE_NULL) {
-      // Take care of resolving the found resource to its final value.
-      ApkAssetsCookie new_cookie =
-          theme->ResolveAttributeReference(cookie, &value, &config, &type_set_flags, &resid);
-      if (new_cookie != kInvalidCookie) {
-        cookie = new_cookie;
-      }
-      if (kDebugStyles) {
-        ALOGI("-> Resolved attr: type=0x%x, data=0x%08x", value.dataType, value.data);
-      }
-    } else if (value.data != Res_value::DATA_NULL_EMPTY) {
-      // If we still don't have a value for this attribute, try to find it in the theme!
-      ApkAssetsCookie new_cookie = theme->GetAttribute(cur_ident, &value, &type_set_flags);
-      if (new_cookie != kInvalidCookie) {
+      if (value.dataType != Res_value::TYPE_NULL) {
+        // Take care of resolving the found resource to its final value.
+        ApkAssetsCookie new_cookie =
+            theme->ResolveAttributeReference(cookie, &value, &config, &type_set_flags, &resid);
+        if (new_cookie != kInvalidCookie) {
+          cookie = new_cookie;
+        }
         if (kDebugStyles) {
-          ALOGI("-> From theme: type=0x%x, data=0x%08x", value.dataType, value.data);
+          ALOGI("-> Resolved attr: type=0x%x, data=0x%08x", value.dataType, value.data);
         }
-        new_cookie =
-            assetmanager->ResolveReference(new_cookie, &value, &config, &type_set_flags, &resid);
+      } else if (value.data != Res_value::DATA_NULL_EMPTY) {
+        // If we still don't have a value for this attribute, try to find it in the theme!
+        ApkAssetsCookie new_cookie = theme->GetAttribute(cur_ident, &value, &type_set_flags);
         if (new_cookie != kInvalidCookie) {
-          cookie = new_cookie;
+          if (kDebugStyles) {
+            ALOGI("-> From theme: type=0x%x, data=0x%08x", value.dataType, value.data);
+          }
+          new_cookie =
+              assetmanager->ResolveReference(new_cookie, &value, &config, &type_set_flags, &resid);
+          if (new_cookie != kInvalidCookie) {
+            cookie = new_cookie;
+          }
+          if (kDebugStyles) {
+            ALOGI("-> Resolved theme: type=0x%x, data=0x%08x", value.dataType, value.data);
+          }
         }
+      }
+
+      // Deal with the special @null value -- it turns back to TYPE_NULL.
+      if (value.dataType == Res_value::TYPE_REFERENCE && value.data == 0) {
         if (kDebugStyles) {
-          ALOGI("-> Resolved theme: type=0x%x, data=0x%08x", value.dataType, value.data);
+          ALOGI("-> Setting to @null!");
         }
+        value.dataType = Res_value::TYPE_NULL;
+        value.data = Res_value::DATA_NULL_UNDEFINED;
+        cookie = kInvalidCookie;
       }
-    }
 
-    // Deal with the special @null value -- it turns back to TYPE_NULL.
-    if (value.dataType == Res_value::TYPE_REFERENCE && value.data == 0) {
-      if (kDebugStyles) {
-        ALOGI("-> Setting to @null!");
+      if (!from_values) {
+        theme->SetStyleAttribute(style_key, cur_ident,
+                                 {value, cookie, resid, type_set_flags, config.density});
       }
-      value.dataType = Res_value::TYPE_NULL;
-      value.data = Res_value::DATA_NULL_UNDEFINED;
-      cookie = kInvalidCookie;
     }
 
     if (kDebugStyles) {
@@ -268,6 +292,8 @@ void ApplyStyle(Theme* theme, ResXMLParser* xml_parser, uint32_t def_style_attr,
 
   BagAttributeFinder xml_style_attr_finder(xml_style_bag);
 
+  const Theme::StyleKey style_key{def_style_resid, def_style_flags, style_resid, style_flags};
+
   // Retrieve the XML attributes, if requested.
   XmlAttributeFinder xml_attr_finder(xml_parser);
 
@@ -301,73 +327,94 @@ void ApplyStyle(Theme* theme, ResXMLParser* xml_parser, uint32_t def_style_attr,
       }
     }
 
-    if (value.dataType == Res_value::TYPE_NULL && value.data != Res_value::DATA_NULL_EMPTY) {
-      // Walk through the style class values looking for the requested attribute.
-      const ResolvedBag::Entry* entry = xml_style_attr_finder.Find(cur_ident);
-      if (entry != xml_style_attr_finder.end()) {
-        // We found the attribute we were looking for.
-        cookie = entry->cookie;
-        type_set_flags = style_flags;
-        value = entry->value;
-        if (kDebugStyles) {
-          ALOGI("-> From style: type=0x%x, data=0x%08x", value.dataType, value.data);
+    // Attributes that are not in the XML only depend on the styles and the theme, so they may
+    // have been resolved for an identically styled view before.
+    uint32_t resid = 0u;
+    const bool from_xml = xml_attr_idx != xml_attr_finder.end();
+    const Theme::StyleAttribute* cached_attr =
+        from_xml ? nullptr : theme->GetStyleAttribute(style_key, cur_ident);
+    if (cached_attr != nullptr) {
+      value = cached_attr->value;
+      cookie = cached_attr->cookie;
+      resid = cached_attr->resid;
+      type_set_flags = cached_attr->type_spec_flags;
+      config.density = cached_attr->density;
+      if (kDebugStyles) {
+        ALOGI("-> From style cache: type=0x%x, data=0x%08x", value.dataType, value.data);
+      }
+    } else {
+      if (value.dataType == Res_value::TYPE_NULL && value.data != Res_value::DATA_NULL_EMPTY) {
+        // Walk through the style class values looking for the requested attribute.
+        const ResolvedBag::Entry* entry = xml_style_attr_finder.Find(cur_ident);
+        if (entry != xml_style_attr_finder.end()) {
+          // We found the attribute we were looking for.
+          cookie = entry->cookie;
+          type_set_flags = style_flags;
+          value = entry->value;
+          if (kDebugStyles) {
+            ALOGI("-> From style: type=0x%x, data=0x%08x", value.dataType, value.data);
+          }
         }
       }
-    }
 
-    if (value.dataType == Res_value::TYPE_NULL && value.data != Res_value::DATA_NULL_EMPTY) {
-      // Walk through the default style values looking for the requested attribute.
-      const ResolvedBag::Entry* entry = def_style_attr_finder.Find(cur_ident);
-      if (entry != def_style_attr_finder.end()) {
-        // We found the attribute we were looking for.
-        cookie = entry->cookie;
-        type_set_flags = def_style_flags;
-        value = entry->value;
-        if (kDebugStyles) {
-          ALOGI("-> From def style: type=0x%x, data=0x%08x", value.dataType, value.data);
+      if (value.dataType == Res_value::TYPE_NULL && value.data != Res_value::DATA_NULL_EMPTY) {
+        // Walk through the default style values looking for the requested attribute.
+        const ResolvedBag::Entry* entry = def_style_attr_finder.Find(cur_ident);
+        if (entry != def_style_attr_finder.end()) {
+          // We found the attribute we were looking for.
+          cookie = entry->cookie;
+          type_set_flags = def_style_flags;
+          value = entry->value;
+          if (kDebugStyles) {
+            ALOGI("-> From def style: type=0x%x, data=0x%08x", value.dataType, value.data);
+          }
         }
       }
-    }
 
-    uint32_t resid = 0u;
-    if (value.dataType != Res_value::TYPE_NULL) {
-      // Take care of resolving the found resource to its final value.
-      ApkAssetsCookie new_cookie =
-          theme->ResolveAttributeReference(cookie, &value, &config, &type_set_flags, &resid);
-      if (new_cookie != kInvalidCookie) {
-        cookie = new_cookie;
-      }
+      if (value.dataType != Res_value::TYPE_NULL) {
+        // Take care of resolving the found resource to its final value.
+        ApkAssetsCookie new_cookie =
+            theme->ResolveAttributeReference(cookie, &value, &config, &type_set_flags, &resid);
+        if (new_cookie != kInvalidCookie) {
+          cookie = new_cookie;
+        }
 
-      if (kDebugStyles) {
-        ALOGI("-> Resolved attr: type=0x%x, data=0x%08x", value.dataType, value.data);
-      }
-    } else if (value.data != Res_value::DATA_NULL_EMPTY) {
-      // If we still don't have a value for this attribute, try to find it in the theme!
-      ApkAssetsCookie new_cookie = theme->GetAttribute(cur_ident, &value, &type_set_flags);
-      if (new_cookie != kInvalidCookie) {
         if (kDebugStyles) {
-          ALOGI("-> From theme: type=0x%x, data=0x%08x", value.dataType, value.data);
+          ALOGI("-> Resolved attr: type=0x%x, data=0x%08x", value.dataType, value.data);
         }
-        new_cookie =
-            assetmanager->ResolveReference(new_cookie, &value, &config, &type_set_flags, &resid);
+      } else if (value.data != Res_value::DATA_NULL_EMPTY) {
+        // If we still don't have a value for this attribute, try to find it in the theme!
+        ApkAssetsCookie new_cookie = theme->GetAttribute(cur_ident, &value, &type_set_flags);
         if (new_cookie != kInvalidCookie) {
-          cookie = new_cookie;
+          if (kDebugStyles) {
+            ALOGI("-> From theme: type=0x%x, data=0x%08x", value.dataType, value.data);
+          }
+          new_cookie =
+              assetmanager->ResolveReference(new_cookie, &value, &config, &type_set_flags, &resid);
+          if (new_cookie != kInvalidCookie) {
+            cookie = new_cookie;
+          }
+
+          if (kDebugStyles) {
+            ALOGI("-> Resolved theme: type=0x%x, data=0x%08x", value.dataType, value.data);
+          }
         }
+      }
 
+      // Deal with the special @null value -- it turns back to TYPE_NULL.
+      if (value.dataType == Res_value::TYPE_REFERENCE && value.data == 0) {
         if (kDebugStyles) {
-          ALOGI("-> Resolved theme: type=0x%x, data=0x%08x", value.dataType, value.data);
+          ALOGI("-> Setting to @null!");
         }
+        value.dataType = Res_value::TYPE_NULL;
+        value.data = Res_value::DATA_NULL_UNDEFINED;
+        cookie = kInvalidCookie;
       }
-    }
 
-    // Deal with the special @null value -- it turns back to TYPE_NULL.
-    if (value.dataType == Res_value::TYPE_REFERENCE && value.data == 0) {
-      if (kDebugStyles) {
-        ALOGI("-> Setting to @null!");
+      if (!from_xml) {
+        theme->SetStyleAttribute(style_key, cur_ident,
+                                 {value, cookie, resid, type_set_flags, config.density});
       }
-      value.dataType = Res_value::TYPE_NULL;
-      value.data = Res_value::DATA_NULL_UNDEFINED;
-      cookie = kInvalidCookie;
     }
 
     if (kDebugStyles) {
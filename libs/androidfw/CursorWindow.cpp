@@ -139,13 +139,10 @@ status_t CursorWindow::clear() {
         return INVALID_OPERATION;
     }
 
-    mHeader->freeOffset = sizeof(Header) + sizeof(RowSlotChunk);
-    mHeader->firstChunkOffset = sizeof(Header);
+    mHeader->freeOffset = sizeof(Header);
+    mHeader->slotsOffset = mSize;
     mHeader->numRows = 0;
     mHeader->numColumns = 0;
-
-    RowSlotChunk* firstChunk = static_cast<RowSlotChunk*>(offsetToPtr(mHeader->firstChunkOffset));
-    firstChunk->nextChunkOffset = 0;
     return OK;
 }
 
@@ -179,6 +176,7 @@ status_t CursorWindow::allocRow() {
     uint32_t fieldDirOffset = alloc(fieldDirSize, true /*aligned*/);
     if (!fieldDirOffset) {
         mHeader->numRows--;
+        mHeader->slotsOffset += sizeof(RowSlot);
         LOG_WINDOW("The row failed, so back out the new row accounting "
                 "from allocRowSlot %d", mHeader->numRows);
         return NO_MEMORY;
@@ -199,10 +197,84 @@ status_t CursorWindow::freeLastRow() {
 
     if (mHeader->numRows > 0) {
         mHeader->numRows--;
+        mHeader->slotsOffset += sizeof(RowSlot);
     }
     return OK;
 }
 
+status_t CursorWindow::appendRow(const FieldValue* values) {
+    if (mReadOnly) {
+        return INVALID_OPERATION;
+    }
+
+    // Size the whole row up front: its slot, the field directory (4 byte aligned)
+    // and the blob and string data that follows it. 64 bits so that the sum of
+    // many large fields can't wrap.
+    uint32_t numColumns = mHeader->numColumns;
+    uint32_t fieldDirOffset = mHeader->freeOffset + ((~mHeader->freeOffset + 1) & 3);
+    uint64_t rowEnd = uint64_t(fieldDirOffset) + numColumns * sizeof(FieldSlot);
+    for (uint32_t i = 0; i < numColumns; i++) {
+        switch (values[i].type) {
+            case FIELD_TYPE_STRING:
+            case FIELD_TYPE_BLOB:
+                rowEnd += values[i].data.buffer.size;
+                break;
+            case FIELD_TYPE_NULL:
+            case FIELD_TYPE_INTEGER:
+            case FIELD_TYPE_FLOAT:
+                break;
+            default:
+                ALOGE("Unknown field type %d in column %d", values[i].type, i);
+                return BAD_VALUE;
+        }
+    }
+    if (rowEnd + sizeof(RowSlot) > mHeader->slotsOffset) {
+        ALOGW("Window is full: requested row of %" PRIu64 " bytes, "
+                "free space %zu bytes, window size %zu bytes",
+                rowEnd + sizeof(RowSlot) - mHeader->freeOffset, freeSpace(), mSize);
+        return NO_MEMORY;
+    }
+
+    // Everything fits, so nothing below can fail.
+    uint8_t* data = static_cast<uint8_t*>(mData);
+    FieldSlot* fieldDir = reinterpret_cast<FieldSlot*>(data + fieldDirOffset);
+    uint32_t dataOffset = fieldDirOffset + numColumns * sizeof(FieldSlot);
+    for (uint32_t i = 0; i < numColumns; i++) {
+        const FieldValue& value = values[i];
+        FieldSlot* fieldSlot = &fieldDir[i];
+        fieldSlot->type = value.type;
+        switch (value.type) {
+            case FIELD_TYPE_STRING:
+            case FIELD_TYPE_BLOB:
+                memcpy(data + dataOffset, value.data.buffer.data, value.data.buffer.size);
+                fieldSlot->data.buffer.offset = dataOffset;
+                fieldSlot->data.buffer.size = value.data.buffer.size;
+                dataOffset += value.data.buffer.size;
+                break;
+            case FIELD_TYPE_INTEGER:
+                fieldSlot->data.l = value.data.l;
+                break;
+            case FIELD_TYPE_FLOAT:
+                fieldSlot->data.d = value.data.d;
+                break;
+            default:
+                fieldSlot->data.buffer.offset = 0;
+                fieldSlot->data.buffer.size = 0;
+                break;
+        }
+    }
+
+    mHeader->freeOffset = dataOffset;
+    mHeader->slotsOffset -= sizeof(RowSlot);
+    RowSlot* rowSlot = reinterpret_cast<RowSlot*>(data + mHeader->slotsOffset);
+    rowSlot->offset = fieldDirOffset;
+    mHeader->numRows += 1;
+
+    LOG_WINDOW("Appended row %u, fieldDir at offset %u, %u bytes of data\n",
+            mHeader->numRows - 1, fieldDirOffset, dataOffset - fieldDirOffset);
+    return OK;
+}
+
 uint32_t CursorWindow::alloc(size_t size, bool aligned) {
     uint32_t padding;
     if (aligned) {
@@ -214,7 +286,7 @@ uint32_t CursorWindow::alloc(size_t size, bool aligned) {
 
     uint32_t offset = mHeader->freeOffset + padding;
     uint32_t nextFreeOffset = offset + size;
-    if (nextFreeOffset > mSize) {
+    if (nextFreeOffset > mHeader->slotsOffset) {
         ALOGW("Window is full: requested allocation %zu bytes, "
                 "free space %zu bytes, window size %zu bytes",
                 size, freeSpace(), mSize);
@@ -226,37 +298,20 @@ uint32_t CursorWindow::alloc(size_t size, bool aligned) {
 }
 
 CursorWindow::RowSlot* CursorWindow::getRowSlot(uint32_t row) {
-    uint32_t chunkPos = row;
-    RowSlotChunk* chunk = static_cast<RowSlotChunk*>(
-            offsetToPtr(mHeader->firstChunkOffset));
-    while (chunkPos >= ROW_SLOT_CHUNK_NUM_ROWS) {
-        chunk = static_cast<RowSlotChunk*>(offsetToPtr(chunk->nextChunkOffset));
-        chunkPos -= ROW_SLOT_CHUNK_NUM_ROWS;
-    }
-    return &chunk->slots[chunkPos];
+    // Row slots are stored in reverse order from the end of the window.
+    return static_cast<RowSlot*>(offsetToPtr(mSize - (row + 1) * sizeof(RowSlot),
+            sizeof(RowSlot)));
 }
 
 CursorWindow::RowSlot* CursorWindow::allocRowSlot() {
-    uint32_t chunkPos = mHeader->numRows;
-    RowSlotChunk* chunk = static_cast<RowSlotChunk*>(
-            offsetToPtr(mHeader->firstChunkOffset));
-    while (chunkPos > ROW_SLOT_CHUNK_NUM_ROWS) {
-        chunk = static_cast<RowSlotChunk*>(offsetToPtr(chunk->nextChunkOffset));
-        chunkPos -= ROW_SLOT_CHUNK_NUM_ROWS;
-    }
-    if (chunkPos == ROW_SLOT_CHUNK_NUM_ROWS) {
-        if (!chunk->nextChunkOffset) {
-            chunk->nextChunkOffset = alloc(sizeof(RowSlotChunk), true /*aligned*/);
-            if (!chunk->nextChunkOffset) {
-                return NULL;
-            }
-        }
-        chunk = static_cast<RowSlotChunk*>(offsetToPtr(chunk->nextChunkOffset));
-        chunk->nextChunkOffset = 0;
-        chunkPos = 0;
+    if (mHeader->slotsOffset - mHeader->freeOffset < sizeof(RowSlot)) {
+        ALOGW("Window is full: no space for another row slot, window size %zu bytes",
+                mSize);
+        return NULL;
     }
+    mHeader->slotsOffset -= sizeof(RowSlot);
     mHeader->numRows += 1;
-    return &chunk->slots[chunkPos];
+    return static_cast<RowSlot*>(offsetToPtr(mHeader->slotsOffset));
 }
 
 CursorWindow::FieldSlot* CursorWindow::getFieldSlot(uint32_t row, uint32_t column) {
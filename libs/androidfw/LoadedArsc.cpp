@@ -19,8 +19,11 @@
 #include "androidfw/LoadedArsc.h"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cstddef>
 #include <limits>
+#include <thread>
 
 #include "android-base/logging.h"
 #include "android-base/stringprintf.h"
@@ -44,6 +47,9 @@ namespace android {
 
 constexpr const static int kAppPackageId = 0x7f;
 
+// The most threads, including the calling one, that load the packages of a single table.
+constexpr const static size_t kMaxPackageLoadThreads = 4u;
+
 namespace {
 
 // Builder that helps accumulate Type structs and then create a single
@@ -84,6 +90,28 @@ class TypeSpecPtrBuilder {
   std::vector<const ResTable_type*> types_;
 };
 
+// Maps the key string of every entry in every configuration of `type_spec` to the entry's index.
+// When several entries share a key, the first one found wins.
+std::unordered_map<uint32_t, uint16_t> BuildEntryNameIndex(const TypeSpec* type_spec) {
+  std::unordered_map<uint32_t, uint16_t> index;
+  const auto iter_end = type_spec->types + type_spec->type_count;
+  for (auto iter = type_spec->types; iter != iter_end; ++iter) {
+    const ResTable_type* type = *iter;
+    size_t entry_count = dtohl(type->entryCount);
+    const uint32_t* entry_offsets = reinterpret_cast<const uint32_t*>(
+        reinterpret_cast<const uint8_t*>(type) + dtohs(type->header.headerSize));
+    for (size_t entry_idx = 0; entry_idx < entry_count; entry_idx++) {
+      const uint32_t offset = dtohl(entry_offsets[entry_idx]);
+      if (offset != ResTable_type::NO_ENTRY) {
+        const ResTable_entry* entry = reinterpret_cast<const ResTable_entry*>(
+            reinterpret_cast<const uint8_t*>(type) + dtohl(type->entriesStart) + offset);
+        index.emplace(dtohl(entry->key.index), static_cast<uint16_t>(entry_idx));
+      }
+    }
+  }
+  return index;
+}
+
 }  // namespace
 
 LoadedPackage::LoadedPackage() = default;
@@ -335,26 +363,22 @@ uint32_t LoadedPackage::FindEntryByName(const std::u16string& type_name,
     return 0u;
   }
 
-  const auto iter_end = type_spec->types + type_spec->type_count;
-  for (auto iter = type_spec->types; iter != iter_end; ++iter) {
-    const ResTable_type* type = *iter;
-    size_t entry_count = dtohl(type->entryCount);
-    for (size_t entry_idx = 0; entry_idx < entry_count; entry_idx++) {
-      const uint32_t* entry_offsets = reinterpret_cast<const uint32_t*>(
-          reinterpret_cast<const uint8_t*>(type) + dtohs(type->header.headerSize));
-      const uint32_t offset = dtohl(entry_offsets[entry_idx]);
-      if (offset != ResTable_type::NO_ENTRY) {
-        const ResTable_entry* entry = reinterpret_cast<const ResTable_entry*>(
-            reinterpret_cast<const uint8_t*>(type) + dtohl(type->entriesStart) + offset);
-        if (dtohl(entry->key.index) == static_cast<uint32_t>(key_idx)) {
-          // The package ID will be overridden by the caller (due to runtime assignment of package
-          // IDs for shared libraries).
-          return make_resid(0x00, type_idx + type_id_offset_ + 1, entry_idx);
-        }
-      }
-    }
+  std::lock_guard<std::mutex> lock(entry_name_indexes_lock_);
+  if (entry_name_indexes_.size() <= static_cast<size_t>(type_idx)) {
+    entry_name_indexes_.resize(type_idx + 1);
+  }
+  std::unique_ptr<const EntryNameIndex>& index = entry_name_indexes_[type_idx];
+  if (index == nullptr) {
+    index = util::make_unique<const EntryNameIndex>(BuildEntryNameIndex(type_spec));
   }
-  return 0u;
+
+  auto iter = index->find(static_cast<uint32_t>(key_idx));
+  if (iter == index->end()) {
+    return 0u;
+  }
+  // The package ID will be overridden by the caller (due to runtime assignment of package
+  // IDs for shared libraries).
+  return make_resid(0x00, type_idx + type_id_offset_ + 1, iter->second);
 }
 
 const LoadedPackage* LoadedArsc::GetPackageById(uint8_t package_id) const {
@@ -409,10 +433,12 @@ std::unique_ptr<const LoadedPackage> LoadedPackage::Load(const Chunk& chunk,
   util::ReadUtf16StringFromDevice(header->name, arraysize(header->name),
                                   &loaded_package->package_name_);
 
-  // A map of TypeSpec builders, each associated with an type index.
+  // TypeSpec builders, indexed by type index.
   // We use these to accumulate the set of Types available for a TypeSpec, and later build a single,
   // contiguous block of memory that holds all the Types together with the TypeSpec.
-  std::unordered_map<int, std::unique_ptr<TypeSpecPtrBuilder>> type_builder_map;
+  // Type IDs fit in a byte, so a flat array avoids hashing the ID of every type chunk.
+  std::array<std::unique_ptr<TypeSpecPtrBuilder>, std::numeric_limits<uint8_t>::max() + 1>
+      type_builder_map;
 
   ChunkIterator iter(chunk.data_ptr(), chunk.data_size());
   while (iter.HasNext()) {
@@ -566,9 +592,12 @@ std::unique_ptr<const LoadedPackage> LoadedPackage::Load(const Chunk& chunk,
   }
 
   // Flatten and construct the TypeSpecs.
-  for (auto& entry : type_builder_map) {
-    uint8_t type_idx = static_cast<uint8_t>(entry.first);
-    TypeSpecPtr type_spec_ptr = entry.second->Build();
+  for (size_t i = 0; i < type_builder_map.size(); i++) {
+    if (type_builder_map[i] == nullptr) {
+      continue;
+    }
+    uint8_t type_idx = static_cast<uint8_t>(i);
+    TypeSpecPtr type_spec_ptr = type_builder_map[i]->Build();
     if (type_spec_ptr == nullptr) {
       LOG(ERROR) << "Too many type configurations, overflow detected.";
       return {};
@@ -599,7 +628,9 @@ bool LoadedArsc::LoadTable(const Chunk& chunk, const LoadedIdmap* loaded_idmap,
   const size_t package_count = dtohl(header->packageCount);
   size_t packages_seen = 0;
 
-  packages_.reserve(package_count);
+  // Packages don't depend on each other, so they are loaded once all of them are found.
+  std::vector<Chunk> package_chunks;
+  package_chunks.reserve(package_count);
 
   ChunkIterator iter(chunk.data_ptr(), chunk.data_size());
   while (iter.HasNext()) {
@@ -626,13 +657,7 @@ bool LoadedArsc::LoadTable(const Chunk& chunk, const LoadedIdmap* loaded_idmap,
           return false;
         }
         packages_seen++;
-
-        std::unique_ptr<const LoadedPackage> loaded_package =
-            LoadedPackage::Load(child_chunk, loaded_idmap, system_, load_as_shared_library);
-        if (!loaded_package) {
-          return false;
-        }
-        packages_.push_back(std::move(loaded_package));
+        package_chunks.push_back(child_chunk);
       } break;
 
       default:
@@ -647,6 +672,38 @@ bool LoadedArsc::LoadTable(const Chunk& chunk, const LoadedIdmap* loaded_idmap,
       return false;
     }
   }
+
+  // Tables with several packages load them in parallel. This thread and a few helpers each take
+  // the next package that nobody has started on, until all are loaded or one fails.
+  std::vector<std::unique_ptr<const LoadedPackage>> loaded_packages(package_chunks.size());
+  std::atomic<size_t> next_package(0u);
+  std::atomic<bool> failed(false);
+  auto load_packages = [&]() {
+    for (size_t i = next_package++; i < package_chunks.size() && !failed; i = next_package++) {
+      loaded_packages[i] =
+          LoadedPackage::Load(package_chunks[i], loaded_idmap, system_, load_as_shared_library);
+      if (loaded_packages[i] == nullptr) {
+        failed = true;
+      }
+    }
+  };
+
+  std::vector<std::thread> helpers;
+  for (size_t i = 1; i < std::min(package_chunks.size(), kMaxPackageLoadThreads); i++) {
+    helpers.emplace_back(load_packages);
+  }
+  load_packages();
+  for (std::thread& helper : helpers) {
+    helper.join();
+  }
+  if (failed) {
+    return false;
+  }
+
+  packages_.reserve(packages_.size() + loaded_packages.size());
+  for (auto& loaded_package : loaded_packages) {
+    packages_.push_back(std::move(loaded_package));
+  }
   return true;
 }
 
@@ -27,6 +27,7 @@
 #include <algorithm>
 #include <limits>
 #include <memory>
+#include <new>
 #include <type_traits>
 
 #include <androidfw/ByteBucketArray.h>
@@ -416,13 +417,25 @@ Res_png_9patch* Res_png_9patch::deserialize(void* inData)
 // --------------------------------------------------------------------
 // --------------------------------------------------------------------
 
+// A chunk of memory that decoded strings are carved out of. The strings follow the header.
+struct ResStringPool::DecodeArenaBlock
+{
+    DecodeArenaBlock* next;
+    size_t used;
+    size_t capacity;
+};
+
+// Most decoded strings are short, so they are packed into blocks of this size rather than
+// allocated one by one.
+static const size_t kDecodeArenaBlockSize = 16 * 1024;
+
 ResStringPool::ResStringPool()
-    : mError(NO_INIT), mOwnedData(NULL), mHeader(NULL), mCache(NULL)
+    : mError(NO_INIT), mOwnedData(NULL), mHeader(NULL), mCache(NULL), mDecodeArena(NULL)
 {
 }
 
 ResStringPool::ResStringPool(const void* data, size_t size, bool copyData)
-    : mError(NO_INIT), mOwnedData(NULL), mHeader(NULL), mCache(NULL)
+    : mError(NO_INIT), mOwnedData(NULL), mHeader(NULL), mCache(NULL), mDecodeArena(NULL)
 {
     setTo(data, size, copyData);
 }
@@ -651,15 +664,11 @@ status_t ResStringPool::getError() const
 void ResStringPool::uninit()
 {
     mError = NO_INIT;
-    if (mHeader != NULL && mCache != NULL) {
-        for (size_t x = 0; x < mHeader->stringCount; x++) {
-            if (mCache[x] != NULL) {
-                free(mCache[x]);
-                mCache[x] = NULL;
-            }
-        }
-        free(mCache);
-        mCache = NULL;
+    delete[] mCache.exchange(NULL);
+    while (mDecodeArena != NULL) {
+        DecodeArenaBlock* next = mDecodeArena->next;
+        free(mDecodeArena);
+        mDecodeArena = next;
     }
     if (mOwnedData) {
         free(mOwnedData);
@@ -743,64 +752,13 @@ const char16_t* ResStringPool::stringAt(size_t idx, size_t* u16len) const
 
                 // encLen must be less than 0x7FFF due to encoding.
                 if ((uint32_t)(u8str+u8len-strings) < mStringPoolSize) {
-                    AutoMutex lock(mDecodeLock);
-
-                    if (mCache != NULL && mCache[idx] != NULL) {
-                        return mCache[idx];
-                    }
-
-                    // Retrieve the actual length of the utf8 string if the
-                    // encoded length was truncated
-                    if (stringDecodeAt(idx, u8str, u8len, &u8len) == NULL) {
-                        return NULL;
-                    }
-
-                    // Since AAPT truncated lengths longer than 0x7FFF, check
-                    // that the bits that remain after truncation at least match
-                    // the bits of the actual length
-                    ssize_t actualLen = utf8_to_utf16_length(u8str, u8len);
-                    if (actualLen < 0 || ((size_t)actualLen & 0x7FFF) != *u16len) {
-                        ALOGW("Bad string block: string #%lld decoded length is not correct "
-                                "%lld vs %llu\n",
-                                (long long)idx, (long long)actualLen, (long long)*u16len);
-                        return NULL;
-                    }
-
-                    *u16len = (size_t) actualLen;
-                    char16_t *u16str = (char16_t *)calloc(*u16len+1, sizeof(char16_t));
-                    if (!u16str) {
-                        ALOGW("No memory when trying to allocate decode cache for string #%d\n",
-                                (int)idx);
-                        return NULL;
-                    }
-
-                    utf8_to_utf16(u8str, u8len, u16str, *u16len + 1);
-
-                    if (mCache == NULL) {
-#ifndef __ANDROID__
-                        if (kDebugStringPoolNoisy) {
-                            ALOGI("CREATING STRING CACHE OF %zu bytes",
-                                  mHeader->stringCount*sizeof(char16_t**));
-                        }
-#else
-                        // We do not want to be in this case when actually running Android.
-                        ALOGW("CREATING STRING CACHE OF %zu bytes",
-                                static_cast<size_t>(mHeader->stringCount*sizeof(char16_t**)));
-#endif
-                        mCache = (char16_t**)calloc(mHeader->stringCount, sizeof(char16_t*));
-                        if (mCache == NULL) {
-                            ALOGW("No memory trying to allocate decode cache table of %d bytes\n",
-                                  (int)(mHeader->stringCount*sizeof(char16_t**)));
-                            return NULL;
-                        }
+                    const char16_t* cached = cachedStringAt(idx, u16len);
+                    if (cached != NULL) {
+                        return cached;
                     }
 
-                    if (kDebugStringPoolNoisy) {
-                      ALOGI("Caching UTF8 string: %s", u8str);
-                    }
-
-                    mCache[idx] = u16str;
-                    return u16str;
+                    AutoMutex lock(mDecodeLock);
+                    return decodeStringLocked(idx, u8str, u8len, u16len);
                 } else {
                     ALOGW("Bad string block: string #%lld extends to %lld, past end at %lld\n",
                             (long long)idx, (long long)(u8str+u8len-strings),
@@ -816,6 +774,126 @@ const char16_t* ResStringPool::stringAt(size_t idx, size_t* u16len) const
     return NULL;
 }
 
+// Decoded strings are stored as their UTF16 length followed by the NUL-terminated characters.
+// The cache points at the characters.
+static inline size_t decodedLength(const char16_t* u16str)
+{
+    return reinterpret_cast<const size_t*>(u16str)[-1];
+}
+
+const char16_t* ResStringPool::cachedStringAt(size_t idx, size_t* outLen) const
+{
+    std::atomic<char16_t*>* cache = mCache.load(std::memory_order_acquire);
+    if (cache == NULL) {
+        return NULL;
+    }
+    char16_t* u16str = cache[idx].load(std::memory_order_acquire);
+    if (u16str != NULL) {
+        *outLen = decodedLength(u16str);
+    }
+    return u16str;
+}
+
+const char16_t* ResStringPool::decodeStringLocked(size_t idx, const uint8_t* u8str, size_t u8len,
+                                                  size_t* u16len) const
+{
+    // Another thread may have decoded it while we waited for the lock.
+    const char16_t* cached = cachedStringAt(idx, u16len);
+    if (cached != NULL) {
+        return cached;
+    }
+
+    // Retrieve the actual length of the utf8 string if the
+    // encoded length was truncated
+    if (stringDecodeAt(idx, u8str, u8len, &u8len) == NULL) {
+        return NULL;
+    }
+
+    // Since AAPT truncated lengths longer than 0x7FFF, check
+    // that the bits that remain after truncation at least match
+    // the bits of the actual length
+    ssize_t actualLen = utf8_to_utf16_length(u8str, u8len);
+    if (actualLen < 0 || ((size_t)actualLen & 0x7FFF) != *u16len) {
+        ALOGW("Bad string block: string #%lld decoded length is not correct "
+                "%lld vs %llu\n",
+                (long long)idx, (long long)actualLen, (long long)*u16len);
+        return NULL;
+    }
+
+    std::atomic<char16_t*>* cache = mCache.load(std::memory_order_relaxed);
+    if (cache == NULL) {
+#ifndef __ANDROID__
+        if (kDebugStringPoolNoisy) {
+            ALOGI("CREATING STRING CACHE OF %zu bytes",
+                  mHeader->stringCount*sizeof(char16_t**));
+        }
+#else
+        // We do not want to be in this case when actually running Android.
+        ALOGW("CREATING STRING CACHE OF %zu bytes",
+                static_cast<size_t>(mHeader->stringCount*sizeof(char16_t**)));
+#endif
+        cache = new (std::nothrow) std::atomic<char16_t*>[mHeader->stringCount]();
+        if (cache == NULL) {
+            ALOGW("No memory trying to allocate decode cache table of %d bytes\n",
+                  (int)(mHeader->stringCount*sizeof(char16_t**)));
+            return NULL;
+        }
+        mCache.store(cache, std::memory_order_release);
+    }
+
+    *u16len = (size_t) actualLen;
+    size_t* decoded = reinterpret_cast<size_t*>(
+            allocDecodedLocked(sizeof(size_t) + (*u16len + 1) * sizeof(char16_t)));
+    if (!decoded) {
+        ALOGW("No memory when trying to allocate decode cache for string #%d\n",
+                (int)idx);
+        return NULL;
+    }
+    decoded[0] = *u16len;
+    char16_t* u16str = reinterpret_cast<char16_t*>(decoded + 1);
+    utf8_to_utf16(u8str, u8len, u16str, *u16len + 1);
+
+    if (kDebugStringPoolNoisy) {
+      ALOGI("Caching UTF8 string: %s", u8str);
+    }
+
+    cache[idx].store(u16str, std::memory_order_release);
+    return u16str;
+}
+
+void* ResStringPool::allocDecodedLocked(size_t size) const
+{
+    // Keep every string aligned for its length prefix.
+    size = (size + alignof(size_t) - 1) & ~(alignof(size_t) - 1);
+    DecodeArenaBlock* block = mDecodeArena;
+    if (block == NULL || block->capacity - block->used < size) {
+        const size_t capacity =
+                std::max(size, kDecodeArenaBlockSize - sizeof(DecodeArenaBlock));
+        block = (DecodeArenaBlock*)malloc(sizeof(DecodeArenaBlock) + capacity);
+        if (block == NULL) {
+            return NULL;
+        }
+        block->used = 0;
+        block->capacity = capacity;
+        block->next = mDecodeArena;
+        mDecodeArena = block;
+    }
+    void* result = reinterpret_cast<uint8_t*>(block + 1) + block->used;
+    block->used += size;
+    return result;
+}
+
+void ResStringPool::predecodeStrings() const
+{
+    if (mError != NO_ERROR || !isUTF8()) {
+        return;
+    }
+    size_t len;
+    for (size_t i = 0; i < mHeader->stringCount; i++) {
+        stringAt(i, &len);
+    }
+}
+
 const char* ResStringPool::string8At(size_t idx, size_t* outLen) const
 {
     if (mError == NO_ERROR && idx < mHeader->stringCount) {
@@ -24,7 +24,9 @@
 #include <stdio.h>
 #include <sys/types.h>
 
+#include <future>
 #include <memory>
+#include <string>
 
 #include <utils/Compat.h>
 #include <utils/Errors.h>
@@ -52,6 +54,28 @@ public:
     static int32_t getGlobalCount();
     static String8 getAssetAllocations();
 
+    /*
+     * Set the total size of the process-wide cache of recently inflated
+     * compressed assets.  Shrinking it evicts entries right away; 0 turns
+     * the cache off.
+     */
+    static void setInflatedCacheMaxSize(size_t maxSize);
+
+    /*
+     * Allow large compressed assets to be inflated ahead of use on a small
+     * pool of background threads.  Off by default, so that the zygote never
+     * starts the threads; a process turns it on after it is forked.
+     */
+    static void setReadAheadEnabled(bool enabled);
+
+    /*
+     * Compressed assets at least this large are shared through the cache of
+     * inflated assets when given a cache key, and opening one with
+     * ACCESS_BUFFER queues it to be inflated by a small pool of background
+     * threads, unless read-ahead is off or that pool is already busy.
+     */
+    static const size_t kInflatedCacheMinSize = 128 * 1024;
+
     /* used when opening an asset */
     typedef enum AccessMode {
         ACCESS_UNKNOWN = 0,
@@ -210,7 +234,7 @@ private:
         size_t uncompressedLen, AccessMode mode);
 
     static std::unique_ptr<Asset> createFromCompressedMap(std::unique_ptr<FileMap> dataMap,
-        size_t uncompressedLen, AccessMode mode);
+        size_t uncompressedLen, AccessMode mode, const std::string& cacheKey = std::string());
 
 
     /*
@@ -311,6 +335,17 @@ public:
      */
     status_t openChunk(FileMap* dataMap, size_t uncompressedLen);
 
+    /*
+     * Share the inflated data with other assets opened on the same entry,
+     * through the process-wide cache of inflated assets.  "cacheKey" must
+     * identify the entry and its contents.  If "readAhead" is true and the
+     * entry isn't cached yet, start inflating it on a background thread
+     * instead of on first use.
+     *
+     * Only for memory-mapped input.
+     */
+    void setInflatedCacheKey(const std::string& cacheKey, bool readAhead);
+
     /*
      * Standard Asset interfaces.
      */
@@ -321,7 +356,7 @@ public:
     virtual off64_t getLength(void) const { return mUncompressedLen; }
     virtual off64_t getRemainingLength(void) const { return mUncompressedLen-mOffset; }
     virtual int openFileDescriptor(off64_t* /* outStart */, off64_t* /* outLength */) const { return -1; }
-    virtual bool isAllocated(void) const { return mBuf != NULL; }
+    virtual bool isAllocated(void) const { return mBuf != nullptr || mPendingBuf.valid(); }
 
 private:
     off64_t     mStart;         // offset to start of compressed data
@@ -329,12 +364,17 @@ private:
     off64_t     mUncompressedLen; // length of the uncompressed data
     off64_t     mOffset;        // current offset, 0 == start of uncomp data
 
-    FileMap*    mMap;           // for memory-mapped input
+    std::shared_ptr<FileMap> mMap;  // for memory-mapped input, shared with read-aheads
     int         mFd;            // for file input
 
     class StreamingZipInflater* mZipInflater;  // for streaming large compressed assets
 
-    unsigned char*  mBuf;       // for getBuffer()
+    std::string mCacheKey;      // key in the inflated asset cache, if shared
+
+    std::shared_ptr<unsigned char> mBuf;  // for getBuffer(), may be shared with other assets
+
+    // getBuffer() data still being inflated on a read-ahead thread
+    std::shared_future<std::shared_ptr<unsigned char>> mPendingBuf;
 };
 
 // need: shared mmap version?
@@ -21,6 +21,7 @@
 
 #include <array>
 #include <limits>
+#include <memory>
 #include <set>
 #include <unordered_map>
 
@@ -69,7 +70,31 @@ struct ResolvedBag {
   Entry entries[0];
 };
 
-struct FindEntryResult;
+// The entry selected by AssetManager2::FindEntry().
+struct FindEntryResult {
+  // A pointer to the resource table entry for this resource.
+  // If the size of the entry is > sizeof(ResTable_entry), it can be cast to
+  // a ResTable_map_entry and processed as a bag/map.
+  const ResTable_entry* entry;
+
+  // The configuration for which the resulting entry was defined. This is already swapped to host
+  // endianness.
+  ResTable_config config;
+
+  // The bitmask of configuration axis with which the resource value varies.
+  uint32_t type_flags;
+
+  // The dynamic package ID map for the package from which this resource came from.
+  const DynamicRefTable* dynamic_ref_table;
+
+  // The string pool reference to the type's name. This uses a different string pool than
+  // the global string pool, but this is hidden from the caller.
+  StringPoolRef type_string_ref;
+
+  // The string pool reference to the entry's name. This uses a different string pool than
+  // the global string pool, but this is hidden from the caller.
+  StringPoolRef entry_string_ref;
+};
 
 // AssetManager2 is the main entry point for accessing assets and resources.
 // AssetManager2 provides caching of resources retrieved via the underlying ApkAssets.
@@ -234,9 +259,24 @@ class AssetManager2 {
   // Creates a new Theme from this AssetManager.
   std::unique_ptr<Theme> NewTheme();
 
+  // The state an AssetManager derives from its ApkAssets and configuration. See TakeSnapshot().
+  class Snapshot;
+
+  // Captures the ApkAssets, configuration, package groups with their filtered configurations,
+  // and the bags resolved so far. This is meant to be taken in the zygote once the framework
+  // ApkAssets are preloaded and the common styles resolved, so that processes forked from it can
+  // start from this state rather than rebuilding it. The state is shared, not copied: this
+  // AssetManager and every AssetManager set from the snapshot copy the package groups only when
+  // they first change them. The ApkAssets must outlive the snapshot.
+  std::unique_ptr<const Snapshot> TakeSnapshot() const;
+
+  // Sets the ApkAssets and configuration of this AssetManager to those of `snapshot`, and
+  // shares the state derived from them instead of rebuilding it.
+  void SetFromSnapshot(const Snapshot& snapshot);
+
   template <typename Func>
   void ForEachPackage(Func func) const {
-    for (const PackageGroup& package_group : package_groups_) {
+    for (const PackageGroup& package_group : *package_groups_) {
       func(package_group.packages_.front().loaded_package_->GetPackageName(),
            package_group.dynamic_ref_table.mAssignedPackageId);
     }
@@ -247,6 +287,8 @@ class AssetManager2 {
  private:
   DISALLOW_COPY_AND_ASSIGN(AssetManager2);
 
+  friend class Theme;
+
   // Finds the best entry for `resid` from the set of ApkAssets. The entry can be a simple
   // Res_value, or a complex map/bag type. If successful, it is available in `out_entry`.
   // Returns kInvalidCookie on failure. Otherwise, the return value is the cookie associated with
@@ -274,12 +316,17 @@ class AssetManager2 {
 
   // Triggers the re-construction of lists of types that match the set configuration.
   // This should always be called when mutating the AssetManager's configuration or ApkAssets set.
-  void RebuildFilterList();
+  // `diff` is the set of ResTable_config::CONFIG_* axes that changed; only types with a
+  // configuration that specifies one of them are filtered again.
+  void RebuildFilterList(uint32_t diff = 0xffffffffu);
 
   // AssetManager2::GetBag(resid) wraps this function to track which resource ids have already
   // been seen while traversing bag parents.
   const ResolvedBag* GetBag(uint32_t resid, std::vector<uint32_t>& child_resids);
 
+  // Returns package_groups_ for writing, after copying it if it is shared with a Snapshot.
+  std::vector<PackageGroup>& MutablePackageGroups();
+
   // The ordered list of ApkAssets to search. These are not owned by the AssetManager, and must
   // have a longer lifetime.
   std::vector<const ApkAssets*> apk_assets_;
@@ -289,6 +336,10 @@ class AssetManager2 {
   struct FilteredConfigGroup {
     std::vector<ResTable_config> configurations;
     std::vector<const ResTable_type*> types;
+
+    // The ResTable_config::CONFIG_* axes that affect matching and that any configuration of
+    // the type specifies, whether it matched or not.
+    uint32_t config_axes = 0u;
   };
 
   // Represents an single package.
@@ -320,7 +371,8 @@ class AssetManager2 {
   // These are ordered according to apk_assets_. The mappings may change depending on what is
   // in apk_assets_, therefore they must be stored in the AssetManager and not in the
   // immutable ApkAssets class.
-  std::vector<PackageGroup> package_groups_;
+  // Shared with Snapshots, so it is only written through MutablePackageGroups().
+  std::shared_ptr<std::vector<PackageGroup>> package_groups_;
 
   // An array mapping package ID to index into package_groups. This keeps the lookup fast
   // without taking too much memory.
@@ -331,8 +383,38 @@ class AssetManager2 {
   ResTable_config configuration_;
 
   // Cached set of bags. These are cached because they can inherit keys from parent bags,
-  // which involves some calculation.
-  std::unordered_map<uint32_t, util::unique_cptr<ResolvedBag>> cached_bags_;
+  // which involves some calculation. A bag is never changed once cached, so Snapshots share them.
+  std::unordered_map<uint32_t, std::shared_ptr<const ResolvedBag>> cached_bags_;
+
+  // The result of a successful FindEntry() along with the cookie it returned.
+  struct CachedEntry {
+    ApkAssetsCookie cookie;
+    FindEntryResult result;
+  };
+
+  // Cached results of FindEntry(), keyed by the density override in the upper 32 bits and the
+  // resource ID in the lower 32 bits. A density override equal to the configured density is
+  // stored as 0. Entries are purged like cached_bags_, by the configuration axis they vary with.
+  mutable std::unordered_map<uint64_t, CachedEntry> cached_entries_;
+
+  // Bumped whenever the ApkAssets or the configuration change, so that Themes know to drop the
+  // attributes they have resolved.
+  uint32_t generation_ = 0u;
+};
+
+class AssetManager2::Snapshot {
+ private:
+  friend class AssetManager2;
+
+  DISALLOW_COPY_AND_ASSIGN(Snapshot);
+
+  Snapshot() = default;
+
+  std::vector<const ApkAssets*> apk_assets_;
+  ResTable_config configuration_;
+  std::shared_ptr<const std::vector<PackageGroup>> package_groups_;
+  std::array<uint8_t, std::numeric_limits<uint8_t>::max() + 1> package_ids_;
+  std::unordered_map<uint32_t, std::shared_ptr<const ResolvedBag>> bags_;
 };
 
 class Theme {
@@ -388,15 +470,57 @@ class Theme {
                                             uint32_t* in_out_type_spec_flags = nullptr,
                                             uint32_t* out_last_ref = nullptr) const;
 
+  // The pair of styles, along with their type spec flags, that attributes missing from a view's
+  // XML are resolved against before falling back to this theme.
+  struct StyleKey {
+    uint32_t def_style_resid;
+    uint32_t def_style_flags;
+    uint32_t style_resid;
+    uint32_t style_flags;
+
+    inline bool operator==(const StyleKey& o) const {
+      return def_style_resid == o.def_style_resid && def_style_flags == o.def_style_flags &&
+             style_resid == o.style_resid && style_flags == o.style_flags;
+    }
+  };
+
+  // The fully resolved value of an attribute, as written out by ApplyStyle() and ResolveAttrs().
+  struct StyleAttribute {
+    Res_value value;
+    ApkAssetsCookie cookie;
+    uint32_t resid;
+    uint32_t type_spec_flags;
+    uint16_t density;
+  };
+
+  // Returns the value of `attr` resolved against the styles in `key` and this theme, if it was
+  // cached with SetStyleAttribute(). Otherwise returns nullptr.
+  // The cache lets identically styled views resolve their attributes once. It is dropped when
+  // this theme changes, or when the ApkAssets or configuration of the AssetManager change.
+  const StyleAttribute* GetStyleAttribute(const StyleKey& key, uint32_t attr) const;
+
+  void SetStyleAttribute(const StyleKey& key, uint32_t attr, const StyleAttribute& value) const;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(Theme);
 
   // Called by AssetManager2.
   explicit Theme(AssetManager2* asset_manager);
 
+  // Drops the cached style attributes if the AssetManager changed since they were resolved.
+  void ValidateStyleCache() const;
+
+  struct StyleKeyHash {
+    size_t operator()(const StyleKey& key) const;
+  };
+
   AssetManager2* asset_manager_;
   uint32_t type_spec_flags_ = 0u;
 
+  mutable uint32_t style_cache_generation_ = 0u;
+  mutable std::unordered_map<StyleKey, std::unordered_map<uint32_t, StyleAttribute>, StyleKeyHash>
+      style_cache_;
+
   // Defined in the cpp.
   struct Package;
 
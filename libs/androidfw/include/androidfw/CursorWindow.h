@@ -41,10 +41,11 @@ namespace android {
 
 /**
  * This class stores a set of rows from a database in a buffer. The begining of the
- * window has first chunk of RowSlots, which are offsets to the row directory, followed by
- * an offset to the next chunk in a linked-list of additional chunk of RowSlots in case
- * the pre-allocated chunk isn't big enough to refer to all rows. Each row directory has a
- * FieldSlot per column, which has the size, offset, and type of the data for that field.
+ * window has a header, followed by the row directories and field data, which grow
+ * upwards. The RowSlots, which are offsets to the row directories, grow downwards
+ * from the end of the window, so the slot for any row is at a fixed offset from
+ * the end. Each row directory has a FieldSlot per column, which has the size,
+ * offset, and type of the data for that field.
  * Note that the data types come from sqlite3.h.
  *
  * Strings are stored in UTF-8.
@@ -79,6 +80,19 @@ public:
         friend class CursorWindow;
     } __attribute((packed));
 
+    /* Describes the value of one field of a row passed to appendRow(). */
+    struct FieldValue {
+        int32_t type;
+        union {
+            double d;
+            int64_t l;
+            struct {
+                const void* data;
+                size_t size;
+            } buffer;
+        } data;
+    };
+
     ~CursorWindow();
 
     static status_t create(const String8& name, size_t size, CursorWindow** outCursorWindow);
@@ -88,7 +102,7 @@ public:
 
     inline String8 name() { return mName; }
     inline size_t size() { return mSize; }
-    inline size_t freeSpace() { return mSize - mHeader->freeOffset; }
+    inline size_t freeSpace() { return mHeader->slotsOffset - mHeader->freeOffset; }
     inline uint32_t getNumRows() { return mHeader->numRows; }
     inline uint32_t getNumColumns() { return mHeader->numColumns; }
 
@@ -102,6 +116,13 @@ public:
     status_t allocRow();
     status_t freeLastRow();
 
+    /**
+     * Appends a row with one value per column, copying the whole row with a
+     * single bounds check rather than one per field.
+     * Returns NO_MEMORY and leaves the window unchanged if the row doesn't fit.
+     */
+    status_t appendRow(const FieldValue* values);
+
     status_t putBlob(uint32_t row, uint32_t column, const void* value, size_t size);
     status_t putString(uint32_t row, uint32_t column, const char* value, size_t sizeIncludingNull);
     status_t putLong(uint32_t row, uint32_t column, int64_t value);
@@ -139,14 +160,13 @@ public:
     }
 
 private:
-    static const size_t ROW_SLOT_CHUNK_NUM_ROWS = 100;
-
     struct Header {
         // Offset of the lowest unused byte in the window.
         uint32_t freeOffset;
 
-        // Offset of the first row slot chunk.
-        uint32_t firstChunkOffset;
+        // Offset of the last allocated row slot. Row slots are stored in
+        // reverse order at the end of the window.
+        uint32_t slotsOffset;
 
         uint32_t numRows;
         uint32_t numColumns;
@@ -156,11 +176,6 @@ private:
         uint32_t offset;
     };
 
-    struct RowSlotChunk {
-        RowSlot slots[ROW_SLOT_CHUNK_NUM_ROWS];
-        uint32_t nextChunkOffset;
-    };
-
     String8 mName;
     int mAshmemFd;
     void* mData;
@@ -18,7 +18,9 @@
 #define LOADEDARSC_H_
 
 #include <memory>
+#include <mutex>
 #include <set>
+#include <unordered_map>
 #include <vector>
 
 #include "android-base/macros.h"
@@ -89,6 +91,8 @@ class LoadedPackage {
   // the default policy in AAPT2 is to build UTF-8 string pools, this needs to change.
   // Returns a partial resource ID, with the package ID left as 0x00. The caller is responsible
   // for patching the correct package ID to the resource ID.
+  // The first lookup in a type indexes the names of all its entries, so later lookups in that type
+  // don't scan its entries.
   uint32_t FindEntryByName(const std::u16string& type_name, const std::u16string& entry_name) const;
 
   static const ResTable_entry* GetEntry(const ResTable_type* type_chunk, uint16_t entry_index);
@@ -183,6 +187,16 @@ class LoadedPackage {
 
   ByteBucketArray<TypeSpecPtr> type_specs_;
   std::vector<DynamicPackageEntry> dynamic_package_map_;
+
+  // Maps an index into key_string_pool_ to the index of the entry with that name.
+  using EntryNameIndex = std::unordered_map<uint32_t, uint16_t>;
+
+  // The entry name index of each type, by type index. An index is built by the first
+  // FindEntryByName() in its type. Packages are shared between AssetManagers on any thread, so
+  // access is guarded by entry_name_indexes_lock_. Indexes built in the zygote, before fork, are
+  // shared with its children.
+  mutable std::mutex entry_name_indexes_lock_;
+  mutable std::vector<std::unique_ptr<const EntryNameIndex>> entry_name_indexes_;
 };
 
 // Read-only view into a resource table. This class validates all data
@@ -34,6 +34,7 @@
 
 #include <android/configuration.h>
 
+#include <atomic>
 #include <memory>
 
 namespace android {
@@ -506,6 +507,11 @@ public:
     }
     const char16_t* stringAt(size_t idx, size_t* outLen) const;
 
+    // Decodes every string of a UTF8 pool to UTF16 up front, so that later calls to stringAt()
+    // only read the cache. Meant for pools that are known to be read heavily, since the UTF16
+    // copies stay around for the lifetime of the pool.
+    void predecodeStrings() const;
+
     // Note: returns null if the string pool is not UTF8.
     const char* string8At(size_t idx, size_t* outLen) const;
 
@@ -526,21 +532,32 @@ public:
     bool isUTF8() const;
 
 private:
+    struct DecodeArenaBlock;
+
     status_t                    mError;
     void*                       mOwnedData;
     const ResStringPool_header* mHeader;
     size_t                      mSize;
-    mutable Mutex               mDecodeLock;
+    mutable Mutex               mDecodeLock;        // guards decoding and mDecodeArena
     const uint32_t*             mEntries;
     const uint32_t*             mEntryStyles;
     const void*                 mStrings;
-    char16_t mutable**          mCache;
+    // UTF16 copies of the strings of a UTF8 pool, indexed by string. The table and its slots are
+    // published with release stores, so strings that are already decoded are read without
+    // taking mDecodeLock.
+    mutable std::atomic<std::atomic<char16_t*>*> mCache;
+    // The blocks holding the decoded strings, most recent first.
+    mutable DecodeArenaBlock*   mDecodeArena;
     uint32_t                    mStringPoolSize;    // number of uint16_t
     const uint32_t*             mStyles;
     uint32_t                    mStylePoolSize;    // number of uint32_t
 
     const char* stringDecodeAt(size_t idx, const uint8_t* str, const size_t encLen,
                                size_t* outLen) const;
+    const char16_t* cachedStringAt(size_t idx, size_t* outLen) const;
+    const char16_t* decodeStringLocked(size_t idx, const uint8_t* u8str, size_t u8len,
+                                       size_t* u16len) const;
+    void* allocDecodedLocked(size_t size) const;
 };
 
 /**
@@ -128,6 +128,49 @@ static void BM_AssetManagerGetResourceFrameworkLocaleOld(benchmark::State& state
 }
 BENCHMARK(BM_AssetManagerGetResourceFrameworkLocaleOld);
 
+// Looks up a spread of framework strings and app resources, the way inflating a large layout
+// revisits the same IDs over and over.
+static void BM_AssetManagerGetResourcesFrameworkAndApp(benchmark::State& state) {
+  std::unique_ptr<const ApkAssets> framework_apk = ApkAssets::Load(kFrameworkPath);
+  std::unique_ptr<const ApkAssets> app_apk =
+      ApkAssets::Load(GetTestDataPath() + "/basic/basic.apk");
+  if (framework_apk == nullptr || app_apk == nullptr) {
+    state.SkipWithError("Failed to load assets");
+    return;
+  }
+
+  AssetManager2 assets;
+  assets.SetApkAssets({framework_apk.get(), app_apk.get()});
+
+  ResTable_config config;
+  memset(&config, 0, sizeof(config));
+  memcpy(config.language, "fr", 2);
+  assets.SetConfiguration(config);
+
+  std::vector<uint32_t> resids;
+  for (uint32_t i = 0; i < 64; i++) {
+    resids.push_back(0x01040000u + i);
+  }
+  resids.push_back(basic::R::integer::number1);
+  resids.push_back(basic::R::integer::number2);
+  resids.push_back(basic::R::string::test1);
+  resids.push_back(basic::R::string::test2);
+
+  Res_value value;
+  ResTable_config selected_config;
+  uint32_t flags;
+
+  while (state.KeepRunning()) {
+    for (uint32_t resid : resids) {
+      ApkAssetsCookie cookie = assets.GetResource(resid, false /* may_be_bag */,
+                                                  0u /* density_override */, &value,
+                                                  &selected_config, &flags);
+      benchmark::DoNotOptimize(cookie);
+    }
+  }
+}
+BENCHMARK(BM_AssetManagerGetResourcesFrameworkAndApp);
+
 static void BM_AssetManagerGetBag(benchmark::State& state) {
   std::unique_ptr<const ApkAssets> apk = ApkAssets::Load(GetTestDataPath() + "/styles/styles.apk");
   if (apk == nullptr) {
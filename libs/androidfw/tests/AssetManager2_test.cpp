@@ -145,6 +145,107 @@ TEST_F(AssetManager2Test, FindsResourceFromMultipleApkAssets) {
   EXPECT_EQ(Res_value::TYPE_STRING, value.dataType);
 }
 
+TEST_F(AssetManager2Test, FindsResourceAgainAfterConfigurationChange) {
+  ResTable_config desired_config;
+  memset(&desired_config, 0, sizeof(desired_config));
+  desired_config.language[0] = 'd';
+  desired_config.language[1] = 'e';
+
+  AssetManager2 assetmanager;
+  assetmanager.SetConfiguration(desired_config);
+  assetmanager.SetApkAssets({basic_assets_.get(), basic_de_fr_assets_.get()});
+
+  Res_value value;
+  ResTable_config selected_config;
+  uint32_t flags;
+
+  ApkAssetsCookie cookie =
+      assetmanager.GetResource(basic::R::string::test1, false /*may_be_bag*/,
+                               0 /*density_override*/, &value, &selected_config, &flags);
+  ASSERT_EQ(1, cookie);
+  EXPECT_EQ('d', selected_config.language[0]);
+  EXPECT_EQ('e', selected_config.language[1]);
+
+  // The lookup above must not be served for the new configuration.
+  desired_config.language[0] = 'f';
+  desired_config.language[1] = 'r';
+  assetmanager.SetConfiguration(desired_config);
+
+  cookie = assetmanager.GetResource(basic::R::string::test1, false /*may_be_bag*/,
+                                    0 /*density_override*/, &value, &selected_config, &flags);
+  ASSERT_EQ(1, cookie);
+  EXPECT_EQ('f', selected_config.language[0]);
+  EXPECT_EQ('r', selected_config.language[1]);
+
+  memset(&desired_config, 0, sizeof(desired_config));
+  assetmanager.SetConfiguration(desired_config);
+
+  cookie = assetmanager.GetResource(basic::R::string::test1, false /*may_be_bag*/,
+                                    0 /*density_override*/, &value, &selected_config, &flags);
+  ASSERT_EQ(0, cookie);
+  EXPECT_EQ(0, selected_config.language[0]);
+  EXPECT_EQ(0, selected_config.language[1]);
+}
+
+TEST_F(AssetManager2Test, FindsDensityOverrideAcrossConfigurationChanges) {
+  std::unique_ptr<const ApkAssets> hdpi_assets =
+      ApkAssets::Load(GetTestDataPath() + "/basic/basic_hdpi-v4.apk");
+  ASSERT_NE(nullptr, hdpi_assets);
+  std::unique_ptr<const ApkAssets> xhdpi_assets =
+      ApkAssets::Load(GetTestDataPath() + "/basic/basic_xhdpi-v4.apk");
+  ASSERT_NE(nullptr, xhdpi_assets);
+  std::unique_ptr<const ApkAssets> xxhdpi_assets =
+      ApkAssets::Load(GetTestDataPath() + "/basic/basic_xxhdpi-v4.apk");
+  ASSERT_NE(nullptr, xxhdpi_assets);
+
+  ResTable_config desired_config;
+  memset(&desired_config, 0, sizeof(desired_config));
+  desired_config.density = ResTable_config::DENSITY_XHIGH;
+  desired_config.sdkVersion = 21;
+
+  AssetManager2 assetmanager;
+  assetmanager.SetConfiguration(desired_config);
+  assetmanager.SetApkAssets({basic_assets_.get(), basic_de_fr_assets_.get(), hdpi_assets.get(),
+                             xhdpi_assets.get(), xxhdpi_assets.get()});
+
+  Res_value value;
+  ResTable_config selected_config;
+  uint32_t flags;
+
+  ApkAssetsCookie cookie =
+      assetmanager.GetResource(basic::R::string::density, false /*may_be_bag*/,
+                               0 /*density_override*/, &value, &selected_config, &flags);
+  ASSERT_NE(kInvalidCookie, cookie);
+  EXPECT_EQ(ResTable_config::DENSITY_XHIGH, selected_config.density);
+
+  cookie = assetmanager.GetResource(basic::R::string::density, false /*may_be_bag*/,
+                                    ResTable_config::DENSITY_XXHIGH, &value, &selected_config,
+                                    &flags);
+  ASSERT_NE(kInvalidCookie, cookie);
+  EXPECT_EQ(ResTable_config::DENSITY_XXHIGH, selected_config.density);
+
+  // Changing an axis that no density or locale configuration uses keeps the filtered lists,
+  // and changing the locale must still filter the locale configurations again.
+  desired_config.orientation = ResTable_config::ORIENTATION_LAND;
+  assetmanager.SetConfiguration(desired_config);
+  desired_config.language[0] = 'f';
+  desired_config.language[1] = 'r';
+  assetmanager.SetConfiguration(desired_config);
+
+  cookie = assetmanager.GetResource(basic::R::string::density, false /*may_be_bag*/,
+                                    ResTable_config::DENSITY_HIGH, &value, &selected_config,
+                                    &flags);
+  ASSERT_NE(kInvalidCookie, cookie);
+  EXPECT_EQ(ResTable_config::DENSITY_HIGH, selected_config.density);
+
+  cookie = assetmanager.GetResource(basic::R::string::test1, false /*may_be_bag*/,
+                                    ResTable_config::DENSITY_HIGH, &value, &selected_config,
+                                    &flags);
+  ASSERT_EQ(1, cookie);
+  EXPECT_EQ('f', selected_config.language[0]);
+  EXPECT_EQ('r', selected_config.language[1]);
+}
+
 TEST_F(AssetManager2Test, FindsResourceFromSharedLibrary) {
   AssetManager2 assetmanager;
 
@@ -233,6 +334,60 @@ TEST_F(AssetManager2Test, FindsBagResourceFromSingleApkAssets) {
 
 TEST_F(AssetManager2Test, FindsBagResourceFromMultipleApkAssets) {}
 
+TEST_F(AssetManager2Test, SetFromSnapshot) {
+  ResTable_config desired_config;
+  memset(&desired_config, 0, sizeof(desired_config));
+  desired_config.language[0] = 'd';
+  desired_config.language[1] = 'e';
+
+  std::unique_ptr<AssetManager2> source = util::make_unique<AssetManager2>();
+  source->SetConfiguration(desired_config);
+  source->SetApkAssets({basic_assets_.get(), basic_de_fr_assets_.get()});
+  const ResolvedBag* source_bag = source->GetBag(basic::R::array::integerArray1);
+  ASSERT_NE(nullptr, source_bag);
+
+  std::unique_ptr<const AssetManager2::Snapshot> snapshot = source->TakeSnapshot();
+  ASSERT_NE(nullptr, snapshot);
+
+  // The bag resolved before the snapshot is shared, not copied.
+  AssetManager2 assetmanager;
+  assetmanager.SetFromSnapshot(*snapshot);
+  EXPECT_EQ(source_bag, assetmanager.GetBag(basic::R::array::integerArray1));
+
+  // The state outlives the AssetManager it was taken from.
+  source.reset();
+  snapshot.reset();
+
+  Res_value value;
+  ResTable_config selected_config;
+  uint32_t flags;
+  ApkAssetsCookie cookie =
+      assetmanager.GetResource(basic::R::string::test1, false /*may_be_bag*/,
+                               0 /*density_override*/, &value, &selected_config, &flags);
+  ASSERT_NE(kInvalidCookie, cookie);
+  EXPECT_EQ(1, cookie);
+  EXPECT_EQ('d', selected_config.language[0]);
+  EXPECT_EQ('e', selected_config.language[1]);
+
+  const ResolvedBag* bag = assetmanager.GetBag(basic::R::array::integerArray1);
+  ASSERT_NE(nullptr, bag);
+  ASSERT_EQ(3u, bag->entry_count);
+  EXPECT_EQ(Res_value::TYPE_INT_DEC, bag->entries[0].value.dataType);
+  EXPECT_EQ(1u, bag->entries[0].value.data);
+  EXPECT_EQ(Res_value::TYPE_INT_DEC, bag->entries[2].value.dataType);
+  EXPECT_EQ(3u, bag->entries[2].value.data);
+
+  // Changing the configuration copies the shared package groups rather than writing to them.
+  desired_config.language[0] = 'f';
+  desired_config.language[1] = 'r';
+  assetmanager.SetConfiguration(desired_config);
+  cookie = assetmanager.GetResource(basic::R::string::test1, false /*may_be_bag*/,
+                                    0 /*density_override*/, &value, &selected_config, &flags);
+  ASSERT_NE(kInvalidCookie, cookie);
+  EXPECT_EQ('f', selected_config.language[0]);
+  EXPECT_EQ('r', selected_config.language[1]);
+}
+
 TEST_F(AssetManager2Test, FindsBagResourceFromSharedLibrary) {
   AssetManager2 assetmanager;
 
@@ -16,10 +16,39 @@
 
 #include "androidfw/Asset.h"
 
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "android-base/file.h"
+#include "android-base/test_utils.h"
+#include "androidfw/Util.h"
+#include "utils/FileMap.h"
+
 #include "gtest/gtest.h"
 
 namespace android {
 
+// Encodes `data` as raw deflate data made of stored (uncompressed) blocks.
+static std::string DeflateStored(const std::string& data) {
+  std::string out;
+  size_t pos = 0;
+  do {
+    const size_t len = std::min<size_t>(data.size() - pos, 0xffff);
+    const bool final_block = pos + len == data.size();
+    out.push_back(final_block ? 1 : 0);
+    out.push_back(static_cast<char>(len & 0xff));
+    out.push_back(static_cast<char>(len >> 8));
+    out.push_back(static_cast<char>(~len & 0xff));
+    out.push_back(static_cast<char>((~len >> 8) & 0xff));
+    out.append(data, pos, len);
+    pos += len;
+  } while (pos < data.size());
+  return out;
+}
+
 TEST(AssetTest, FileAssetRegistersItself) {
   const int32_t count = Asset::getGlobalCount();
   Asset* asset = new _FileAsset();
@@ -36,4 +65,109 @@ TEST(AssetTest, CompressedAssetRegistersItself) {
   EXPECT_EQ(count, Asset::getGlobalCount());
 }
 
+TEST(AssetTest, CompressedAssetsShareInflatedData) {
+  Asset::setReadAheadEnabled(true);
+  std::string contents(Asset::kInflatedCacheMinSize * 2, '\0');
+  for (size_t i = 0; i < contents.size(); i++) {
+    contents[i] = static_cast<char>(i % 251);
+  }
+  const std::string compressed = DeflateStored(contents);
+
+  TemporaryFile tf;
+  ASSERT_TRUE(base::WriteStringToFd(compressed, tf.fd));
+
+  auto open_asset = [&]() -> std::unique_ptr<_CompressedAsset> {
+    FileMap* map = new FileMap();
+    if (!map->create(tf.path, tf.fd, 0, compressed.size(), true /*readOnly*/)) {
+      delete map;
+      return {};
+    }
+    auto asset = util::make_unique<_CompressedAsset>();
+    EXPECT_EQ(NO_ERROR, asset->openChunk(map, contents.size()));
+    asset->setInflatedCacheKey("AssetTest!CompressedAssetsShareInflatedData", true /*readAhead*/);
+    return asset;
+  };
+
+  std::unique_ptr<_CompressedAsset> first = open_asset();
+  std::unique_ptr<_CompressedAsset> second = open_asset();
+  ASSERT_NE(nullptr, first);
+  ASSERT_NE(nullptr, second);
+
+  const void* data = first->getBuffer(false /*wordAligned*/);
+  ASSERT_NE(nullptr, data);
+  EXPECT_EQ(0, memcmp(contents.data(), data, contents.size()));
+  EXPECT_EQ(data, second->getBuffer(false /*wordAligned*/));
+
+  // Reads go through the same inflated data.
+  char buf[16];
+  ASSERT_EQ(static_cast<ssize_t>(sizeof(buf)), second->read(buf, sizeof(buf)));
+  EXPECT_EQ(0, memcmp(contents.data(), buf, sizeof(buf)));
+}
+
+TEST(AssetTest, ManyReadAheadsAllInflate) {
+  Asset::setReadAheadEnabled(true);
+  std::string contents(Asset::kInflatedCacheMinSize, '\0');
+  for (size_t i = 0; i < contents.size(); i++) {
+    contents[i] = static_cast<char>(i % 251);
+  }
+  const std::string compressed = DeflateStored(contents);
+
+  TemporaryFile tf;
+  ASSERT_TRUE(base::WriteStringToFd(compressed, tf.fd));
+
+  // More than the read-ahead pool queues, so that some are inflated on first use instead.
+  std::vector<std::unique_ptr<_CompressedAsset>> assets;
+  for (int i = 0; i < 32; i++) {
+    FileMap* map = new FileMap();
+    ASSERT_TRUE(map->create(tf.path, tf.fd, 0, compressed.size(), true /*readOnly*/));
+    auto asset = util::make_unique<_CompressedAsset>();
+    ASSERT_EQ(NO_ERROR, asset->openChunk(map, contents.size()));
+    asset->setInflatedCacheKey("AssetTest!ManyReadAheadsAllInflate" + std::to_string(i),
+                               true /*readAhead*/);
+    assets.push_back(std::move(asset));
+  }
+
+  for (const auto& asset : assets) {
+    const void* data = asset->getBuffer(false /*wordAligned*/);
+    ASSERT_NE(nullptr, data);
+    EXPECT_EQ(0, memcmp(contents.data(), data, contents.size()));
+  }
+}
+
+TEST(AssetTest, CloseLeavesReadAheadRunning) {
+  Asset::setReadAheadEnabled(true);
+  std::string contents(Asset::kInflatedCacheMinSize * 2, '\0');
+  for (size_t i = 0; i < contents.size(); i++) {
+    contents[i] = static_cast<char>(i % 251);
+  }
+  const std::string compressed = DeflateStored(contents);
+
+  TemporaryFile tf;
+  ASSERT_TRUE(base::WriteStringToFd(compressed, tf.fd));
+
+  auto open_asset = [&]() -> std::unique_ptr<_CompressedAsset> {
+    FileMap* map = new FileMap();
+    if (!map->create(tf.path, tf.fd, 0, compressed.size(), true /*readOnly*/)) {
+      delete map;
+      return {};
+    }
+    auto asset = util::make_unique<_CompressedAsset>();
+    EXPECT_EQ(NO_ERROR, asset->openChunk(map, contents.size()));
+    asset->setInflatedCacheKey("AssetTest!CloseLeavesReadAheadRunning", true /*readAhead*/);
+    return asset;
+  };
+
+  // Closed before its read-ahead is done, which keeps the map alive until it finishes.
+  std::unique_ptr<_CompressedAsset> first = open_asset();
+  ASSERT_NE(nullptr, first);
+  first.reset();
+
+  // The next asset on the entry picks up the inflated data.
+  std::unique_ptr<_CompressedAsset> second = open_asset();
+  ASSERT_NE(nullptr, second);
+  const void* data = second->getBuffer(false /*wordAligned*/);
+  ASSERT_NE(nullptr, data);
+  EXPECT_EQ(0, memcmp(contents.data(), data, contents.size()));
+}
+
 }  // nameapce android
@@ -79,7 +79,10 @@ static void BM_ApplyStyle(benchmark::State& state) {
 }
 BENCHMARK(BM_ApplyStyle);
 
-static void BM_ApplyStyleFramework(benchmark::State& state) {
+// Resolves the TextView attributes the way inflation does. With `fresh_theme`, every iteration
+// starts from a theme that has not resolved them before, like the first view of its kind. Without
+// it, iterations reuse the theme, like identically styled views in a list.
+static void BM_ApplyStyleFramework(benchmark::State& state, bool fresh_theme) {
   std::unique_ptr<const ApkAssets> framework_apk = ApkAssets::Load(kFrameworkPath);
   if (framework_apk == nullptr) {
     state.SkipWithError("failed to load framework assets");
@@ -144,8 +147,10 @@ static void BM_ApplyStyleFramework(benchmark::State& state) {
   while (xml_tree.next() != ResXMLParser::START_TAG) {
   }
 
+  std::unique_ptr<Theme> base_theme = assetmanager.NewTheme();
+  base_theme->ApplyStyle(Theme_Material_Light);
   std::unique_ptr<Theme> theme = assetmanager.NewTheme();
-  theme->ApplyStyle(Theme_Material_Light);
+  theme->SetTo(*base_theme);
 
   std::array<uint32_t, 92> attrs{
       {0x0101000e, 0x01010034, 0x01010095, 0x01010096, 0x01010097, 0x01010098, 0x01010099,
@@ -166,10 +171,16 @@ static void BM_ApplyStyleFramework(benchmark::State& state) {
   std::array<uint32_t, attrs.size() * STYLE_NUM_ENTRIES> values;
   std::array<uint32_t, attrs.size() + 1> indices;
   while (state.KeepRunning()) {
+    if (fresh_theme) {
+      state.PauseTiming();
+      theme->SetTo(*base_theme);
+      state.ResumeTiming();
+    }
     ApplyStyle(theme.get(), &xml_tree, 0x01010084u /*def_style_attr*/, 0u /*def_style_res*/,
                attrs.data(), attrs.size(), values.data(), indices.data());
   }
 }
-BENCHMARK(BM_ApplyStyleFramework);
+BENCHMARK_CAPTURE(BM_ApplyStyleFramework, same_theme, false);
+BENCHMARK_CAPTURE(BM_ApplyStyleFramework, fresh_theme, true);
 
 }  // namespace android
@@ -156,6 +156,39 @@ TEST_F(AttributeResolutionTest, Theme) {
   EXPECT_EQ(public_flag, values_cursor[STYLE_CHANGING_CONFIGURATIONS]);
 }
 
+TEST_F(AttributeResolutionTest, ResolvedAttributesFollowThemeChanges) {
+  std::unique_ptr<Theme> theme = assetmanager_.NewTheme();
+  ASSERT_TRUE(theme->ApplyStyle(R::style::StyleTwo));
+
+  std::array<uint32_t, 2> attrs{{R::attr::attr_one, R::attr::attr_three}};
+  std::array<uint32_t, attrs.size() * STYLE_NUM_ENTRIES> values;
+  ASSERT_TRUE(ResolveAttrs(theme.get(), 0u /*def_style_attr*/, 0u /*def_style_res*/,
+                           nullptr /*src_values*/, 0 /*src_values_length*/, attrs.data(),
+                           attrs.size(), values.data(), nullptr /*out_indices*/));
+
+  // Resolving again gives the same values.
+  std::array<uint32_t, attrs.size() * STYLE_NUM_ENTRIES> values_again;
+  ASSERT_TRUE(ResolveAttrs(theme.get(), 0u /*def_style_attr*/, 0u /*def_style_res*/,
+                           nullptr /*src_values*/, 0 /*src_values_length*/, attrs.data(),
+                           attrs.size(), values_again.data(), nullptr /*out_indices*/));
+  EXPECT_EQ(values, values_again);
+
+  // Once the theme is cleared, nothing defines the attributes anymore.
+  theme->Clear();
+  ASSERT_TRUE(ResolveAttrs(theme.get(), 0u /*def_style_attr*/, 0u /*def_style_res*/,
+                           nullptr /*src_values*/, 0 /*src_values_length*/, attrs.data(),
+                           attrs.size(), values.data(), nullptr /*out_indices*/));
+  EXPECT_EQ(Res_value::TYPE_NULL, values[STYLE_TYPE]);
+  EXPECT_EQ(Res_value::TYPE_NULL, values[STYLE_NUM_ENTRIES + STYLE_TYPE]);
+
+  // And applying the style again brings them back.
+  ASSERT_TRUE(theme->ApplyStyle(R::style::StyleTwo));
+  ASSERT_TRUE(ResolveAttrs(theme.get(), 0u /*def_style_attr*/, 0u /*def_style_res*/,
+                           nullptr /*src_values*/, 0 /*src_values_length*/, attrs.data(),
+                           attrs.size(), values.data(), nullptr /*out_indices*/));
+  EXPECT_EQ(values_again, values);
+}
+
 TEST_F(AttributeResolutionXmlTest, XmlParser) {
   std::array<uint32_t, 5> attrs{{R::attr::attr_one, R::attr::attr_two, R::attr::attr_three,
                                  R::attr::attr_four, R::attr::attr_empty}};
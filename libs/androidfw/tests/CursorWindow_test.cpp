@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "androidfw/CursorWindow.h"
+
+#include <string.h>
+
+#include <memory>
+
+#include "gtest/gtest.h"
+
+namespace android {
+
+static std::unique_ptr<CursorWindow> CreateWindow(size_t size, uint32_t num_columns) {
+  CursorWindow* window = nullptr;
+  if (CursorWindow::create(String8("CursorWindowTest"), size, &window) != OK) {
+    return {};
+  }
+  std::unique_ptr<CursorWindow> owned_window(window);
+  if (owned_window->setNumColumns(num_columns) != OK) {
+    return {};
+  }
+  return owned_window;
+}
+
+static CursorWindow::FieldValue IntegerValue(int64_t value) {
+  CursorWindow::FieldValue field;
+  field.type = CursorWindow::FIELD_TYPE_INTEGER;
+  field.data.l = value;
+  return field;
+}
+
+TEST(CursorWindowTest, AppendRowStoresEveryFieldType) {
+  std::unique_ptr<CursorWindow> window = CreateWindow(4096, 5);
+  ASSERT_NE(nullptr, window);
+
+  const char string_value[] = "hello";
+  const uint8_t blob_value[] = {1, 2, 3};
+  CursorWindow::FieldValue values[5];
+  values[0].type = CursorWindow::FIELD_TYPE_NULL;
+  values[1] = IntegerValue(42);
+  values[2].type = CursorWindow::FIELD_TYPE_FLOAT;
+  values[2].data.d = 1.5;
+  values[3].type = CursorWindow::FIELD_TYPE_STRING;
+  values[3].data.buffer.data = string_value;
+  values[3].data.buffer.size = sizeof(string_value);
+  values[4].type = CursorWindow::FIELD_TYPE_BLOB;
+  values[4].data.buffer.data = blob_value;
+  values[4].data.buffer.size = sizeof(blob_value);
+  ASSERT_EQ(OK, window->appendRow(values));
+  ASSERT_EQ(1u, window->getNumRows());
+
+  CursorWindow::FieldSlot* slot = window->getFieldSlot(0, 0);
+  ASSERT_NE(nullptr, slot);
+  EXPECT_EQ(CursorWindow::FIELD_TYPE_NULL, window->getFieldSlotType(slot));
+
+  slot = window->getFieldSlot(0, 1);
+  ASSERT_NE(nullptr, slot);
+  EXPECT_EQ(CursorWindow::FIELD_TYPE_INTEGER, window->getFieldSlotType(slot));
+  EXPECT_EQ(42, window->getFieldSlotValueLong(slot));
+
+  slot = window->getFieldSlot(0, 2);
+  ASSERT_NE(nullptr, slot);
+  EXPECT_EQ(CursorWindow::FIELD_TYPE_FLOAT, window->getFieldSlotType(slot));
+  EXPECT_EQ(1.5, window->getFieldSlotValueDouble(slot));
+
+  slot = window->getFieldSlot(0, 3);
+  ASSERT_NE(nullptr, slot);
+  EXPECT_EQ(CursorWindow::FIELD_TYPE_STRING, window->getFieldSlotType(slot));
+  size_t size = 0;
+  EXPECT_STREQ(string_value, window->getFieldSlotValueString(slot, &size));
+  EXPECT_EQ(sizeof(string_value), size);
+
+  slot = window->getFieldSlot(0, 4);
+  ASSERT_NE(nullptr, slot);
+  EXPECT_EQ(CursorWindow::FIELD_TYPE_BLOB, window->getFieldSlotType(slot));
+  const void* blob = window->getFieldSlotValueBlob(slot, &size);
+  ASSERT_EQ(sizeof(blob_value), size);
+  EXPECT_EQ(0, memcmp(blob_value, blob, size));
+}
+
+TEST(CursorWindowTest, LooksUpRowsAfterManyAllocations) {
+  const uint32_t row_count = 1000;
+  std::unique_ptr<CursorWindow> window = CreateWindow(64 * 1024, 1);
+  ASSERT_NE(nullptr, window);
+
+  for (uint32_t row = 0; row < row_count; row++) {
+    ASSERT_EQ(OK, window->allocRow());
+    ASSERT_EQ(OK, window->putLong(row, 0, row));
+  }
+  ASSERT_EQ(row_count, window->getNumRows());
+
+  // Look rows up out of order, since each one is found from its slot at the end of the window.
+  for (uint32_t i = 0; i < row_count; i++) {
+    const uint32_t row = (i * 7919) % row_count;
+    CursorWindow::FieldSlot* slot = window->getFieldSlot(row, 0);
+    ASSERT_NE(nullptr, slot);
+    EXPECT_EQ(static_cast<int64_t>(row), window->getFieldSlotValueLong(slot));
+  }
+  EXPECT_EQ(nullptr, window->getFieldSlot(row_count, 0));
+  EXPECT_EQ(nullptr, window->getFieldSlot(0, 1));
+}
+
+TEST(CursorWindowTest, AppendRowFillsWindowExactly) {
+  const CursorWindow::FieldValue value = IntegerValue(7);
+
+  // Find out what a row takes, including its slot.
+  std::unique_ptr<CursorWindow> window = CreateWindow(4096, 1);
+  ASSERT_NE(nullptr, window);
+  const size_t empty_space = window->freeSpace();
+  ASSERT_EQ(OK, window->appendRow(&value));
+  const size_t row_size = empty_space - window->freeSpace();
+
+  // A window with room for exactly `row_count` rows.
+  const uint32_t row_count = 100;
+  window = CreateWindow(4096 - empty_space + row_count * row_size, 1);
+  ASSERT_NE(nullptr, window);
+  for (uint32_t row = 0; row < row_count; row++) {
+    ASSERT_EQ(OK, window->appendRow(&value));
+  }
+  EXPECT_EQ(0u, window->freeSpace());
+
+  // The row past the boundary doesn't fit, and leaves the window as it was.
+  EXPECT_EQ(NO_MEMORY, window->appendRow(&value));
+  EXPECT_EQ(NO_MEMORY, window->allocRow());
+  EXPECT_EQ(row_count, window->getNumRows());
+  EXPECT_EQ(0u, window->freeSpace());
+
+  CursorWindow::FieldSlot* slot = window->getFieldSlot(row_count - 1, 0);
+  ASSERT_NE(nullptr, slot);
+  EXPECT_EQ(7, window->getFieldSlotValueLong(slot));
+}
+
+TEST(CursorWindowTest, FreeLastRowReturnsSlotSpace) {
+  std::unique_ptr<CursorWindow> window = CreateWindow(4096, 1);
+  ASSERT_NE(nullptr, window);
+
+  ASSERT_EQ(OK, window->allocRow());
+  ASSERT_EQ(OK, window->allocRow());
+  const size_t free_space = window->freeSpace();
+
+  ASSERT_EQ(OK, window->freeLastRow());
+  EXPECT_EQ(1u, window->getNumRows());
+  // The slot is given back. The field directory of the row stays allocated.
+  EXPECT_GT(window->freeSpace(), free_space);
+  EXPECT_EQ(nullptr, window->getFieldSlot(1, 0));
+
+  // The freed slot is used by the next row.
+  const CursorWindow::FieldValue value = IntegerValue(3);
+  ASSERT_EQ(OK, window->appendRow(&value));
+  ASSERT_EQ(2u, window->getNumRows());
+  CursorWindow::FieldSlot* slot = window->getFieldSlot(1, 0);
+  ASSERT_NE(nullptr, slot);
+  EXPECT_EQ(3, window->getFieldSlotValueLong(slot));
+
+  // Freeing more rows than there are is harmless.
+  ASSERT_EQ(OK, window->freeLastRow());
+  ASSERT_EQ(OK, window->freeLastRow());
+  ASSERT_EQ(OK, window->freeLastRow());
+  EXPECT_EQ(0u, window->getNumRows());
+}
+
+}  // namespace android
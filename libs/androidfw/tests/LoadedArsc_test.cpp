@@ -17,6 +17,7 @@
 #include "androidfw/LoadedArsc.h"
 
 #include "android-base/file.h"
+#include "androidfw/Chunk.h"
 #include "androidfw/ResourceUtils.h"
 
 #include "TestHelpers.h"
@@ -66,6 +67,66 @@ TEST(LoadedArscTest, LoadSinglePackageArsc) {
   ASSERT_THAT(LoadedPackage::GetEntry(type, entry_index), NotNull());
 }
 
+TEST(LoadedArscTest, FindEntryByName) {
+  std::string contents;
+  ASSERT_TRUE(ReadFileFromZipToString(GetTestDataPath() + "/basic/basic.apk", "resources.arsc",
+                                      &contents));
+
+  std::unique_ptr<const LoadedArsc> loaded_arsc = LoadedArsc::Load(StringPiece(contents));
+  ASSERT_THAT(loaded_arsc, NotNull());
+
+  const LoadedPackage* package =
+      loaded_arsc->GetPackageById(get_package_id(basic::R::layout::main));
+  ASSERT_THAT(package, NotNull());
+
+  const uint32_t expected_id = basic::R::layout::main & 0x00ffffffu;
+  EXPECT_THAT(package->FindEntryByName(u"layout", u"main"), Eq(expected_id));
+
+  // The second lookup in the same type goes through the index built by the first.
+  EXPECT_THAT(package->FindEntryByName(u"layout", u"layoutt"),
+              Eq(basic::R::layout::layoutt & 0x00ffffffu));
+  EXPECT_THAT(package->FindEntryByName(u"layout", u"main"), Eq(expected_id));
+
+  EXPECT_THAT(package->FindEntryByName(u"layout", u"does_not_exist"), Eq(0u));
+  EXPECT_THAT(package->FindEntryByName(u"does_not_exist", u"main"), Eq(0u));
+}
+
+TEST(LoadedArscTest, DecodedStringsAreCached) {
+  std::string contents;
+  ASSERT_TRUE(ReadFileFromZipToString(GetTestDataPath() + "/basic/basic.apk", "resources.arsc",
+                                      &contents));
+
+  std::unique_ptr<const LoadedArsc> loaded_arsc = LoadedArsc::Load(StringPiece(contents));
+  ASSERT_THAT(loaded_arsc, NotNull());
+
+  const ResStringPool* pool = loaded_arsc->GetStringPool();
+  ASSERT_THAT(pool, NotNull());
+  ASSERT_TRUE(pool->isUTF8());
+  ASSERT_THAT(pool->size(), Ge(1u));
+
+  size_t len;
+  const char16_t* first = pool->stringAt(0, &len);
+  ASSERT_THAT(first, NotNull());
+  size_t u8len;
+  const char* u8str = pool->string8At(0, &u8len);
+  ASSERT_THAT(u8str, NotNull());
+  EXPECT_THAT(String8(first, len).string(), StrEq(std::string(u8str, u8len)));
+
+  // Decoding everything keeps the strings that were already decoded.
+  pool->predecodeStrings();
+  size_t cached_len;
+  EXPECT_THAT(pool->stringAt(0, &cached_len), Eq(first));
+  EXPECT_THAT(cached_len, Eq(len));
+
+  for (size_t i = 0; i < pool->size(); i++) {
+    const char16_t* str = pool->stringAt(i, &len);
+    ASSERT_THAT(str, NotNull());
+    u8str = pool->string8At(i, &u8len);
+    ASSERT_THAT(u8str, NotNull());
+    EXPECT_THAT(String8(str, len).string(), StrEq(std::string(u8str, u8len)));
+  }
+}
+
 TEST(LoadedArscTest, LoadSparseEntryApp) {
   std::string contents;
   ASSERT_TRUE(ReadFileFromZipToString(GetTestDataPath() + "/sparse/sparse.apk", "resources.arsc",
@@ -273,6 +334,92 @@ TEST(LoadedArscTest, LoadOverlay) {
   ASSERT_THAT(LoadedPackage::GetEntry(type_spec->types[0], 0x0000), NotNull());
 }
 
+// Builds a resource table out of the global string pool of `contents` followed by `count` copies
+// of its package, the i-th with package ID `first_id + i`.
+static std::string MakeMultiPackageTable(const std::string& contents, size_t count,
+                                         uint8_t first_id) {
+  std::string pool;
+  std::string package;
+  ChunkIterator iter(contents.data(), contents.size());
+  const Chunk table = iter.Next();
+  ChunkIterator child_iter(table.data_ptr(), table.data_size());
+  while (child_iter.HasNext()) {
+    const Chunk child = child_iter.Next();
+    const char* data = reinterpret_cast<const char*>(child.header<ResChunk_header>());
+    if (child.type() == RES_STRING_POOL_TYPE) {
+      pool.assign(data, child.size());
+    } else if (child.type() == RES_TABLE_PACKAGE_TYPE) {
+      package.assign(data, child.size());
+    }
+  }
+
+  ResTable_header header;
+  header.header.type = htods(RES_TABLE_TYPE);
+  header.header.headerSize = htods(sizeof(header));
+  header.header.size = htodl(sizeof(header) + pool.size() + count * package.size());
+  header.packageCount = htodl(count);
+
+  std::string out(reinterpret_cast<const char*>(&header), sizeof(header));
+  out += pool;
+  for (size_t i = 0; i < count; i++) {
+    reinterpret_cast<ResTable_package*>(&package[0])->id = htodl(first_id + i);
+    out += package;
+  }
+  return out;
+}
+
+TEST(LoadedArscTest, LoadMultiplePackagesInOrder) {
+  std::string contents;
+  ASSERT_TRUE(ReadFileFromZipToString(GetTestDataPath() + "/styles/styles.apk", "resources.arsc",
+                                      &contents));
+
+  // More packages than are loaded at once.
+  const size_t package_count = 9u;
+  const std::string table = MakeMultiPackageTable(contents, package_count, 0x70u);
+  std::unique_ptr<const LoadedArsc> loaded_arsc = LoadedArsc::Load(StringPiece(table));
+  ASSERT_THAT(loaded_arsc, NotNull());
+  ASSERT_THAT(loaded_arsc->GetPackages(), SizeIs(package_count));
+
+  const uint8_t type_index = get_type_id(app::R::string::string_one) - 1;
+  const uint16_t entry_index = get_entry_id(app::R::string::string_one);
+  for (size_t i = 0; i < package_count; i++) {
+    const LoadedPackage* package = loaded_arsc->GetPackages()[i].get();
+    ASSERT_THAT(package, NotNull());
+    EXPECT_THAT(package->GetPackageId(), Eq(0x70u + i));
+    EXPECT_THAT(package->GetPackageName(), StrEq("com.android.app"));
+    EXPECT_THAT(loaded_arsc->GetPackageById(0x70u + i), Eq(package));
+
+    const TypeSpec* type_spec = package->GetTypeSpecByTypeIndex(type_index);
+    ASSERT_THAT(type_spec, NotNull());
+    ASSERT_THAT(type_spec->type_count, Ge(1u));
+    ASSERT_THAT(LoadedPackage::GetEntry(type_spec->types[0], entry_index), NotNull());
+  }
+}
+
+TEST(LoadedArscTest, CorruptPackageFailsWholeTable) {
+  std::string contents;
+  ASSERT_TRUE(ReadFileFromZipToString(GetTestDataPath() + "/styles/styles.apk", "resources.arsc",
+                                      &contents));
+
+  std::string table = MakeMultiPackageTable(contents, 6u, 0x70u);
+
+  // Shrink the header of the second package below the minimum, leaving the chunks intact.
+  ChunkIterator iter(table.data(), table.size());
+  const Chunk table_chunk = iter.Next();
+  ChunkIterator child_iter(table_chunk.data_ptr(), table_chunk.data_size());
+  int packages_seen = 0;
+  while (child_iter.HasNext()) {
+    const Chunk child = child_iter.Next();
+    if (child.type() == RES_TABLE_PACKAGE_TYPE && ++packages_seen == 2) {
+      ResChunk_header* header = const_cast<ResChunk_header*>(child.header<ResChunk_header>());
+      header->headerSize = htods(sizeof(ResChunk_header));
+    }
+  }
+  ASSERT_THAT(packages_seen, Eq(6));
+
+  EXPECT_THAT(LoadedArsc::Load(StringPiece(table)), IsNull());
+}
+
 // structs with size fields (like Res_value, ResTable_entry) should be
 // backwards and forwards compatible (aka checking the size field against
 // sizeof(Res_value) might not be backwards compatible.